@@ -1,4 +1,13 @@
 #include <dpp/dpp.h>
+#include "cooldown.h"
+#include "entity_counters.h"
+#include "gateway_loadgen.h"
+#include "gateway_record.h"
+#include "metrics.h"
+#include "thread_placement.h"
+#include "trace.h"
+#include "warmup.h"
+#include "watchdog.h"
 
 /* Be sure to place your token in the line below.
  * Follow steps here to get a token: https://dpp.dev/creating-a-bot-application.html
@@ -9,30 +18,160 @@
 const std::string    BOT_TOKEN    = "add your token here";
 const dpp::snowflake MY_GUILD_ID  =  825407338755653642;
 
+/* Read an environment variable, or an empty string if it is not set */
+std::string env(const char* name)
+{
+#ifdef _WIN32
+    std::string out;
+    char* value = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&value, &length, name) == 0 && value != nullptr) {
+        out = value;
+        free(value);
+    }
+    return out;
+#else
+    const char* value = std::getenv(name);
+    return value ? value : "";
+#endif
+}
+
 int main()
 {
+    /* Startup phases are timed from here */
+    mybot::startup_phases startup;
+
+    /* Set MYBOT_LOADGEN_GATEWAY to the host of a TLS front for gateway_loadgen to
+     * scale test against synthetic traffic; it serves uncompressed JSON only
+     */
+    std::string loadgen_gateway = env("MYBOT_LOADGEN_GATEWAY");
+
     /* Create bot cluster */
-    dpp::cluster bot(BOT_TOKEN);
+    dpp::cluster bot(BOT_TOKEN, dpp::i_default_intents, 0, 0, 1, loadgen_gateway.empty());
 
     /* Output simple log messages to stdout */
     bot.on_log(dpp::utility::cout_logger());
 
+    /* Attached before any other handler, so that lag is measured to the first one */
+    mybot::loadgen_probe probe;
+    if (!loadgen_gateway.empty()) {
+        bot.set_default_gateway(loadgen_gateway);
+        probe.attach(bot);
+        bot.start_timer([&bot, &probe](dpp::timer) {
+            bot.log(dpp::ll_info, "Load: " + probe.report().str());
+        }, 10);
+    }
+
+    /* Set MYBOT_TRACE to record spans; fetch them from /trace on the metrics port */
+    if (!env("MYBOT_TRACE").empty()) {
+        mybot::tracing_start();
+    }
+
+    /* Each user may run commands five times in ten seconds */
+    mybot::cooldown_config cooldown_config;
+    cooldown_config.kind = mybot::cooldown_sliding_window;
+    cooldown_config.limit = 5;
+    cooldown_config.window = std::chrono::seconds(10);
+    mybot::cooldown_table cooldowns(cooldown_config);
+    cooldowns.expire_on(bot);
+
     /* Handle slash command */
-    bot.on_interaction_create([](const dpp::interaction_create_t& event) {
+    bot.on_interaction_create(mybot::watched("interaction_create", mybot::traced("interaction_create", [&cooldowns](const dpp::interaction_create_t& event) {
+        if (auto wait = cooldowns.try_acquire(event); wait.count() > 0) {
+            event.reply(dpp::message("Slow down! Try again in " + std::to_string((wait.count() + 999) / 1000) + "s.").set_flags(dpp::m_ephemeral));
+            return;
+        }
          if (event.command.get_command_name() == "ping") {
             event.reply("Pong!");
         }
-    });
+    })));
+
+    /* Set MYBOT_RECORD to a file name to record gateway traffic for replaying later */
+    std::unique_ptr<mybot::gateway_recorder> recorder;
+    if (std::string path = env("MYBOT_RECORD"); !path.empty()) {
+        recorder = std::make_unique<mybot::gateway_recorder>(path);
+        recorder->attach(bot);
+    }
+
+    /* Set MYBOT_REPLAY to a recording to play it into the shards once the first is
+     * ready, at MYBOT_REPLAY_SPEED times real time (0 for as fast as possible)
+     */
+    std::unique_ptr<mybot::gateway_replay> replay;
+    if (std::string path = env("MYBOT_REPLAY"); !path.empty()) {
+        mybot::replay_config config;
+        if (std::string speed = env("MYBOT_REPLAY_SPEED"); !speed.empty()) {
+            config.speed = std::atof(speed.c_str());
+        }
+        replay = std::make_unique<mybot::gateway_replay>(bot, path, config);
+    }
+
+    /* Resolve Discord's hosts and set up TLS while the shards connect */
+    mybot::io_loop io;
+    mybot::dns_resolver resolver(io);
+    mybot::connection_warmup warmup(bot, resolver, startup);
+
+    /* Log anything which holds up the loops, shards or a handler for two seconds */
+    mybot::watchdog_config watchdog_config;
+    watchdog_config.on_stall = [&bot](const mybot::watchdog_stall& stall) {
+        if (stall.ended) {
+            bot.log(dpp::ll_info, "Stall on " + stall.loop + " over after " + std::to_string(static_cast<uint64_t>(stall.stalled_ms)) + "ms");
+        } else {
+            bot.log(dpp::ll_warning, "Stall on " + stall.loop + " for " + std::to_string(static_cast<uint64_t>(stall.stalled_ms)) + "ms" + (stall.task.empty() ? "" : " in " + stall.task));
+        }
+    };
+    mybot::watchdog watchdog(watchdog_config);
+    watchdog.watch(io, "io_loop");
+    watchdog.watch(bot);
+
+    /* Set MYBOT_PLACEMENT to pin threads to CPUs, e.g. "io=0;shards=2-15/1;voice=1" */
+    mybot::thread_placement placement = mybot::parse_placement(env("MYBOT_PLACEMENT"));
+    mybot::place(io, placement.io, "io_loop");
+    mybot::place(bot, placement);
+    if (!placement.pool.empty()) {
+        /* pool= is for work_pool_config::cpus, and MyBot runs no work_pool */
+        bot.log(dpp::ll_warning, "MYBOT_PLACEMENT sets pool=, but there is no work_pool to place; ignoring it");
+    }
+
+    /* Guild, member and channel totals, kept up to date from events */
+    mybot::entity_counters counters;
+    counters.attach(bot);
+
+    /* Set MYBOT_METRICS_PORT to serve Prometheus metrics at http://127.0.0.1:port/metrics */
+    mybot::metrics_registry metrics;
+    std::unique_ptr<mybot::metrics_server> metrics_server;
+    if (std::string port = env("MYBOT_METRICS_PORT"); !port.empty()) {
+        mybot::add_dpp_metrics(metrics, bot);
+        mybot::add_entity_metrics(metrics, counters);
+        mybot::add_rest_pool_metrics(metrics);
+        mybot::add_watchdog_metrics(metrics, watchdog);
+        metrics_server = std::make_unique<mybot::metrics_server>(io, metrics, static_cast<uint16_t>(std::atoi(port.c_str())));
+    }
 
     /* Register slash command here in on_ready */
-    bot.on_ready([&bot](const dpp::ready_t& event) {
+    bot.on_ready([&bot, &startup, &warmup, &replay](const dpp::ready_t& event) {
         /* Wrap command registration in run_once to make sure it doesnt run on every full reconnection */
         if (dpp::run_once<struct register_bot_commands>()) {
-            bot.guild_command_create(dpp::slashcommand("ping", "Ping pong!", bot.me.id), MY_GUILD_ID);
+            startup.mark("first shard ready");
+            if (replay) {
+                replay->start([&bot](const mybot::replay_stats& stats) {
+                    bot.log(dpp::ll_info, "Replayed " + std::to_string(stats.dispatched) + " events in " + std::to_string(stats.seconds) + "s (" + std::to_string(static_cast<uint64_t>(stats.events_per_second)) + "/s)");
+                });
+            }
+            warmup.when_ready([&bot, &startup]() {
+                bot.guild_command_create(dpp::slashcommand("ping", "Ping pong!", bot.me.id), MY_GUILD_ID, [&bot, &startup](const dpp::confirmation_callback_t& callback) {
+                    if (callback.is_error()) {
+                        bot.log(dpp::ll_error, "Can't register commands: " + callback.get_error().message);
+                    }
+                    startup.mark("commands registered");
+                    startup.log(bot);
+                });
+            });
         }
     });
 
     /* Start the bot */
+    warmup.start();
+    startup.mark("cluster start");
     bot.start(false);
 
     return 0;
@@ -0,0 +1,54 @@
+#include "compact_types.h"
+
+namespace mybot {
+
+/* Compact layouts must actually be smaller than what they replace. A member
+ * holds its first four roles inline, so compare it against a guild_member
+ * plus the heap block its role vector would need for the same four roles.
+ */
+static_assert(sizeof(compact_member) <= sizeof(dpp::guild_member) + 4 * sizeof(dpp::snowflake), "compact_member should be no bigger than dpp::guild_member and its roles");
+static_assert(sizeof(compact_message) < sizeof(dpp::message), "compact_message should be smaller than dpp::message");
+static_assert(sizeof(compact_channel) < sizeof(dpp::channel), "compact_channel should be smaller than dpp::channel");
+static_assert(sizeof(compact_role) < sizeof(dpp::role), "compact_role should be smaller than dpp::role");
+
+compact_member::compact_member(const dpp::guild_member& m)
+    : user_id(m.user_id), guild_id(m.guild_id), joined_at(m.joined_at), premium_since(m.premium_since),
+      communication_disabled_until(m.communication_disabled_until), avatar(m.avatar),
+      roles(m.get_roles().begin(), m.get_roles().end()), nickname(m.get_nickname())
+{
+}
+
+bool compact_member::has_role(dpp::snowflake role_id) const {
+    return std::find(roles.begin(), roles.end(), role_id) != roles.end();
+}
+
+compact_message::compact_message(const dpp::message& m)
+    : id(m.id), channel_id(m.channel_id), guild_id(m.guild_id), author_id(m.author.id), sent(m.sent), edited(m.edited),
+      mention_roles(m.mention_roles.begin(), m.mention_roles.end()), content(m.content), flags(m.flags),
+      embed_count(static_cast<uint8_t>(std::min<size_t>(m.embeds.size(), UINT8_MAX))),
+      component_count(static_cast<uint8_t>(std::min<size_t>(m.components.size(), UINT8_MAX))),
+      attachment_count(static_cast<uint8_t>(std::min<size_t>(m.attachments.size(), UINT8_MAX))),
+      mention_everyone(m.mention_everyone)
+{
+    mentions.reserve(m.mentions.size());
+    for (const auto& mention : m.mentions) {
+        mentions.push_back(mention.first.id);
+    }
+}
+
+compact_channel::compact_channel(const dpp::channel& c)
+    : id(c.id), guild_id(c.guild_id), parent_id(c.parent_id), name(c.name), position(c.position), flags(c.flags)
+{
+    permission_overwrites.reserve(c.permission_overwrites.size());
+    for (const auto& po : c.permission_overwrites) {
+        permission_overwrites.push_back({po.id, static_cast<uint64_t>(po.allow), static_cast<uint64_t>(po.deny), po.type});
+    }
+}
+
+compact_role::compact_role(const dpp::role& r)
+    : id(r.id), guild_id(r.guild_id), permissions(static_cast<uint64_t>(r.permissions)), colour(r.colour),
+      position(r.position), flags(r.flags), name(r.name)
+{
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <dpp/dpp.h>
+#include "small_vector.h"
+
+namespace mybot {
+
+/**
+ * @brief Snowflake list sized for the common case of a few entries
+ * @tparam N inline capacity
+ */
+template<size_t N> using snowflake_list = small_vector<dpp::snowflake, N>;
+
+/**
+ * @brief A guild member as the bot keeps it in its own long lived storage.
+ *
+ * dpp::guild_member holds its roles in an std::vector, which is a heap
+ * allocation for every member with at least one role. Most members have
+ * four or fewer, which fit inline here. The avatar is kept as the 128 bit
+ * dpp::utility::iconhash and timestamps as time_t, never as strings.
+ */
+struct compact_member {
+    dpp::snowflake user_id;
+    dpp::snowflake guild_id;
+    time_t joined_at{0};
+    time_t premium_since{0};
+    time_t communication_disabled_until{0};
+    dpp::utility::iconhash avatar;
+    snowflake_list<4> roles;
+    std::string nickname;
+
+    compact_member() = default;
+
+    /**
+     * @brief Build from a D++ guild member
+     * @param m member to copy from
+     */
+    explicit compact_member(const dpp::guild_member& m);
+
+    /**
+     * @brief Returns true if the member has the given role
+     * @param role_id role id
+     */
+    bool has_role(dpp::snowflake role_id) const;
+};
+
+/**
+ * @brief The parts of a message the bot keeps after the event has been handled.
+ * Embeds, components and attachments are only counted, as nothing downstream
+ * needs their content once the handler has run.
+ */
+struct compact_message {
+    dpp::snowflake id;
+    dpp::snowflake channel_id;
+    dpp::snowflake guild_id;
+    dpp::snowflake author_id;
+    time_t sent{0};
+    time_t edited{0};
+    snowflake_list<4> mentions;
+    snowflake_list<2> mention_roles;
+    std::string content;
+    uint16_t flags{0};
+    uint8_t embed_count{0};
+    uint8_t component_count{0};
+    uint8_t attachment_count{0};
+    bool mention_everyone{false};
+
+    compact_message() = default;
+
+    /**
+     * @brief Build from a D++ message
+     * @param m message to copy from
+     */
+    explicit compact_message(const dpp::message& m);
+};
+
+/**
+ * @brief A channel permission overwrite without the virtual permission wrappers
+ */
+struct compact_overwrite {
+    dpp::snowflake id;
+    uint64_t allow{0};
+    uint64_t deny{0};
+    uint8_t type{0};
+
+    bool operator==(const compact_overwrite& other) const {
+        return id == other.id && allow == other.allow && deny == other.deny && type == other.type;
+    }
+};
+
+/**
+ * @brief A channel as the bot keeps it in its own long lived storage
+ */
+struct compact_channel {
+    dpp::snowflake id;
+    dpp::snowflake guild_id;
+    dpp::snowflake parent_id;
+    small_vector<compact_overwrite, 4> permission_overwrites;
+    std::string name;
+    uint16_t position{0};
+    uint16_t flags{0};
+
+    compact_channel() = default;
+
+    /**
+     * @brief Build from a D++ channel
+     * @param c channel to copy from
+     */
+    explicit compact_channel(const dpp::channel& c);
+};
+
+/**
+ * @brief A role as the bot keeps it in its own long lived storage
+ */
+struct compact_role {
+    dpp::snowflake id;
+    dpp::snowflake guild_id;
+    uint64_t permissions{0};
+    uint32_t colour{0};
+    uint8_t position{0};
+    uint8_t flags{0};
+    std::string name;
+
+    compact_role() = default;
+
+    /**
+     * @brief Build from a D++ role
+     * @param r role to copy from
+     */
+    explicit compact_role(const dpp::role& r);
+};
+
+}
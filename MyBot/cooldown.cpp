@@ -0,0 +1,247 @@
+#include "cooldown.h"
+#include <algorithm>
+#include <cmath>
+
+namespace mybot {
+
+namespace {
+
+constexpr uint32_t ways = 4;
+constexpr uint64_t token_unit = 1024;
+constexpr uint64_t token_mask = (1ull << 24) - 1;
+
+uint64_t key_hash(std::string_view command, dpp::snowflake id) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : command) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    /* splitmix64 finaliser, so that ids differing in low bits spread over sets */
+    h ^= static_cast<uint64_t>(id) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h == 0 ? 1 : h;
+}
+
+std::chrono::milliseconds wait_ms(double ms) {
+    return std::chrono::milliseconds(std::max<int64_t>(static_cast<int64_t>(std::ceil(ms)), 1));
+}
+
+}
+
+struct cooldown_table::slot {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> state{0};
+};
+
+cooldown_table::cooldown_table(const cooldown_config& cfg) : config(cfg), epoch(std::chrono::steady_clock::now()) {
+    config.window = std::max(config.window, std::chrono::milliseconds(1));
+    config.limit = std::max<uint32_t>(config.limit, 1);
+    if (config.kind == cooldown_sliding_window) {
+        config.limit = std::min<uint32_t>(config.limit, 0xffff);
+    } else if (config.kind == cooldown_token_bucket) {
+        config.limit = std::min<uint32_t>(config.limit, static_cast<uint32_t>(token_mask / token_unit));
+    }
+    sets = std::max<uint32_t>((config.slots + ways - 1) / ways, 1);
+    table = std::make_unique<slot[]>(static_cast<size_t>(sets) * ways);
+}
+
+cooldown_table::~cooldown_table() {
+    if (owner != nullptr) {
+        owner->stop_timer(sweeper);
+    }
+}
+
+uint64_t cooldown_table::now_ms() const {
+    /* Starting two windows in means a zeroed state is expired for every kind */
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch);
+    return static_cast<uint64_t>(elapsed.count() + 2 * config.window.count());
+}
+
+bool cooldown_table::expired(uint64_t state, uint64_t now) const {
+    uint64_t window = static_cast<uint64_t>(config.window.count());
+    switch (config.kind) {
+        case cooldown_fixed_window:
+            return (state >> 32) < now / window;
+        case cooldown_sliding_window:
+            return (state >> 32) + 1 < now / window;
+        case cooldown_token_bucket:
+            return now - (state >> 24) >= window;
+    }
+    return true;
+}
+
+cooldown_table::slot* cooldown_table::find(uint64_t key, bool create, uint64_t now) {
+    slot* set = &table[static_cast<size_t>(key % sets) * ways];
+    for (uint32_t i = 0; i < ways; ++i) {
+        if (set[i].key.load(std::memory_order_acquire) == key) {
+            return &set[i];
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+    /* An empty slot, else one whose cooldown has run out. An expired state
+     * means the same as a fresh one, so the slot needs no resetting.
+     */
+    uint32_t claimed = ways;
+    for (uint32_t i = 0; i < ways && claimed == ways; ++i) {
+        uint64_t k = 0;
+        if (set[i].key.compare_exchange_strong(k, key)) {
+            claimed = i;
+        }
+    }
+    for (uint32_t i = 0; i < ways && claimed == ways; ++i) {
+        uint64_t k = set[i].key.load(std::memory_order_acquire);
+        if (k != key && expired(set[i].state.load(std::memory_order_acquire), now) && set[i].key.compare_exchange_strong(k, key)) {
+            claimed = i;
+        }
+    }
+    if (claimed == ways) {
+        return nullptr;
+    }
+    /* Threads claiming the same key at once settle on the lowest slot */
+    for (uint32_t i = 0; i < claimed; ++i) {
+        if (set[i].key.load(std::memory_order_acquire) == key) {
+            uint64_t k = key;
+            set[claimed].key.compare_exchange_strong(k, 0);
+            return &set[i];
+        }
+    }
+    return &set[claimed];
+}
+
+std::chrono::milliseconds cooldown_table::try_acquire(std::string_view command, dpp::snowflake id) {
+    uint64_t now = now_ms();
+    slot* s = find(key_hash(command, id), true, now);
+    if (s == nullptr) {
+        overflow_count.fetch_add(1, std::memory_order_relaxed);
+        return std::chrono::milliseconds(0);
+    }
+    uint64_t window = static_cast<uint64_t>(config.window.count());
+    uint64_t limit = config.limit;
+    uint64_t state = s->state.load(std::memory_order_acquire);
+    for (;;) {
+        uint64_t next;
+        if (config.kind == cooldown_fixed_window) {
+            /* window number : 32, uses : 32 */
+            uint64_t w = now / window;
+            uint64_t used = (state >> 32) == w ? state & 0xffffffff : 0;
+            if (used >= limit) {
+                return wait_ms(static_cast<double>((w + 1) * window - now));
+            }
+            next = (w << 32) | (used + 1);
+        } else if (config.kind == cooldown_sliding_window) {
+            /* window number : 32, previous window's uses : 16, this window's : 16 */
+            uint64_t w = now / window;
+            uint64_t sw = state >> 32;
+            uint64_t previous = 0;
+            uint64_t current = 0;
+            if (sw == w) {
+                previous = (state >> 16) & 0xffff;
+                current = state & 0xffff;
+            } else if (sw + 1 == w) {
+                previous = state & 0xffff;
+            }
+            double into = static_cast<double>(now - w * window) / static_cast<double>(window);
+            if (static_cast<double>(previous) * (1.0 - into) + static_cast<double>(current) + 1.0 > static_cast<double>(limit)) {
+                if (current + 1 > limit) {
+                    return wait_ms(static_cast<double>((w + 1) * window - now));
+                }
+                /* When enough of the previous window has slid out */
+                double until = static_cast<double>(window) * (1.0 - static_cast<double>(limit - current - 1) / static_cast<double>(previous));
+                return wait_ms(static_cast<double>(w * window) + until - static_cast<double>(now));
+            }
+            next = (w << 32) | (previous << 16) | std::min<uint64_t>(current + 1, 0xffff);
+        } else {
+            /* last refill in ms : 40, tokens in 1/1024ths : 24 */
+            uint64_t capacity = limit * token_unit;
+            uint64_t last = state >> 24;
+            uint64_t tokens = state & token_mask;
+            uint64_t elapsed = now - std::min(last, now);
+            tokens = elapsed >= window ? capacity : std::min(capacity, tokens + elapsed * capacity / window);
+            if (tokens < token_unit) {
+                return wait_ms(static_cast<double>(token_unit - tokens) * static_cast<double>(window) / static_cast<double>(capacity));
+            }
+            next = (now << 24) | (tokens - token_unit);
+        }
+        if (s->state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+            return std::chrono::milliseconds(0);
+        }
+    }
+}
+
+std::chrono::milliseconds cooldown_table::try_acquire(const dpp::interaction_create_t& event) {
+    if (event.command.type != dpp::it_application_command) {
+        return std::chrono::milliseconds(0);
+    }
+    dpp::snowflake id = event.command.usr.id;
+    if (config.scope == cooldown_guild && !event.command.guild_id.empty()) {
+        id = event.command.guild_id;
+    } else if (config.scope == cooldown_channel) {
+        id = event.command.channel_id;
+    }
+    return try_acquire(event.command.get_command_name(), id);
+}
+
+std::chrono::milliseconds cooldown_table::try_acquire(std::string_view command, const dpp::command_source& source) {
+    dpp::snowflake id = source.issuer.id;
+    if (config.scope == cooldown_guild && !source.guild_id.empty()) {
+        id = source.guild_id;
+    } else if (config.scope == cooldown_channel) {
+        id = source.channel_id;
+    }
+    return try_acquire(command, id);
+}
+
+void cooldown_table::reset(std::string_view command, dpp::snowflake id) {
+    if (slot* s = find(key_hash(command, id), false, 0)) {
+        s->state.store(0, std::memory_order_release);
+    }
+}
+
+size_t cooldown_table::sweep() {
+    uint64_t now = now_ms();
+    size_t used = 0;
+    size_t total = static_cast<size_t>(sets) * ways;
+    for (size_t i = 0; i < total; ++i) {
+        slot& s = table[i];
+        uint64_t k = s.key.load(std::memory_order_acquire);
+        if (k == 0) {
+            continue;
+        }
+        uint64_t state = s.state.load(std::memory_order_acquire);
+        if (!expired(state, now) || !s.key.compare_exchange_strong(k, 0)) {
+            used++;
+            continue;
+        }
+        /* A use between reading the state and clearing the key; put it back */
+        if (s.state.load(std::memory_order_acquire) != state) {
+            uint64_t empty = 0;
+            if (s.key.compare_exchange_strong(empty, k)) {
+                used++;
+            }
+        }
+    }
+    return used;
+}
+
+void cooldown_table::expire_on(dpp::cluster& bot, uint64_t interval) {
+    if (owner != nullptr) {
+        owner->stop_timer(sweeper);
+    }
+    owner = &bot;
+    sweeper = bot.start_timer([this](dpp::timer) {
+        sweep();
+    }, std::max<uint64_t>(interval, 1));
+}
+
+uint64_t cooldown_table::overflows() const {
+    return overflow_count.load(std::memory_order_relaxed);
+}
+
+size_t cooldown_table::capacity() const {
+    return static_cast<size_t>(sets) * ways;
+}
+
+}
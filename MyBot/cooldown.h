@@ -0,0 +1,187 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace mybot {
+
+/**
+ * @brief How a cooldown_table counts uses
+ */
+enum cooldown_kind {
+    /**
+     * @brief At most limit uses per window, the count resetting at each
+     * window boundary
+     */
+    cooldown_fixed_window,
+
+    /**
+     * @brief At most limit uses in any window long stretch, estimated from
+     * the current and previous windows' counts. Limits up to 65535.
+     */
+    cooldown_sliding_window,
+
+    /**
+     * @brief A bucket of limit uses refilling evenly over window, which
+     * allows a burst and then a steady rate. Limits up to 16383.
+     */
+    cooldown_token_bucket,
+};
+
+/**
+ * @brief What a cooldown is counted per
+ */
+enum cooldown_scope {
+    /**
+     * @brief Each user, across every guild
+     */
+    cooldown_user,
+
+    /**
+     * @brief Each guild, or each user in direct messages
+     */
+    cooldown_guild,
+
+    /**
+     * @brief Each channel
+     */
+    cooldown_channel,
+};
+
+/**
+ * @brief Settings for a cooldown_table
+ */
+struct cooldown_config {
+    /**
+     * @brief Counting method
+     */
+    cooldown_kind kind{cooldown_fixed_window};
+
+    /**
+     * @brief Scope the helpers taking an event key by
+     */
+    cooldown_scope scope{cooldown_user};
+
+    /**
+     * @brief Uses allowed per window, or the bucket's size
+     */
+    uint32_t limit{1};
+
+    /**
+     * @brief Window length, or the time to refill an empty bucket
+     */
+    std::chrono::milliseconds window{5000};
+
+    /**
+     * @brief Entries kept at most, rounded up to a multiple of four. Each
+     * takes 16 bytes.
+     */
+    uint32_t slots{65536};
+};
+
+/**
+ * @brief A fixed size, lock free table of cooldowns keyed by command and
+ * user, guild or channel.
+ *
+ * Each key hashes to a set of four slots. A slot is two atomics, the key's
+ * hash and its whole state packed into 64 bits, so a check is a lookup in
+ * the set and one compare-and-swap, with no lock and no allocation. Memory is
+ * fixed when the table is made. A new key takes an empty slot in its set, or
+ * one whose cooldown has run out; if every slot there is still cooling down
+ * the use is allowed and counted in overflows(), so size slots well above
+ * the keys active at once. Expired slots are cleared by sweep(), which
+ * expire_on() runs from a cluster timer.
+ *
+ * Racing first uses of one key may each be allowed once before they settle
+ * on one slot, and a use racing the eviction of an expired key may be
+ * counted against the key taking its place.
+ */
+class cooldown_table {
+    struct slot;
+
+    cooldown_config config;
+    uint32_t sets{0};
+    std::unique_ptr<slot[]> table;
+    std::chrono::steady_clock::time_point epoch;
+    std::atomic<uint64_t> overflow_count{0};
+    dpp::cluster* owner{nullptr};
+    dpp::timer sweeper{0};
+
+    uint64_t now_ms() const;
+    bool expired(uint64_t state, uint64_t now) const;
+    slot* find(uint64_t key, bool create, uint64_t now);
+
+public:
+    /**
+     * @brief Create an empty table
+     * @param cfg settings
+     */
+    explicit cooldown_table(const cooldown_config& cfg = {});
+
+    /**
+     * @brief Stop the sweep timer, if any
+     */
+    ~cooldown_table();
+
+    cooldown_table(const cooldown_table&) = delete;
+    cooldown_table& operator=(const cooldown_table&) = delete;
+
+    /**
+     * @brief Count a use if one is allowed
+     * @param command command name
+     * @param id user, guild or channel id
+     * @return zero if allowed and counted, otherwise how long until a use
+     * would be allowed
+     */
+    std::chrono::milliseconds try_acquire(std::string_view command, dpp::snowflake id);
+
+    /**
+     * @brief Count a use of a slash command, keyed by the configured scope.
+     * Other interactions, such as button clicks, are always allowed.
+     * @param event event, e.g. from on_slashcommand
+     * @return zero if allowed, otherwise how long to wait
+     */
+    std::chrono::milliseconds try_acquire(const dpp::interaction_create_t& event);
+
+    /**
+     * @brief Count a use of a command registered with
+     * dpp::commandhandler::add_command, keyed by the configured scope
+     * @param command command name
+     * @param source source passed to the command's handler
+     * @return zero if allowed, otherwise how long to wait
+     */
+    std::chrono::milliseconds try_acquire(std::string_view command, const dpp::command_source& source);
+
+    /**
+     * @brief Forget a key's uses
+     * @param command command name
+     * @param id user, guild or channel id
+     */
+    void reset(std::string_view command, dpp::snowflake id);
+
+    /**
+     * @brief Clear every slot whose cooldown has run out
+     * @return slots still in use
+     */
+    size_t sweep();
+
+    /**
+     * @brief Run sweep() from a cluster timer until the table is destroyed
+     * @param bot cluster
+     * @param interval seconds between sweeps
+     */
+    void expire_on(dpp::cluster& bot, uint64_t interval = 60);
+
+    /**
+     * @brief Uses allowed because their set was full
+     */
+    uint64_t overflows() const;
+
+    /**
+     * @brief Total slots
+     */
+    size_t capacity() const;
+};
+
+}
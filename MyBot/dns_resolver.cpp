@@ -0,0 +1,671 @@
+#include "dns_resolver.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <random>
+#include <sstream>
+#ifdef _WIN32
+#include <iphlpapi.h>
+#endif
+
+namespace mybot {
+
+namespace {
+
+constexpr uint16_t type_a = 1;
+constexpr uint16_t type_soa = 6;
+constexpr uint16_t type_aaaa = 28;
+constexpr uint16_t class_in = 1;
+constexpr uint8_t rcode_nxdomain = 3;
+constexpr size_t header_size = 12;
+
+#ifdef _WIN32
+constexpr int error_timed_out = WSAETIMEDOUT;
+#else
+constexpr int error_timed_out = ETIMEDOUT;
+#endif
+
+uint16_t random_id() {
+    thread_local std::mt19937 rng{std::random_device{}()};
+    return static_cast<uint16_t>(rng());
+}
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void write16(std::string& out, uint16_t v) {
+    out += static_cast<char>(v >> 8);
+    out += static_cast<char>(v & 0xff);
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (!s.empty() && s.back() == '.') {
+        s.pop_back();
+    }
+    return s;
+}
+
+/**
+ * @brief Build a recursive query for one name and type
+ * @return false if the name can't be encoded
+ */
+bool build_query(uint16_t id, const std::string& name, uint16_t type, std::string& out) {
+    if (name.empty() || name.size() > 253) {
+        return false;
+    }
+    out.clear();
+    write16(out, id);
+    write16(out, 0x0100); /* RD */
+    write16(out, 1);
+    write16(out, 0);
+    write16(out, 0);
+    write16(out, 0);
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t dot = name.find('.', start);
+        if (dot == std::string::npos) {
+            dot = name.size();
+        }
+        size_t label = dot - start;
+        if (label == 0 || label > 63) {
+            return false;
+        }
+        out += static_cast<char>(label);
+        out.append(name, start, label);
+        start = dot + 1;
+    }
+    out += '\0';
+    write16(out, type);
+    write16(out, class_in);
+    return true;
+}
+
+/**
+ * @brief Step over a possibly compressed name
+ */
+bool skip_name(const uint8_t* msg, size_t len, size_t& pos) {
+    while (pos < len) {
+        uint8_t b = msg[pos];
+        if (b == 0) {
+            pos++;
+            return true;
+        }
+        if ((b & 0xC0) == 0xC0) {
+            pos += 2;
+            return pos <= len;
+        }
+        if (b & 0xC0) {
+            return false;
+        }
+        pos += 1 + b;
+    }
+    return false;
+}
+
+/**
+ * @brief The parts of a reply the resolver cares about
+ */
+struct dns_reply {
+    uint16_t id{0};
+    uint8_t rcode{0};
+    bool truncated{false};
+    std::vector<ip_address> addresses;
+    uint32_t ttl{UINT32_MAX};
+    bool has_soa{false};
+    uint32_t soa_ttl{0};
+};
+
+bool parse_reply(const uint8_t* msg, size_t len, uint16_t qtype, dns_reply& out) {
+    if (len < header_size) {
+        return false;
+    }
+    uint16_t flags = read16(msg + 2);
+    if (!(flags & 0x8000)) {
+        return false;
+    }
+    out.id = read16(msg);
+    out.rcode = flags & 0x0f;
+    out.truncated = (flags & 0x0200) != 0;
+    uint16_t questions = read16(msg + 4);
+    uint16_t answers = read16(msg + 6);
+    uint16_t authority = read16(msg + 8);
+    size_t pos = header_size;
+    for (uint16_t i = 0; i < questions; ++i) {
+        if (!skip_name(msg, len, pos) || pos + 4 > len) {
+            return false;
+        }
+        pos += 4;
+    }
+    for (uint32_t i = 0; i < uint32_t(answers) + authority; ++i) {
+        if (!skip_name(msg, len, pos) || pos + 10 > len) {
+            /* Truncated replies may end mid-record; keep what we have */
+            return out.truncated;
+        }
+        uint16_t type = read16(msg + pos);
+        uint16_t cls = read16(msg + pos + 2);
+        uint32_t ttl = read32(msg + pos + 4);
+        uint16_t rdlen = read16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len) {
+            return out.truncated;
+        }
+        const uint8_t* rdata = msg + pos;
+        if (i < answers && cls == class_in && type == qtype) {
+            ip_address a;
+            if (type == type_a && rdlen == 4) {
+                auto* v4 = reinterpret_cast<sockaddr_in*>(&a.addr);
+                v4->sin_family = AF_INET;
+                memcpy(&v4->sin_addr, rdata, 4);
+                a.len = sizeof(sockaddr_in);
+            } else if (type == type_aaaa && rdlen == 16) {
+                auto* v6 = reinterpret_cast<sockaddr_in6*>(&a.addr);
+                v6->sin6_family = AF_INET6;
+                memcpy(&v6->sin6_addr, rdata, 16);
+                a.len = sizeof(sockaddr_in6);
+            } else {
+                pos += rdlen;
+                continue;
+            }
+            out.addresses.push_back(a);
+            out.ttl = std::min(out.ttl, ttl);
+        } else if (i >= answers && type == type_soa) {
+            /* RFC 2308 section 5: negative TTL is the lesser of the SOA TTL and MINIMUM */
+            size_t p = pos;
+            if (skip_name(msg, pos + rdlen, p) && skip_name(msg, pos + rdlen, p) && p + 20 <= pos + rdlen) {
+                out.has_soa = true;
+                out.soa_ttl = std::min(ttl, read32(msg + p + 16));
+            }
+        }
+        pos += rdlen;
+    }
+    return true;
+}
+
+/**
+ * @brief One Happy Eyeballs connection race. Only touched on the loop thread.
+ */
+struct connection_race : std::enable_shared_from_this<connection_race> {
+    io_loop& loop;
+    std::vector<ip_address> addresses;
+    connect_callback_t callback;
+    std::chrono::milliseconds stagger;
+    std::vector<std::pair<dpp::socket, size_t>> pending;
+    size_t next{0};
+    bool done{false};
+    io_timer stagger_timer{0};
+    io_timer timeout_timer{0};
+    connect_result result;
+    std::chrono::steady_clock::time_point started{std::chrono::steady_clock::now()};
+
+    connection_race(io_loop& io, const std::vector<ip_address>& a, connect_callback_t cb, std::chrono::milliseconds s)
+        : loop(io), addresses(a), callback(std::move(cb)), stagger(s) {
+    }
+
+    void begin(std::chrono::milliseconds timeout) {
+        auto self = shared_from_this();
+        timeout_timer = loop.after(timeout, [self] {
+            self->timeout_timer = 0;
+            self->result.error = error_timed_out;
+            self->finish(INVALID_SOCKET, 0);
+        });
+        attempt();
+    }
+
+    void attempt() {
+        if (done) {
+            return;
+        }
+        if (stagger_timer) {
+            loop.cancel(stagger_timer);
+            stagger_timer = 0;
+        }
+        auto self = shared_from_this();
+        while (next < addresses.size()) {
+            size_t index = next++;
+            const ip_address& a = addresses[index];
+            dpp::socket fd = ::socket(a.family(), SOCK_STREAM, IPPROTO_TCP);
+            if (fd == INVALID_SOCKET) {
+                result.error = last_socket_error();
+                continue;
+            }
+            result.attempts++;
+            set_nonblocking(fd);
+            if (::connect(fd, reinterpret_cast<const sockaddr*>(&a.addr), a.len) == 0) {
+                finish(fd, index);
+                return;
+            }
+            int err = last_socket_error();
+            if (!error_is_transient(err)) {
+                close_socket(fd);
+                result.error = err;
+                continue;
+            }
+            pending.emplace_back(fd, index);
+            io_events e;
+            e.fd = fd;
+            e.flags = WANT_WRITE;
+            e.on_write = [self, index](dpp::socket s) {
+                int err = 0;
+                socklen len = sizeof(err);
+                getsockopt(s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len);
+                if (err == 0) {
+                    self->finish(s, index);
+                } else {
+                    self->failed(s, err);
+                }
+            };
+            e.on_error = [self](dpp::socket s, int err) {
+                self->failed(s, err);
+            };
+            loop.add(e);
+            if (next < addresses.size()) {
+                stagger_timer = loop.after(stagger, [self] {
+                    self->stagger_timer = 0;
+                    self->attempt();
+                });
+            }
+            return;
+        }
+        if (pending.empty()) {
+            finish(INVALID_SOCKET, 0);
+        }
+    }
+
+    void failed(dpp::socket fd, int err) {
+        loop.remove(fd);
+        close_socket(fd);
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [fd](const auto& p) { return p.first == fd; }), pending.end());
+        result.error = err;
+        /* A failure starts the next attempt without waiting for the stagger */
+        attempt();
+    }
+
+    void finish(dpp::socket winner, size_t index) {
+        if (done) {
+            return;
+        }
+        done = true;
+        for (io_timer* t : {&stagger_timer, &timeout_timer}) {
+            if (*t) {
+                loop.cancel(*t);
+                *t = 0;
+            }
+        }
+        for (auto& [fd, i] : pending) {
+            loop.remove(fd);
+            if (fd != winner) {
+                close_socket(fd);
+            }
+        }
+        pending.clear();
+        result.fd = winner;
+        if (winner != INVALID_SOCKET) {
+            result.address = addresses[index];
+            result.error = 0;
+        }
+        result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        connect_callback_t cb;
+        std::swap(cb, callback);
+        cb(result);
+    }
+};
+
+}
+
+bool dns_result::failed() const {
+    return addresses.empty();
+}
+
+/**
+ * @brief A lookup in progress; every caller asking for the same name while
+ * it is in flight waits on the same one. Only touched on the loop thread.
+ */
+struct dns_resolver::lookup {
+    std::string hostname;
+    std::vector<std::pair<uint16_t, dns_callback_t>> waiters;
+    dpp::socket fd{INVALID_SOCKET};
+    uint32_t attempt{0};
+    io_timer timer{0};
+    uint16_t id_a{0};
+    uint16_t id_aaaa{0};
+    bool answered_a{false};
+    bool answered_aaaa{false};
+    std::vector<ip_address> v4;
+    std::vector<ip_address> v6;
+    uint32_t ttl{UINT32_MAX};
+    bool nxdomain{false};
+    bool has_soa{false};
+    uint32_t soa_ttl{UINT32_MAX};
+    std::string error;
+};
+
+dns_resolver::dns_resolver(io_loop& io, dns_config cfg) : loop(io), config(std::move(cfg)), alive(std::make_shared<bool>(true)) {
+    if (config.nameservers.empty()) {
+        config.nameservers = system_nameservers();
+    }
+    if (config.attempts == 0) {
+        config.attempts = 1;
+    }
+}
+
+dns_resolver::~dns_resolver() {
+    auto cleanup = [this] {
+        for (auto& [name, l] : in_flight) {
+            if (l->timer) {
+                loop.cancel(l->timer);
+            }
+            if (l->fd != INVALID_SOCKET) {
+                loop.remove(l->fd);
+                close_socket(l->fd);
+            }
+        }
+        in_flight.clear();
+        alive.reset();
+    };
+    if (loop.in_loop_thread()) {
+        cleanup();
+    } else {
+        /* Closures already posted check alive on the loop thread, so tear down there */
+        std::promise<void> done;
+        loop.post([&] {
+            cleanup();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+void dns_resolver::resolve(const std::string& hostname, uint16_t port, dns_callback_t callback) {
+    dns_result result;
+    result.hostname = hostname;
+    ip_address numeric;
+    if (ip_address::parse(hostname, port, numeric)) {
+        result.addresses.push_back(numeric);
+        loop.post([result, callback] { callback(result); });
+        return;
+    }
+    if (cached(hostname, port, result)) {
+        loop.post([result, callback] { callback(result); });
+        return;
+    }
+    std::weak_ptr<bool> guard = alive;
+    std::string name = lower(hostname);
+    loop.post([this, guard, hostname, name, port, callback] {
+        if (guard.expired()) {
+            return;
+        }
+        /* A lookup may have completed since the cache was checked above */
+        dns_result result;
+        if (cached(hostname, port, result)) {
+            callback(result);
+            return;
+        }
+        auto it = in_flight.find(name);
+        if (it != in_flight.end()) {
+            it->second->waiters.emplace_back(port, callback);
+            return;
+        }
+        auto l = std::make_shared<lookup>();
+        l->hostname = name;
+        l->waiters.emplace_back(port, callback);
+        in_flight.emplace(name, l);
+        start(l);
+    });
+}
+
+void dns_resolver::start(const std::shared_ptr<lookup>& l) {
+    if (config.nameservers.empty()) {
+        l->error = "no nameservers configured";
+        finish(l, false);
+        return;
+    }
+    send_queries(l);
+}
+
+void dns_resolver::send_queries(const std::shared_ptr<lookup>& l) {
+    if (l->fd != INVALID_SOCKET) {
+        loop.remove(l->fd);
+        close_socket(l->fd);
+        l->fd = INVALID_SOCKET;
+    }
+    /* Each attempt uses a fresh socket and ids, so a late reply to an earlier
+     * attempt can't be mistaken for this one and the source port is new.
+     */
+    const ip_address& server = config.nameservers[l->attempt % config.nameservers.size()];
+    l->attempt++;
+    dpp::socket fd = ::socket(server.family(), SOCK_DGRAM, IPPROTO_UDP);
+    if (fd != INVALID_SOCKET && set_nonblocking(fd) && ::connect(fd, reinterpret_cast<const sockaddr*>(&server.addr), server.len) == 0) {
+        l->fd = fd;
+        std::string packet;
+        if (!l->answered_a) {
+            l->id_a = random_id();
+            if (build_query(l->id_a, l->hostname, type_a, packet)) {
+                ::send(fd, packet.data(), static_cast<int>(packet.size()), 0);
+            } else {
+                l->error = "invalid hostname";
+                finish(l, false);
+                return;
+            }
+        }
+        if (!l->answered_aaaa) {
+            do {
+                l->id_aaaa = random_id();
+            } while (l->id_aaaa == l->id_a);
+            build_query(l->id_aaaa, l->hostname, type_aaaa, packet);
+            ::send(fd, packet.data(), static_cast<int>(packet.size()), 0);
+        }
+        std::weak_ptr<lookup> weak = l;
+        io_events e;
+        e.fd = fd;
+        e.flags = WANT_READ;
+        e.on_read = [this, weak](dpp::socket) {
+            if (auto l = weak.lock()) {
+                on_reply(l);
+            }
+        };
+        /* ICMP port unreachable and the like: let the timer move on to the next server */
+        e.on_error = [this, weak](dpp::socket s, int) {
+            if (auto l = weak.lock(); l && l->fd == s) {
+                loop.remove(s);
+            }
+        };
+        loop.add(e);
+    } else if (fd != INVALID_SOCKET) {
+        close_socket(fd);
+    }
+    std::weak_ptr<lookup> weak = l;
+    l->timer = loop.after(config.timeout, [this, weak] {
+        auto l = weak.lock();
+        if (!l) {
+            return;
+        }
+        l->timer = 0;
+        if (l->attempt < config.attempts) {
+            send_queries(l);
+        } else {
+            finish(l, true);
+        }
+    });
+}
+
+void dns_resolver::on_reply(const std::shared_ptr<lookup>& l) {
+    uint8_t buffer[1500];
+    for (;;) {
+        auto r = ::recv(l->fd, reinterpret_cast<char*>(buffer), sizeof(buffer), 0);
+        if (r <= 0) {
+            break;
+        }
+        size_t len = static_cast<size_t>(r);
+        if (len < header_size) {
+            continue;
+        }
+        uint16_t id = read16(buffer);
+        bool is_a = !l->answered_a && id == l->id_a;
+        bool is_aaaa = !l->answered_aaaa && id == l->id_aaaa;
+        dns_reply reply;
+        if ((!is_a && !is_aaaa) || !parse_reply(buffer, len, is_a ? type_a : type_aaaa, reply)) {
+            continue;
+        }
+        (is_a ? l->answered_a : l->answered_aaaa) = true;
+        auto& into = is_a ? l->v4 : l->v6;
+        into.insert(into.end(), reply.addresses.begin(), reply.addresses.end());
+        l->ttl = std::min(l->ttl, reply.ttl);
+        if (reply.rcode == rcode_nxdomain) {
+            l->nxdomain = true;
+        } else if (reply.rcode != 0) {
+            l->error = "nameserver returned rcode " + std::to_string(reply.rcode);
+        }
+        if (reply.has_soa) {
+            l->has_soa = true;
+            l->soa_ttl = std::min(l->soa_ttl, reply.soa_ttl);
+        }
+        if (l->answered_a && l->answered_aaaa) {
+            finish(l, false);
+            return;
+        }
+    }
+}
+
+void dns_resolver::finish(const std::shared_ptr<lookup>& l, bool timed_out) {
+    if (l->timer) {
+        loop.cancel(l->timer);
+        l->timer = 0;
+    }
+    if (l->fd != INVALID_SOCKET) {
+        loop.remove(l->fd);
+        close_socket(l->fd);
+        l->fd = INVALID_SOCKET;
+    }
+    in_flight.erase(l->hostname);
+
+    dns_result result;
+    result.hostname = l->hostname;
+    /* RFC 8305 section 4: interleave the families, IPv6 first */
+    for (size_t i = 0; i < std::max(l->v4.size(), l->v6.size()); ++i) {
+        if (i < l->v6.size()) {
+            result.addresses.push_back(l->v6[i]);
+        }
+        if (i < l->v4.size()) {
+            result.addresses.push_back(l->v4[i]);
+        }
+    }
+
+    bool cacheable = true;
+    if (!result.addresses.empty()) {
+        result.ttl = std::clamp(l->ttl, config.min_ttl, config.max_ttl);
+    } else if (!l->error.empty()) {
+        /* Server failures are not remembered */
+        result.error = l->error;
+        cacheable = false;
+    } else if (timed_out && !l->nxdomain) {
+        /* One family may have answered empty while the other was lost, which
+         * says nothing about the host, so only remember a negative answer
+         * once both families have answered or the name does not exist
+         */
+        result.error = (l->answered_a || l->answered_aaaa) ? "no addresses for host" : "timed out";
+        cacheable = false;
+    } else {
+        result.error = l->nxdomain ? "no such host" : "no addresses for host";
+        result.ttl = std::min(l->has_soa ? l->soa_ttl : config.negative_ttl, config.max_ttl);
+    }
+
+    if (cacheable && result.ttl > 0) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cache[l->hostname] = cache_entry{result.addresses, std::chrono::steady_clock::now() + std::chrono::seconds(result.ttl), result.error};
+    }
+
+    for (auto& [port, callback] : l->waiters) {
+        dns_result r = result;
+        for (auto& a : r.addresses) {
+            a.set_port(port);
+        }
+        callback(r);
+    }
+}
+
+void dns_resolver::connect(const std::string& hostname, uint16_t port, connect_callback_t callback, std::chrono::milliseconds stagger) {
+    io_loop& io = loop;
+    resolve(hostname, port, [&io, callback, stagger](const dns_result& r) {
+        if (r.failed()) {
+            connect_result failure;
+            failure.dns_error = r.error;
+            callback(failure);
+            return;
+        }
+        race_connect(io, r.addresses, callback, stagger);
+    });
+}
+
+bool dns_resolver::cached(const std::string& hostname, uint16_t port, dns_result& out) const {
+    std::string name = lower(hostname);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(name);
+    if (it == cache.end()) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (it->second.expires <= now) {
+        return false;
+    }
+    out.hostname = hostname;
+    out.addresses = it->second.addresses;
+    for (auto& a : out.addresses) {
+        a.set_port(port);
+    }
+    out.error = it->second.error;
+    out.cached = true;
+    out.ttl = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(it->second.expires - now).count());
+    return true;
+}
+
+void dns_resolver::flush() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.clear();
+}
+
+std::vector<ip_address> dns_resolver::system_nameservers() {
+    std::vector<ip_address> servers;
+#ifdef _WIN32
+    ULONG size = 0;
+    GetNetworkParams(nullptr, &size);
+    std::vector<char> buffer(size);
+    auto* info = reinterpret_cast<FIXED_INFO*>(buffer.data());
+    if (size > 0 && GetNetworkParams(info, &size) == NO_ERROR) {
+        for (IP_ADDR_STRING* s = &info->DnsServerList; s != nullptr; s = s->Next) {
+            ip_address a;
+            if (ip_address::parse(s->IpAddress.String, 53, a)) {
+                servers.push_back(a);
+            }
+        }
+    }
+#else
+    std::ifstream resolv("/etc/resolv.conf");
+    std::string line;
+    while (std::getline(resolv, line)) {
+        std::istringstream words(line);
+        std::string keyword, ip;
+        ip_address a;
+        if (words >> keyword >> ip && keyword == "nameserver" && ip_address::parse(ip, 53, a)) {
+            servers.push_back(a);
+        }
+    }
+#endif
+    return servers;
+}
+
+void race_connect(io_loop& loop, const std::vector<ip_address>& addresses, connect_callback_t callback, std::chrono::milliseconds stagger, std::chrono::milliseconds timeout) {
+    auto race = std::make_shared<connection_race>(loop, addresses, std::move(callback), stagger);
+    loop.post([race, timeout] {
+        race->begin(timeout);
+    });
+}
+
+}
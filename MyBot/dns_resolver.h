@@ -0,0 +1,236 @@
+#pragma once
+#include "io_loop.h"
+#include <memory>
+
+namespace mybot {
+
+/**
+ * @brief Result of a hostname lookup
+ */
+struct dns_result {
+    /**
+     * @brief Hostname which was looked up
+     */
+    std::string hostname;
+
+    /**
+     * @brief Every A and AAAA address, in the order they should be tried:
+     * IPv6 and IPv4 interleaved, starting with IPv6 (RFC 8305 section 4).
+     * Ports are set to the port passed to resolve().
+     */
+    std::vector<ip_address> addresses;
+
+    /**
+     * @brief True if the answer came from the cache without a query
+     */
+    bool cached{false};
+
+    /**
+     * @brief Seconds until the answer expires from the cache
+     */
+    uint32_t ttl{0};
+
+    /**
+     * @brief Empty on success, otherwise why the lookup failed
+     */
+    std::string error;
+
+    /**
+     * @brief True if no addresses were found
+     */
+    bool failed() const;
+};
+
+/**
+ * @brief Called once when a lookup completes, on the io_loop thread
+ */
+using dns_callback_t = std::function<void(const dns_result&)>;
+
+/**
+ * @brief Resolver settings
+ */
+struct dns_config {
+    /**
+     * @brief Nameservers to query, in order. If empty, the system nameservers
+     * are used. Point this at a local stand-in to test without the network.
+     */
+    std::vector<ip_address> nameservers;
+
+    /**
+     * @brief How long to wait for each attempt before retrying
+     */
+    std::chrono::milliseconds timeout{1500};
+
+    /**
+     * @brief Attempts per lookup. Each retry goes to the next nameserver.
+     */
+    uint32_t attempts{3};
+
+    /**
+     * @brief Lower bound on cached TTLs, so a zero TTL does not mean
+     * one query per connection
+     */
+    uint32_t min_ttl{5};
+
+    /**
+     * @brief Upper bound on cached TTLs
+     */
+    uint32_t max_ttl{3600};
+
+    /**
+     * @brief How long to cache a name which does not exist when the
+     * nameserver does not say (no SOA record in the reply)
+     */
+    uint32_t negative_ttl{30};
+};
+
+/**
+ * @brief Result of race_connect()
+ */
+struct connect_result {
+    /**
+     * @brief Connected non-blocking socket, or INVALID_SOCKET on failure.
+     * The caller owns it and must close it.
+     */
+    dpp::socket fd{INVALID_SOCKET};
+
+    /**
+     * @brief Address which won the race
+     */
+    ip_address address;
+
+    /**
+     * @brief Last socket error if every attempt failed
+     */
+    int error{0};
+
+    /**
+     * @brief If the hostname could not be resolved, why (see dns_resolver::connect())
+     */
+    std::string dns_error;
+
+    /**
+     * @brief Connection attempts started
+     */
+    uint32_t attempts{0};
+
+    /**
+     * @brief Milliseconds from the first attempt until the result
+     */
+    double ms{0};
+};
+
+/**
+ * @brief Called once when a connection race ends, on the io_loop thread
+ */
+using connect_callback_t = std::function<void(const connect_result&)>;
+
+/**
+ * @brief Connect to the first of several addresses to answer, Happy Eyeballs
+ * style (RFC 8305).
+ *
+ * The first address is tried straight away. Each later one is started when
+ * the previous attempt fails, or after `stagger` if it is still pending,
+ * whichever comes first. The first attempt to connect wins and the rest are
+ * closed. A host with a broken IPv6 route therefore costs at most one stagger
+ * interval rather than a full TCP timeout.
+ *
+ * @param loop loop to run the attempts on
+ * @param addresses addresses to try in order, with ports set, e.g. from dns_result
+ * @param callback called once with the winner or the failure
+ * @param stagger delay before starting the next attempt
+ * @param timeout give up if nothing has connected after this long
+ */
+void race_connect(io_loop& loop, const std::vector<ip_address>& addresses, connect_callback_t callback, std::chrono::milliseconds stagger = std::chrono::milliseconds(250), std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+/**
+ * @brief A non-blocking DNS stub resolver running on an io_loop.
+ *
+ * dpp::resolve_hostname() calls getaddrinfo() on whichever thread opens the
+ * connection, keeps only the first address, and caches it for a fixed time.
+ * This sends A and AAAA queries over UDP in parallel, keeps every address of
+ * both families, caches each answer for its own TTL, caches NXDOMAIN and empty
+ * answers for the SOA minimum (RFC 2308), and joins concurrent lookups of the
+ * same name into one query.
+ *
+ * D++ 10.0 does not let a bot replace the resolver used by its own shards,
+ * REST and voice connections; use this for connections the bot makes itself
+ * (see connect()) and for warming up ahead of them.
+ */
+class dns_resolver {
+    struct cache_entry {
+        std::vector<ip_address> addresses;
+        std::chrono::steady_clock::time_point expires;
+        std::string error;
+    };
+
+    struct lookup;
+
+    io_loop& loop;
+    dns_config config;
+    mutable std::mutex cache_mutex;
+    std::unordered_map<std::string, cache_entry> cache;
+    /* Only touched on the loop thread */
+    std::unordered_map<std::string, std::shared_ptr<lookup>> in_flight;
+    std::shared_ptr<bool> alive;
+
+    void start(const std::shared_ptr<lookup>& l);
+    void send_queries(const std::shared_ptr<lookup>& l);
+    void on_reply(const std::shared_ptr<lookup>& l);
+    void finish(const std::shared_ptr<lookup>& l, bool timed_out);
+
+public:
+    /**
+     * @brief Create a resolver
+     * @param io loop to run queries on. It must outlive the resolver.
+     * @param cfg settings
+     */
+    dns_resolver(io_loop& io, dns_config cfg = {});
+
+    /**
+     * @brief Lookups still in progress are abandoned and their callbacks never fire
+     */
+    ~dns_resolver();
+
+    dns_resolver(const dns_resolver&) = delete;
+    dns_resolver& operator=(const dns_resolver&) = delete;
+
+    /**
+     * @brief Look up a hostname. Numeric addresses complete without a query.
+     * @param hostname hostname
+     * @param port port to set on each returned address
+     * @param callback called once with the result, on the loop thread
+     */
+    void resolve(const std::string& hostname, uint16_t port, dns_callback_t callback);
+
+    /**
+     * @brief Look up a hostname and race_connect() to its addresses
+     * @param hostname hostname
+     * @param port port
+     * @param callback called once with the connected socket or the failure
+     * @param stagger Happy Eyeballs delay between attempts
+     */
+    void connect(const std::string& hostname, uint16_t port, connect_callback_t callback, std::chrono::milliseconds stagger = std::chrono::milliseconds(250));
+
+    /**
+     * @brief Get an unexpired cached answer without blocking or querying
+     * @param hostname hostname
+     * @param port port to set on each returned address
+     * @param out result
+     * @return true if there was a cached answer, positive or negative
+     */
+    bool cached(const std::string& hostname, uint16_t port, dns_result& out) const;
+
+    /**
+     * @brief Drop every cached answer
+     */
+    void flush();
+
+    /**
+     * @brief The nameservers the operating system is configured to use
+     * (resolv.conf, or the adapter settings on Windows)
+     */
+    static std::vector<ip_address> system_nameservers();
+};
+
+}
@@ -0,0 +1,159 @@
+#include "entity_counters.h"
+
+namespace mybot {
+
+namespace {
+
+entity_counts snapshot(const std::atomic<int64_t>& guilds, const std::atomic<int64_t>& members, const std::atomic<int64_t>& channels) {
+    entity_counts out;
+    out.guilds = static_cast<uint64_t>(std::max<int64_t>(guilds.load(std::memory_order_relaxed), 0));
+    out.members = static_cast<uint64_t>(std::max<int64_t>(members.load(std::memory_order_relaxed), 0));
+    out.channels = static_cast<uint64_t>(std::max<int64_t>(channels.load(std::memory_order_relaxed), 0));
+    return out;
+}
+
+}
+
+entity_counters::~entity_counters() {
+    for (auto& fn : detach) {
+        fn();
+    }
+}
+
+entity_counters::shard_state& entity_counters::shard(const dpp::discord_client* from) {
+    uint32_t id = from != nullptr ? from->shard_id : 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(shards_mutex);
+        auto s = shards.find(id);
+        if (s != shards.end()) {
+            return *s->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(shards_mutex);
+    auto& s = shards[id];
+    if (!s) {
+        s = std::make_unique<shard_state>();
+    }
+    return *s;
+}
+
+void entity_counters::add(shard_state& s, int64_t guilds, int64_t members, int64_t channels) {
+    s.totals.guilds.fetch_add(guilds, std::memory_order_relaxed);
+    s.totals.members.fetch_add(members, std::memory_order_relaxed);
+    s.totals.channels.fetch_add(channels, std::memory_order_relaxed);
+    cluster_totals.guilds.fetch_add(guilds, std::memory_order_relaxed);
+    cluster_totals.members.fetch_add(members, std::memory_order_relaxed);
+    cluster_totals.channels.fetch_add(channels, std::memory_order_relaxed);
+}
+
+void entity_counters::adjust(const dpp::discord_client* from, dpp::snowflake guild_id, int64_t members, int64_t channels) {
+    shard_state& s = shard(from);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto g = s.guilds.find(guild_id);
+        /* Events for guilds not yet created are already in GUILD_CREATE's counts */
+        if (g == s.guilds.end()) {
+            return;
+        }
+        g->second.members += members;
+        g->second.channels += channels;
+    }
+    add(s, 0, members, channels);
+}
+
+void entity_counters::attach(dpp::cluster& bot) {
+    auto listen = [this](auto& router, auto handler) {
+        auto handle = router(handler);
+        detach.push_back([&router, handle] {
+            router.detach(handle);
+        });
+    };
+    listen(bot.on_guild_create, [this](const dpp::guild_create_t& event) {
+        const dpp::guild* g = event.created;
+        if (g == nullptr || g->is_unavailable()) {
+            return;
+        }
+        guild_entry next{static_cast<int64_t>(g->member_count), static_cast<int64_t>(g->channels.size())};
+        shard_state& s = shard(event.from);
+        guild_entry previous;
+        int64_t guilds = 1;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            /* A guild sent again, after a reconnect or an outage, replaces its counts */
+            auto [entry, inserted] = s.guilds.try_emplace(g->id, next);
+            if (!inserted) {
+                previous = entry->second;
+                entry->second = next;
+                guilds = 0;
+            }
+        }
+        add(s, guilds, next.members - previous.members, next.channels - previous.channels);
+    });
+    listen(bot.on_guild_delete, [this](const dpp::guild_delete_t& event) {
+        dpp::snowflake id = !event.guild_id.empty() ? event.guild_id : event.deleted.id;
+        shard_state& s = shard(event.from);
+        guild_entry previous;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto entry = s.guilds.find(id);
+            if (entry == s.guilds.end()) {
+                return;
+            }
+            previous = entry->second;
+            s.guilds.erase(entry);
+        }
+        add(s, -1, -previous.members, -previous.channels);
+    });
+    listen(bot.on_guild_member_add, [this](const dpp::guild_member_add_t& event) {
+        adjust(event.from, event.adding_guild != nullptr ? event.adding_guild->id : event.added.guild_id, 1, 0);
+    });
+    listen(bot.on_guild_member_remove, [this](const dpp::guild_member_remove_t& event) {
+        adjust(event.from, event.removing_guild != nullptr ? event.removing_guild->id : event.guild_id, -1, 0);
+    });
+    listen(bot.on_channel_create, [this](const dpp::channel_create_t& event) {
+        if (event.created != nullptr && !event.created->guild_id.empty()) {
+            adjust(event.from, event.created->guild_id, 0, 1);
+        }
+    });
+    listen(bot.on_channel_delete, [this](const dpp::channel_delete_t& event) {
+        if (!event.deleted.guild_id.empty()) {
+            adjust(event.from, event.deleted.guild_id, 0, -1);
+        }
+    });
+}
+
+entity_counts entity_counters::totals() const {
+    return snapshot(cluster_totals.guilds, cluster_totals.members, cluster_totals.channels);
+}
+
+entity_counts entity_counters::shard_totals(uint32_t shard_id) const {
+    std::shared_lock<std::shared_mutex> lock(shards_mutex);
+    auto s = shards.find(shard_id);
+    if (s == shards.end()) {
+        return {};
+    }
+    return snapshot(s->second->totals.guilds, s->second->totals.members, s->second->totals.channels);
+}
+
+std::vector<std::pair<uint32_t, entity_counts>> entity_counters::per_shard() const {
+    std::shared_lock<std::shared_mutex> lock(shards_mutex);
+    std::vector<std::pair<uint32_t, entity_counts>> out;
+    out.reserve(shards.size());
+    for (const auto& [id, s] : shards) {
+        out.emplace_back(id, snapshot(s->totals.guilds, s->totals.members, s->totals.channels));
+    }
+    return out;
+}
+
+size_t add_entity_metrics(metrics_registry& registry, const entity_counters& counters) {
+    return registry.add_collector([&counters](metric_writer& w) {
+        for (const auto& [id, c] : counters.per_shard()) {
+            metric_labels labels{{"shard", std::to_string(id)}};
+            w.sample("mybot_guilds", "Available guilds", metric_gauge_type, labels, static_cast<double>(c.guilds));
+            w.sample("mybot_members", "Members summed over guilds", metric_gauge_type, labels, static_cast<double>(c.members));
+            w.sample("mybot_channels", "Guild channels", metric_gauge_type, labels, static_cast<double>(c.channels));
+        }
+    });
+}
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "metrics.h"
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace mybot {
+
+/**
+ * @brief Guild, member and channel totals
+ */
+struct entity_counts {
+    /**
+     * @brief Available guilds
+     */
+    uint64_t guilds{0};
+
+    /**
+     * @brief Members summed over the guilds, so a user in two guilds counts
+     * twice. Starts from each guild's member_count in GUILD_CREATE.
+     */
+    uint64_t members{0};
+
+    /**
+     * @brief Guild channels, not counting threads
+     */
+    uint64_t channels{0};
+};
+
+/**
+ * @brief Guild, member and channel totals kept up to date from gateway
+ * events, per shard and for the cluster.
+ *
+ * discord_client::get_guild_count(), get_member_count() and
+ * get_channel_count() walk the cache under its lock on every call, and
+ * member totals visit every guild. Here GUILD_CREATE and GUILD_DELETE,
+ * member add and remove, and channel create and delete adjust atomic
+ * counters instead, so reading totals() costs three atomic loads and can be
+ * done every second for a dashboard or presence text. Counting does not
+ * need D++'s cache.
+ *
+ * Each shard keeps the counts of its own guilds, so that a delete subtracts
+ * exactly what the guild added; only that shard's thread updates them.
+ */
+class entity_counters {
+    struct counts {
+        std::atomic<int64_t> guilds{0};
+        std::atomic<int64_t> members{0};
+        std::atomic<int64_t> channels{0};
+    };
+
+    struct guild_entry {
+        int64_t members{0};
+        int64_t channels{0};
+    };
+
+    struct shard_state {
+        counts totals;
+        std::mutex mutex;
+        std::unordered_map<dpp::snowflake, guild_entry> guilds;
+    };
+
+    counts cluster_totals;
+    mutable std::shared_mutex shards_mutex;
+    std::map<uint32_t, std::unique_ptr<shard_state>> shards;
+    std::vector<std::function<void()>> detach;
+
+    shard_state& shard(const dpp::discord_client* from);
+    void add(shard_state& s, int64_t guilds, int64_t members, int64_t channels);
+    void adjust(const dpp::discord_client* from, dpp::snowflake guild_id, int64_t members, int64_t channels);
+
+public:
+    entity_counters() = default;
+
+    /**
+     * @brief Detach from the cluster
+     */
+    ~entity_counters();
+
+    entity_counters(const entity_counters&) = delete;
+    entity_counters& operator=(const entity_counters&) = delete;
+
+    /**
+     * @brief Start counting a cluster's events. Attach before starting the
+     * cluster, so that no GUILD_CREATE is missed. The cluster must outlive
+     * the counters, or the counters must be destroyed first.
+     * @param bot cluster
+     */
+    void attach(dpp::cluster& bot);
+
+    /**
+     * @brief Totals for the cluster, without taking any lock
+     */
+    entity_counts totals() const;
+
+    /**
+     * @brief Totals for one shard
+     * @param shard_id shard id
+     */
+    entity_counts shard_totals(uint32_t shard_id) const;
+
+    /**
+     * @brief Totals for each shard seen so far, by shard id
+     */
+    std::vector<std::pair<uint32_t, entity_counts>> per_shard() const;
+};
+
+/**
+ * @brief Report guild, member and channel totals per shard
+ * @param registry registry
+ * @param counters counters, which must outlive the registry or the collector
+ * @return collector id
+ */
+size_t add_entity_metrics(metrics_registry& registry, const entity_counters& counters);
+
+}
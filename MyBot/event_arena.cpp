@@ -0,0 +1,152 @@
+#include "event_arena.h"
+#include <cstdlib>
+#include <new>
+
+namespace mybot {
+
+static thread_local allocation_counters counters;
+
+const allocation_counters& thread_allocations() {
+    return counters;
+}
+
+event_arena::event_arena()
+    : initial_block(new std::byte[initial_size]),
+      resource(initial_block.get(), initial_size, std::pmr::new_delete_resource())
+{
+}
+
+event_arena& event_arena::current() {
+    static thread_local event_arena arena;
+    return arena;
+}
+
+void* event_arena::do_allocate(size_t bytes, size_t alignment) {
+    used += bytes;
+    return resource.allocate(bytes, alignment);
+}
+
+void event_arena::do_deallocate(void*, size_t, size_t) {
+    /* Monotonic: nothing is freed until the scope ends */
+}
+
+bool event_arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+size_t event_arena::get_used() const {
+    return used;
+}
+
+size_t event_arena::get_high_water() const {
+    return high_water;
+}
+
+arena_scope::arena_scope(const dpp::cluster* owner, const char* event_name)
+    : arena(event_arena::current()), start(thread_allocations()), bot(owner), name(event_name), arena_bytes_start(arena.used)
+{
+    arena.depth++;
+}
+
+arena_scope::~arena_scope() {
+    if (bot != nullptr) {
+        const allocation_counters& now = thread_allocations();
+        bot->log(dpp::ll_trace, std::string(name) + ": " + std::to_string(now.allocations - start.allocations) + " heap allocations ("
+            + std::to_string(now.bytes - start.bytes) + " bytes), " + std::to_string(arena.used - arena_bytes_start) + " arena bytes");
+    }
+    if (--arena.depth == 0) {
+        if (arena.used > arena.high_water) {
+            arena.high_water = arena.used;
+        }
+        arena.used = 0;
+        /* Returns any overflow blocks to the heap and rewinds to the initial block */
+        arena.resource.release();
+    }
+}
+
+std::pmr::memory_resource* arena_scope::get_resource() {
+    return &arena;
+}
+
+}
+
+#ifdef MYBOT_COUNT_ALLOCATIONS
+/* Counting replacements for the global allocation functions. Only allocations
+ * made by code in this module are seen; the D++ dll has its own.
+ */
+void* operator new(size_t size) {
+    mybot::counters.allocations++;
+    mybot::counters.bytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        mybot::counters.frees++;
+        std::free(p);
+    }
+}
+
+void operator delete[](void* p) noexcept {
+    ::operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    ::operator delete(p);
+}
+
+/* std::pmr::new_delete_resource() may use the aligned forms */
+void* operator new(size_t size, std::align_val_t alignment) {
+    mybot::counters.allocations++;
+    mybot::counters.bytes += size;
+    size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    void* p = _aligned_malloc(size ? size : 1, align);
+#else
+    void* p = std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+#endif
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    if (p != nullptr) {
+        mybot::counters.frees++;
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void operator delete[](void* p, std::align_val_t alignment) noexcept {
+    ::operator delete(p, alignment);
+}
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept {
+    ::operator delete(p, alignment);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t alignment) noexcept {
+    ::operator delete(p, alignment);
+}
+#endif
@@ -0,0 +1,163 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <memory_resource>
+
+namespace mybot {
+
+/**
+ * @brief String allocated from an event arena
+ */
+using arena_string = std::pmr::string;
+
+/**
+ * @brief Vector allocated from an event arena
+ */
+template<typename T> using arena_vector = std::pmr::vector<T>;
+
+/**
+ * @brief Map allocated from an event arena
+ */
+template<typename K, typename V> using arena_map = std::pmr::unordered_map<K, V>;
+
+/**
+ * @brief Allocation counters for the current thread.
+ * These only count when the bot is built with MYBOT_COUNT_ALLOCATIONS defined,
+ * which replaces the global operator new/delete in this module. Allocations
+ * made inside the D++ dll use that dll's own operator new, so are not included.
+ */
+struct allocation_counters {
+    /**
+     * @brief Number of calls to operator new
+     */
+    uint64_t allocations{0};
+
+    /**
+     * @brief Number of calls to operator delete
+     */
+    uint64_t frees{0};
+
+    /**
+     * @brief Total bytes requested from operator new
+     */
+    uint64_t bytes{0};
+};
+
+/**
+ * @brief Get the allocation counters for the calling thread
+ * @return counters, all zero unless MYBOT_COUNT_ALLOCATIONS is defined
+ */
+const allocation_counters& thread_allocations();
+
+/**
+ * @brief A monotonic arena for objects which only live as long as the event
+ * being handled.
+ *
+ * Each thread has one arena with a fixed initial block. Everything allocated
+ * from it while an arena_scope is active is freed in one go when the outermost
+ * scope ends, rather than one small free at a time into the global heap.
+ * Anything which must outlive the event (e.g. a value you are putting in your
+ * own cache) must be copied into ordinary std:: containers first.
+ */
+class event_arena : public std::pmr::memory_resource {
+    friend class arena_scope;
+
+    std::unique_ptr<std::byte[]> initial_block;
+    std::pmr::monotonic_buffer_resource resource;
+    uint32_t depth{0};
+    size_t used{0};
+    size_t high_water{0};
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+public:
+    /**
+     * @brief Size of the per thread initial block. Handler scratch data
+     * which fits in this never goes to the heap; anything larger takes extra
+     * blocks from the heap, which are freed when the scope ends. The objects
+     * D++ decodes from the payload are not in the arena at all.
+     */
+    static constexpr size_t initial_size = 64 * 1024;
+
+    event_arena();
+
+    event_arena(const event_arena&) = delete;
+    event_arena& operator=(const event_arena&) = delete;
+
+    /**
+     * @brief Get the arena for the calling thread
+     * @return thread's arena
+     */
+    static event_arena& current();
+
+    /**
+     * @brief Bytes handed out since the arena was last released
+     * @return byte count
+     */
+    size_t get_used() const;
+
+    /**
+     * @brief Largest number of bytes handed out during any one event on this thread
+     * @return byte count
+     */
+    size_t get_high_water() const;
+};
+
+/**
+ * @brief Marks the lifetime of one event on the current thread's arena.
+ * When the outermost scope ends the arena is released. Optionally logs the
+ * heap allocations made during the scope, for comparing handlers before and
+ * after moving their scratch data into the arena.
+ */
+class arena_scope {
+    event_arena& arena;
+    allocation_counters start;
+    const dpp::cluster* bot;
+    const char* name;
+    size_t arena_bytes_start{0};
+
+public:
+    /**
+     * @brief Enter a scope
+     * @param owner if not nullptr, a trace log of allocations is written on exit
+     * @param event_name name used in the log message
+     */
+    explicit arena_scope(const dpp::cluster* owner = nullptr, const char* event_name = "");
+    ~arena_scope();
+
+    arena_scope(const arena_scope&) = delete;
+    arena_scope& operator=(const arena_scope&) = delete;
+
+    /**
+     * @brief Memory resource to pass to pmr containers
+     * @return memory resource
+     */
+    std::pmr::memory_resource* get_resource();
+};
+
+/**
+ * @brief Wrap an event handler so that it runs inside an arena_scope.
+ *
+ * @code
+ * bot.on_guild_create(mybot::arena_handler<dpp::guild_create_t>(&bot, "GUILD_CREATE",
+ *     [](const dpp::guild_create_t& event, std::pmr::memory_resource* arena) {
+ *         mybot::arena_vector<dpp::snowflake> ids(arena);
+ *         ...
+ *     }));
+ * @endcode
+ *
+ * @tparam E event type
+ * @param bot cluster for logging allocation counts, or nullptr
+ * @param name event name for logging
+ * @param handler handler which receives the arena's memory resource
+ * @return handler suitable for attaching to an event router
+ */
+template<typename E> std::function<void(const E&)> arena_handler(const dpp::cluster* bot, const char* name, std::function<void(const E&, std::pmr::memory_resource*)> handler) {
+    return [bot, name, handler = std::move(handler)](const E& event) {
+        arena_scope scope(bot, name);
+        handler(event, scope.get_resource());
+    };
+}
+
+}
@@ -0,0 +1,198 @@
+#include "fair_queue.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace mybot {
+
+namespace {
+
+double waited_ms(const rest_request& r, std::chrono::steady_clock::time_point now) {
+    return std::chrono::duration<double, std::milli>(now - r.queued).count();
+}
+
+}
+
+fair_queue::fair_queue(dpp::cluster& cluster, const fair_queue_config& cfg) : bot(cluster), config(cfg) {
+    config.max_in_flight = std::max<uint32_t>(config.max_in_flight, 1);
+    config.guild_in_flight = std::max<uint32_t>(config.guild_in_flight, 1);
+    config.default_weight = std::max<uint32_t>(config.default_weight, 1);
+}
+
+uint32_t fair_queue::weight_of(dpp::snowflake guild_id) const {
+    auto it = weights.find(guild_id);
+    return it != weights.end() ? it->second : config.default_weight;
+}
+
+void fair_queue::post(rest_request_ptr request) {
+    if (request->guild_id.empty() && request->endpoint == API_PATH "/guilds") {
+        request->guild_id = parse_snowflake(request->major_parameters);
+    }
+    request->queued = std::chrono::steady_clock::now();
+    /* Taken here, on the caller's thread; the request may be sent from another */
+    if (tracing_enabled()) {
+        request->trace_cause = trace_current_cause();
+        request->trace_flow = trace_flow_begin();
+        request->trace_taken = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& g = guilds[request->guild_id];
+        if (g.waiting.empty()) {
+            active.push_back(request->guild_id);
+        }
+        g.waiting.emplace_back(std::move(request));
+    }
+    pump();
+}
+
+void fair_queue::post(const std::string& endpoint, const std::string& major_parameters, const std::string& parameters, dpp::http_method method, const std::string& postdata, lazy_completion_t callback, dpp::snowflake guild_id) {
+    rest_request_ptr r = rest_request_pool().acquire();
+    r->endpoint = endpoint;
+    r->major_parameters = major_parameters;
+    r->parameters = parameters;
+    r->method = method;
+    r->postdata = postdata;
+    r->callback = std::move(callback);
+    r->guild_id = guild_id;
+    post(std::move(r));
+}
+
+void fair_queue::set_weight(dpp::snowflake guild_id, uint32_t weight) {
+    std::lock_guard<std::mutex> lock(mutex);
+    weights[guild_id] = std::max<uint32_t>(weight, 1);
+}
+
+void fair_queue::take_ready(std::vector<rest_request_ptr>& out) {
+    auto now = std::chrono::steady_clock::now();
+    bool progress = true;
+    while (progress && in_flight < config.max_in_flight && !active.empty()) {
+        progress = false;
+        auto it = active.begin();
+        while (it != active.end() && in_flight < config.max_in_flight) {
+            guild_queue& g = guilds[*it];
+            if (g.in_flight >= config.guild_in_flight) {
+                ++it;
+                continue;
+            }
+            if (g.deficit == 0) {
+                g.deficit = weight_of(*it);
+            }
+            while (g.deficit > 0 && !g.waiting.empty() && g.in_flight < config.guild_in_flight && in_flight < config.max_in_flight) {
+                max_wait_ms = std::max(max_wait_ms, waited_ms(*g.waiting.front(), now));
+                out.emplace_back(std::move(g.waiting.front()));
+                g.waiting.pop_front();
+                g.deficit--;
+                g.in_flight++;
+                in_flight++;
+                progress = true;
+            }
+            if (g.waiting.empty()) {
+                g.deficit = 0;
+                it = active.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        /* If the global cap stopped us part way round, start there next time */
+        if (it != active.end()) {
+            active.splice(active.end(), active, active.begin(), it);
+        }
+    }
+}
+
+void fair_queue::pump() {
+    std::vector<rest_request_ptr> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        take_ready(ready);
+    }
+    for (auto& r : ready) {
+        send(std::move(r));
+    }
+}
+
+void fair_queue::send(rest_request_ptr request) {
+    std::string key = request->endpoint + "/" + request->major_parameters;
+    if (config.store != nullptr && config.loop != nullptr) {
+        std::chrono::milliseconds wait = config.store->acquire(key);
+        if (wait.count() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                delayed++;
+            }
+            auto held = std::make_shared<rest_request_ptr>(std::move(request));
+            config.loop->after(wait, [this, held] {
+                send(std::move(*held));
+            });
+            return;
+        }
+    }
+    dpp::snowflake guild_id = request->guild_id;
+    request->callback = [this, guild_id, key, callback = std::move(request->callback)](lazy_result&& result) {
+        if (config.store != nullptr) {
+            config.store->record(key, result.http_info.status, result.headers);
+        }
+        completed(guild_id);
+        if (callback) {
+            callback(std::move(result));
+        }
+    };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sent++;
+    }
+    if (tracing_enabled()) {
+        int64_t now = trace_now_us();
+        int64_t waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request->queued).count();
+        trace_async("queue_wait", "rest", now - waited, now, key, request->trace_cause);
+    }
+    lazy_rest(bot, std::move(request));
+}
+
+void fair_queue::completed(dpp::snowflake guild_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight--;
+        auto it = guilds.find(guild_id);
+        if (it != guilds.end()) {
+            it->second.in_flight--;
+            if (it->second.in_flight == 0 && it->second.waiting.empty()) {
+                guilds.erase(it);
+            }
+        }
+    }
+    pump();
+}
+
+std::vector<guild_backlog> fair_queue::backlog() const {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<guild_backlog> out;
+    std::lock_guard<std::mutex> lock(mutex);
+    out.reserve(guilds.size());
+    for (const auto& [id, g] : guilds) {
+        guild_backlog b;
+        b.guild_id = id;
+        b.queued = g.waiting.size();
+        b.in_flight = g.in_flight;
+        b.weight = weight_of(id);
+        b.oldest_wait_ms = g.waiting.empty() ? 0 : waited_ms(*g.waiting.front(), now);
+        out.push_back(b);
+    }
+    return out;
+}
+
+fair_queue_stats fair_queue::stats() const {
+    fair_queue_stats s;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [id, g] : guilds) {
+        s.queued += g.waiting.size();
+    }
+    s.in_flight = in_flight;
+    s.sent = sent;
+    s.delayed = delayed;
+    s.guilds = guilds.size();
+    s.max_wait_ms = max_wait_ms;
+    return s;
+}
+
+}
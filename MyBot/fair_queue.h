@@ -0,0 +1,185 @@
+#pragma once
+#include "io_loop.h"
+#include "ratelimit_store.h"
+#include "rest_request.h"
+#include <deque>
+#include <list>
+
+namespace mybot {
+
+/**
+ * @brief Settings for a fair_queue
+ */
+struct fair_queue_config {
+    /**
+     * @brief Requests handed to D++ at once, across every guild
+     */
+    uint32_t max_in_flight{16};
+
+    /**
+     * @brief Requests handed to D++ at once for any one guild
+     */
+    uint32_t guild_in_flight{2};
+
+    /**
+     * @brief Weight of a guild without one set by set_weight(). A guild never
+     * has more than guild_in_flight requests out, whatever its weight.
+     */
+    uint32_t default_weight{1};
+
+    /**
+     * @brief Optional shared rate limit store. Each request claims from its
+     * route's bucket before it is sent, and every response is recorded.
+     */
+    ratelimit_store* store{nullptr};
+
+    /**
+     * @brief Loop used to wait out a rate limit from the store. Without one,
+     * requests are sent regardless and D++ does the waiting.
+     */
+    io_loop* loop{nullptr};
+};
+
+/**
+ * @brief Backlog of one guild
+ */
+struct guild_backlog {
+    /**
+     * @brief Guild id, zero for requests with no guild
+     */
+    dpp::snowflake guild_id;
+
+    /**
+     * @brief Requests waiting
+     */
+    size_t queued{0};
+
+    /**
+     * @brief Requests sent and not yet completed
+     */
+    uint32_t in_flight{0};
+
+    /**
+     * @brief Weight
+     */
+    uint32_t weight{1};
+
+    /**
+     * @brief How long the oldest waiting request has waited
+     */
+    double oldest_wait_ms{0};
+};
+
+/**
+ * @brief Totals for a fair_queue
+ */
+struct fair_queue_stats {
+    /**
+     * @brief Requests waiting, across every guild
+     */
+    size_t queued{0};
+
+    /**
+     * @brief Requests sent and not yet completed
+     */
+    uint32_t in_flight{0};
+
+    /**
+     * @brief Requests sent since the queue was created
+     */
+    uint64_t sent{0};
+
+    /**
+     * @brief Requests held back by the rate limit store
+     */
+    uint64_t delayed{0};
+
+    /**
+     * @brief Guilds with requests waiting or in flight
+     */
+    size_t guilds{0};
+
+    /**
+     * @brief Longest time any request waited before being sent
+     */
+    double max_wait_ms{0};
+};
+
+/**
+ * @brief Weighted fair queuing of REST requests by guild.
+ *
+ * D++ sends requests to its REST threads in the order they are made, so one
+ * guild queueing ten thousand role updates puts every other guild's commands
+ * behind them. Requests posted here are queued per guild and released to D++
+ * by deficit round robin: each pass gives every waiting guild its weight in
+ * requests, and no guild can have more than guild_in_flight outstanding. A
+ * quiet guild's request is therefore sent on the next pass however long the
+ * bulk guild's backlog is, while the bulk job still drains at its share.
+ *
+ * The queue must outlive the requests posted to it.
+ */
+class fair_queue {
+    struct guild_queue {
+        std::deque<rest_request_ptr> waiting;
+        uint32_t in_flight{0};
+        uint32_t deficit{0};
+    };
+
+    dpp::cluster& bot;
+    fair_queue_config config;
+    mutable std::mutex mutex;
+    std::unordered_map<dpp::snowflake, guild_queue> guilds;
+    std::unordered_map<dpp::snowflake, uint32_t> weights;
+    std::list<dpp::snowflake> active;
+    uint32_t in_flight{0};
+    uint64_t sent{0};
+    uint64_t delayed{0};
+    double max_wait_ms{0};
+
+    uint32_t weight_of(dpp::snowflake guild_id) const;
+    void take_ready(std::vector<rest_request_ptr>& out);
+    void pump();
+    void send(rest_request_ptr request);
+    void completed(dpp::snowflake guild_id);
+
+public:
+    /**
+     * @brief Create a queue
+     * @param cluster cluster to send requests with
+     * @param cfg settings
+     */
+    fair_queue(dpp::cluster& cluster, const fair_queue_config& cfg = {});
+
+    /**
+     * @brief Queue a request. If its guild_id is not set and the endpoint is
+     * the guilds endpoint, the guild is taken from the major parameter.
+     * @param request request from rest_request_pool()
+     */
+    void post(rest_request_ptr request);
+
+    /**
+     * @brief Queue a request, like lazy_rest()
+     */
+    void post(const std::string& endpoint, const std::string& major_parameters, const std::string& parameters, dpp::http_method method, const std::string& postdata, lazy_completion_t callback, dpp::snowflake guild_id = {});
+
+    /**
+     * @brief Give a guild a larger (or smaller) share. A guild with weight 3
+     * gets three requests sent for every one of a weight 1 guild while both
+     * have a backlog.
+     * @param guild_id guild
+     * @param weight weight, at least 1
+     */
+    void set_weight(dpp::snowflake guild_id, uint32_t weight);
+
+    /**
+     * @brief Backlog of each guild with requests waiting or in flight
+     */
+    std::vector<guild_backlog> backlog() const;
+
+    /**
+     * @brief Totals
+     */
+    fair_queue_stats stats() const;
+};
+
+}
@@ -0,0 +1,191 @@
+#include "fast_parse.h"
+#include <cstring>
+
+namespace mybot {
+
+/* The SWAR digit routines below load eight characters into a uint64_t and
+ * rely on the first character landing in the lowest byte. Every platform
+ * this template builds for (x86 and x64 Windows) is little endian.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "fast_parse.cpp assumes a little endian target"
+#endif
+
+static inline uint64_t load8(const char* p) noexcept {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* True if all eight bytes are ASCII '0'..'9' */
+static inline bool all_digits8(uint64_t v) noexcept {
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+/* Convert eight ASCII digits to their value with three multiplies */
+static inline uint32_t digits8_value(uint64_t v) noexcept {
+    v = (v & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    v = (v & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return static_cast<uint32_t>((v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32);
+}
+
+static inline bool digit(char c) noexcept {
+    return c >= '0' && c <= '9';
+}
+
+/* Parse exactly n digits at p, or return -1 */
+static inline int fixed_digits(const char* p, size_t n) noexcept {
+    int v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!digit(p[i])) {
+            return -1;
+        }
+        v = v * 10 + (p[i] - '0');
+    }
+    return v;
+}
+
+/* Days since 1970-01-01 for a proleptic Gregorian date (Howard Hinnant's days_from_civil) */
+static inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d) noexcept {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+time_t parse_iso8601(std::string_view ts) noexcept {
+    /* YYYY-MM-DDTHH:MM:SS is 19 characters */
+    if (ts.size() < 19 || ts[4] != '-' || ts[7] != '-' || (ts[10] != 'T' && ts[10] != ' ') || ts[13] != ':' || ts[16] != ':') {
+        return 0;
+    }
+    const char* p = ts.data();
+    int year = fixed_digits(p, 4), month = fixed_digits(p + 5, 2), day = fixed_digits(p + 8, 2);
+    int hour = fixed_digits(p + 11, 2), minute = fixed_digits(p + 14, 2), second = fixed_digits(p + 17, 2);
+    if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) {
+        return 0;
+    }
+    size_t pos = 19;
+    if (pos < ts.size() && ts[pos] == '.') {
+        ++pos;
+        while (pos < ts.size() && digit(ts[pos])) {
+            ++pos;
+        }
+    }
+    int64_t offset = 0;
+    if (pos < ts.size()) {
+        char sign = ts[pos];
+        if (sign == 'Z' || sign == 'z') {
+            ++pos;
+        } else if ((sign == '+' || sign == '-') && ts.size() >= pos + 6 && ts[pos + 3] == ':') {
+            int oh = fixed_digits(p + pos + 1, 2), om = fixed_digits(p + pos + 4, 2);
+            if (oh < 0 || om < 0) {
+                return 0;
+            }
+            offset = (oh * 3600 + om * 60) * (sign == '+' ? 1 : -1);
+            pos += 6;
+        } else {
+            return 0;
+        }
+    }
+    if (pos != ts.size()) {
+        return 0;
+    }
+    int64_t days = days_from_civil(year, static_cast<unsigned>(month), static_cast<unsigned>(day));
+    return static_cast<time_t>(days * 86400 + hour * 3600 + minute * 60 + second - offset);
+}
+
+uint64_t parse_snowflake(std::string_view digits) noexcept {
+    size_t n = digits.size();
+    if (n == 0 || n > snowflake_max_digits) {
+        return 0;
+    }
+    if (n == snowflake_max_digits && digits > std::string_view("18446744073709551615")) {
+        return 0;
+    }
+    const char* p = digits.data();
+    uint64_t value = 0;
+    /* Leading digits which don't make up a full group of eight */
+    size_t head = n % 8;
+    for (size_t i = 0; i < head; ++i) {
+        if (!digit(p[i])) {
+            return 0;
+        }
+        value = value * 10 + static_cast<uint64_t>(p[i] - '0');
+    }
+    for (size_t i = head; i < n; i += 8) {
+        uint64_t chunk = load8(p + i);
+        if (!all_digits8(chunk)) {
+            return 0;
+        }
+        value = value * 100000000ULL + digits8_value(chunk);
+    }
+    return value;
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+size_t format_snowflake(uint64_t value, char* out) noexcept {
+    char buffer[snowflake_max_digits];
+    char* end = buffer + snowflake_max_digits;
+    char* p = end;
+    while (value >= 100) {
+        unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+    }
+    if (value >= 10) {
+        unsigned pair = static_cast<unsigned>(value) * 2;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+    size_t len = static_cast<size_t>(end - p);
+    std::memcpy(out, p, len);
+    return len;
+}
+
+std::string snowflake_str(uint64_t value) {
+    char buffer[snowflake_max_digits];
+    return std::string(buffer, format_snowflake(value, buffer));
+}
+
+dpp::snowflake json_snowflake(const nlohmann::json& j, const char* key) noexcept {
+    auto it = j.find(key);
+    if (it == j.end()) {
+        return {};
+    }
+    if (it->is_string()) {
+        const std::string& s = it->get_ref<const std::string&>();
+        return parse_snowflake(s);
+    }
+    if (it->is_number_unsigned()) {
+        return it->get<uint64_t>();
+    }
+    return {};
+}
+
+time_t json_timestamp(const nlohmann::json& j, const char* key) noexcept {
+    auto it = j.find(key);
+    if (it == j.end() || !it->is_string()) {
+        return 0;
+    }
+    return parse_iso8601(it->get_ref<const std::string&>());
+}
+
+}
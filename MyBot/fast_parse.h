@@ -0,0 +1,69 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+namespace mybot {
+
+/**
+ * @brief Longest decimal representation of a 64 bit snowflake
+ */
+constexpr size_t snowflake_max_digits = 20;
+
+/**
+ * @brief Parse a Discord ISO-8601 timestamp such as
+ * `2015-04-26T06:26:56.936000+00:00`.
+ *
+ * Discord only ever sends this one fixed layout, so rather than going through
+ * strptime/std::get_time and mktime (which also consults the local time zone)
+ * the fields are read from fixed offsets and converted with integer arithmetic.
+ * Fractional seconds are accepted and discarded; `Z` or a `+HH:MM`/`-HH:MM`
+ * offset are honoured.
+ *
+ * @param ts timestamp text
+ * @return seconds since the unix epoch (UTC), or 0 if the text is not a valid timestamp
+ */
+time_t parse_iso8601(std::string_view ts) noexcept;
+
+/**
+ * @brief Parse a decimal snowflake, eight digits at a time.
+ * @param digits text containing only the digits of the id
+ * @return the id, or 0 if the text is empty, too long, contains non-digits or overflows
+ */
+uint64_t parse_snowflake(std::string_view digits) noexcept;
+
+/**
+ * @brief Write a snowflake as decimal, two digits at a time.
+ * @param value id to format
+ * @param out buffer of at least snowflake_max_digits characters. Not null terminated.
+ * @return number of characters written
+ */
+size_t format_snowflake(uint64_t value, char* out) noexcept;
+
+/**
+ * @brief Format a snowflake as a string, for use in place of dpp::snowflake::str()
+ * @param value id to format
+ * @return decimal string
+ */
+std::string snowflake_str(uint64_t value);
+
+/**
+ * @brief Read a snowflake field from a JSON object. Discord sends ids as strings;
+ * numbers are accepted too.
+ * @param j JSON object
+ * @param key field name
+ * @return the id, or 0 if missing, null or invalid
+ */
+dpp::snowflake json_snowflake(const nlohmann::json& j, const char* key) noexcept;
+
+/**
+ * @brief Read an ISO-8601 timestamp field from a JSON object
+ * @param j JSON object
+ * @param key field name
+ * @return seconds since the unix epoch, or 0 if missing, null or invalid
+ */
+time_t json_timestamp(const nlohmann::json& j, const char* key) noexcept;
+
+}
@@ -0,0 +1,1016 @@
+#include "gateway_loadgen.h"
+#include "fast_parse.h"
+#include "http_headers.h"
+#include "net.h"
+#include <cmath>
+#include <deque>
+#include <future>
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+namespace mybot {
+
+namespace {
+
+constexpr auto tick_interval = std::chrono::milliseconds(10);
+constexpr size_t max_handshake = 16 * 1024;
+constexpr uint64_t discord_epoch_ms = 1420070400000ull;
+
+/* SHA-1 (FIPS 180-4), needed only for Sec-WebSocket-Accept */
+std::array<uint8_t, 20> sha1(std::string_view data) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string msg(data);
+    uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    msg += static_cast<char>(0x80);
+    while (msg.size() % 64 != 56) {
+        msg += '\0';
+    }
+    for (int i = 7; i >= 0; --i) {
+        msg += static_cast<char>((bits >> (i * 8)) & 0xff);
+    }
+    auto rol = [](uint32_t v, int n) {
+        return (v << n) | (v >> (32 - n));
+    };
+    for (size_t block = 0; block < msg.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const auto* p = reinterpret_cast<const uint8_t*>(msg.data() + block + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    std::array<uint8_t, 20> out;
+    for (int i = 0; i < 5; ++i) {
+        out[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+        out[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+        out[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+        out[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+    return out;
+}
+
+std::string websocket_accept(std::string_view key) {
+    auto digest = sha1(std::string(key) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    return dpp::base64_encode(digest.data(), static_cast<unsigned int>(digest.size()));
+}
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/* ISO 8601 in Discord's form, from milliseconds since the Unix epoch.
+ * Days to civil date after Howard Hinnant's days_from_civil inverse.
+ */
+void append_iso(std::string& out, int64_t ms) {
+    int64_t secs = ms / 1000;
+    int64_t days = secs / 86400;
+    int64_t rem = secs % 86400;
+    int64_t z = days + 719468;
+    int64_t era = z / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t day = doy - (153 * mp + 2) / 5 + 1;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = yoe + era * 400 + (month <= 2);
+    char buffer[40];
+    int n = snprintf(buffer, sizeof(buffer), "\"%04d-%02d-%02dT%02d:%02d:%02d.%03d000+00:00\"", static_cast<int>(year), static_cast<int>(month), static_cast<int>(day),
+        static_cast<int>(rem / 3600), static_cast<int>(rem / 60 % 60), static_cast<int>(rem % 60), static_cast<int>(ms % 1000));
+    out.append(buffer, static_cast<size_t>(n));
+}
+
+void append_id(std::string& out, uint64_t id) {
+    char buffer[snowflake_max_digits];
+    out += '"';
+    out.append(buffer, format_snowflake(id, buffer));
+    out += '"';
+}
+
+void append_uint(std::string& out, uint64_t value) {
+    char buffer[snowflake_max_digits];
+    out.append(buffer, format_snowflake(value, buffer));
+}
+
+/* Ids are deterministic, so that every run of the same configuration builds
+ * the same guilds: the guild index sits above the 22 low bits like a
+ * timestamp, and the low bits say what kind of object it is.
+ */
+uint64_t guild_id(uint32_t g) {
+    return (static_cast<uint64_t>(g) + 1) << 22;
+}
+
+uint64_t channel_id(uint32_t g, uint32_t c) {
+    return guild_id(g) | (1u << 20) | c;
+}
+
+uint64_t role_id(uint32_t g, uint32_t r) {
+    /* @everyone shares the guild's id */
+    return r == 0 ? guild_id(g) : guild_id(g) | (2u << 20) | r;
+}
+
+uint64_t user_id(uint64_t u) {
+    return ((u + 1) << 22) | (3u << 20);
+}
+
+constexpr uint64_t bot_id = (1ull << 22) | (3u << 20) | 1;
+
+void append_user(std::string& out, uint64_t u) {
+    out += "{\"id\":";
+    append_id(out, user_id(u));
+    out += ",\"username\":\"user";
+    append_uint(out, u);
+    out += "\",\"discriminator\":\"0\",\"global_name\":\"User ";
+    append_uint(out, u);
+    out += "\",\"avatar\":null}";
+}
+
+/* A member object; with_user false for MESSAGE_CREATE, which sends the user as "author" */
+void append_member(std::string& out, uint32_t g, uint64_t u, uint32_t roles, bool with_user) {
+    out += '{';
+    if (with_user) {
+        out += "\"user\":";
+        append_user(out, u);
+        out += ',';
+    }
+    out += "\"roles\":[";
+    if (roles > 1) {
+        append_id(out, role_id(g, 1 + static_cast<uint32_t>(u % (roles - 1))));
+    }
+    out += "],\"joined_at\":";
+    append_iso(out, 1600000000000ll + static_cast<int64_t>(u % 100000000) * 1000);
+    out += ",\"nick\":null,\"deaf\":false,\"mute\":false,\"flags\":0,\"pending\":false}";
+}
+
+}
+
+struct gateway_loadgen::session {
+    std::string id;
+    uint32_t shard{0};
+    uint32_t shards{1};
+    uint64_t seq{0};
+    std::vector<uint32_t> guilds;
+};
+
+struct gateway_loadgen::connection {
+    /* A guild whose member list is still being sent in chunks */
+    struct chunk_job {
+        uint32_t guild;
+        uint32_t index;
+        uint32_t count;
+        std::string nonce;
+    };
+
+    dpp::socket fd{INVALID_SOCKET};
+    std::string handshake;
+    bool upgraded{false};
+    ws_reader reader{true, 1024 * 1024, 16 * 1024};
+    std::string out;
+    size_t sent{0};
+    bool writing{false};
+    std::shared_ptr<session> sess;
+    size_t next_create{0};
+    bool streaming{false};
+    double owed{0};
+    std::deque<chunk_job> chunks;
+
+    size_t backlog() const {
+        return out.size() - sent;
+    }
+};
+
+gateway_loadgen::gateway_loadgen(io_loop& io, const loadgen_config& cfg, uint16_t port) : loop(io), config(cfg), random(cfg.seed), alive(std::make_shared<bool>(true)) {
+    if (config.users == 0) {
+        config.users = std::max<uint32_t>(1, static_cast<uint32_t>(static_cast<uint64_t>(config.guilds) * config.members_per_guild / 2));
+    }
+    config.chunk_size = std::max<uint32_t>(1, std::min<uint32_t>(config.chunk_size, 1000));
+    config.channels_per_guild = std::max<uint32_t>(1, config.channels_per_guild);
+    config.roles_per_guild = std::max<uint32_t>(1, config.roles_per_guild);
+
+    net_init();
+    ip_address address;
+    ip_address::parse("127.0.0.1", port, address);
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int one = 1;
+    if (listen_fd == INVALID_SOCKET
+        || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one)) != 0
+        || ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address.addr), address.len) != 0
+        || ::listen(listen_fd, 128) != 0
+        || !set_nonblocking(listen_fd)) {
+        int err = last_socket_error();
+        if (listen_fd != INVALID_SOCKET) {
+            close_socket(listen_fd);
+        }
+        throw dpp::connection_exception("gateway_loadgen: can't listen on port " + std::to_string(port) + " (error " + std::to_string(err) + ")");
+    }
+    ip_address bound;
+    bound.len = sizeof(bound.addr);
+    getsockname(listen_fd, reinterpret_cast<sockaddr*>(&bound.addr), &bound.len);
+    bound_port = bound.get_port();
+
+    io_events e;
+    e.fd = listen_fd;
+    e.flags = WANT_READ;
+    e.on_read = [this](dpp::socket) {
+        accept_all();
+    };
+    loop.add(e);
+
+    last_tick = std::chrono::steady_clock::now();
+    next_storm = last_tick + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.storm_every));
+    std::weak_ptr<bool> live = alive;
+    loop.post([this, live] {
+        if (live.lock()) {
+            tick();
+        }
+    });
+}
+
+gateway_loadgen::~gateway_loadgen() {
+    auto cleanup = [this] {
+        loop.cancel(tick_timer);
+        loop.remove(listen_fd);
+        close_socket(listen_fd);
+        for (auto& [fd, c] : connections) {
+            loop.remove(fd);
+            close_socket(fd);
+        }
+        connections.clear();
+        alive.reset();
+    };
+    if (loop.in_loop_thread()) {
+        cleanup();
+    } else {
+        std::promise<void> done;
+        loop.post([&] {
+            cleanup();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+uint16_t gateway_loadgen::port() const {
+    return bound_port;
+}
+
+std::string gateway_loadgen::url() const {
+    return "ws://127.0.0.1:" + std::to_string(bound_port);
+}
+
+loadgen_stats gateway_loadgen::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void gateway_loadgen::accept_all() {
+    for (;;) {
+        dpp::socket fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd == INVALID_SOCKET) {
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close_socket(fd);
+            continue;
+        }
+        auto c = std::make_shared<connection>();
+        c->fd = fd;
+        connections[fd] = c;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.accepted++;
+            counters.connections = connections.size();
+        }
+        io_events e;
+        e.fd = fd;
+        e.flags = WANT_READ;
+        e.on_read = [this, c](dpp::socket) {
+            on_readable(c);
+        };
+        e.on_write = [this, c](dpp::socket) {
+            flush(c);
+        };
+        e.on_error = [this, c](dpp::socket, int) {
+            drop(c);
+        };
+        loop.add(e);
+    }
+}
+
+void gateway_loadgen::on_readable(const std::shared_ptr<connection>& c) {
+    for (;;) {
+        size_t space = 0;
+        char* into = nullptr;
+        char buffer[4096];
+        if (c->upgraded) {
+            into = c->reader.prepare(16 * 1024, space);
+        } else {
+            into = buffer;
+            space = sizeof(buffer);
+        }
+        auto r = ::recv(c->fd, into, static_cast<int>(space), 0);
+        if (r > 0) {
+            if (c->upgraded) {
+                c->reader.commit(static_cast<size_t>(r));
+            } else {
+                c->handshake.append(buffer, static_cast<size_t>(r));
+                if (!upgrade(c)) {
+                    return;
+                }
+            }
+            continue;
+        }
+        if (r < 0 && error_is_transient(last_socket_error())) {
+            break;
+        }
+        drop(c);
+        return;
+    }
+    if (!c->upgraded) {
+        return;
+    }
+    ws_message m;
+    for (;;) {
+        ws_status status = c->reader.next(m);
+        if (status == ws_need_more) {
+            break;
+        }
+        if (status != ws_ok) {
+            drop(c);
+            return;
+        }
+        on_message(c, m);
+        if (c->fd == INVALID_SOCKET) {
+            return;
+        }
+    }
+    flush(c);
+}
+
+/* Returns false if the connection was dropped */
+bool gateway_loadgen::upgrade(const std::shared_ptr<connection>& c) {
+    size_t end = c->handshake.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c->handshake.size() > max_handshake) {
+            drop(c);
+            return false;
+        }
+        return true;
+    }
+    std::string_view head(c->handshake.data(), end);
+    size_t eol = head.find("\r\n");
+    flat_headers headers = flat_headers::parse(eol == std::string_view::npos ? std::string_view() : head.substr(eol + 2));
+    std::string_view key = headers.get("Sec-WebSocket-Key");
+    if (head.compare(0, 4, "GET ") != 0 || key.empty()) {
+        drop(c);
+        return false;
+    }
+    c->out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+    c->out += websocket_accept(key);
+    c->out += "\r\n\r\n";
+    c->upgraded = true;
+    /* Anything the client sent after the handshake is already WebSocket frames */
+    c->reader.feed(std::string_view(c->handshake).substr(end + 4));
+    c->handshake.clear();
+    c->handshake.shrink_to_fit();
+    send_op(c, 10, "{\"heartbeat_interval\":" + std::to_string(config.heartbeat_interval.count()) + "}");
+    return true;
+}
+
+void gateway_loadgen::on_message(const std::shared_ptr<connection>& c, const ws_message& m) {
+    if (m.opcode == ws_close) {
+        drop(c);
+        return;
+    }
+    if (m.opcode == ws_ping) {
+        ws_encode(c->out, ws_pong, m.payload, false);
+        return;
+    }
+    if (m.opcode != ws_text && m.opcode != ws_binary) {
+        return;
+    }
+    nlohmann::json j = nlohmann::json::parse(m.payload, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return;
+    }
+    int op = j.value("op", -1);
+    static const nlohmann::json empty = nlohmann::json::object();
+    const nlohmann::json& d = j.contains("d") && j["d"].is_object() ? j["d"] : empty;
+    switch (op) {
+        case 1:
+            send_op(c, 11, "null");
+            break;
+        case 2:
+            identify(c, d);
+            break;
+        case 6:
+            resume(c, d);
+            break;
+        case 8:
+            request_members(c, d);
+            break;
+        default:
+            /* Presence and voice state updates from the bot are accepted and ignored */
+            break;
+    }
+}
+
+void gateway_loadgen::identify(const std::shared_ptr<connection>& c, const nlohmann::json& d) {
+    auto s = std::make_shared<session>();
+    if (d.contains("shard") && d["shard"].is_array() && d["shard"].size() == 2 && d["shard"][0].is_number_unsigned() && d["shard"][1].is_number_unsigned()) {
+        s->shard = d["shard"][0].get<uint32_t>();
+        s->shards = std::max<uint32_t>(1, d["shard"][1].get<uint32_t>());
+    }
+    s->id = "loadgen" + std::to_string(next_session++);
+    for (uint32_t g = 0; g < config.guilds; ++g) {
+        if ((guild_id(g) >> 22) % s->shards == s->shard) {
+            s->guilds.push_back(g);
+        }
+    }
+    sessions[s->id] = s;
+    c->sess = s;
+    c->next_create = 0;
+    c->streaming = false;
+    c->owed = 0;
+    c->chunks.clear();
+
+    std::string ready;
+    ready.reserve(256 + s->guilds.size() * 48);
+    ready += "{\"v\":10,\"user\":{\"id\":";
+    append_id(ready, bot_id);
+    ready += ",\"username\":\"loadgen\",\"discriminator\":\"0\",\"global_name\":null,\"avatar\":null,\"bot\":true,\"verified\":true},\"guilds\":[";
+    for (size_t i = 0; i < s->guilds.size(); ++i) {
+        if (i > 0) {
+            ready += ',';
+        }
+        ready += "{\"id\":";
+        append_id(ready, guild_id(s->guilds[i]));
+        ready += ",\"unavailable\":true}";
+    }
+    /* D++ resumes on the host in resume_gateway_url, so keep it pointing here */
+    ready += "],\"session_id\":\"" + s->id + "\",\"resume_gateway_url\":\"wss://127.0.0.1\",\"shard\":[" + std::to_string(s->shard) + "," + std::to_string(s->shards) + "],\"application\":{\"id\":";
+    append_id(ready, bot_id);
+    ready += ",\"flags\":0}}";
+    dispatch(c, "READY", ready);
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.identifies++;
+}
+
+void gateway_loadgen::resume(const std::shared_ptr<connection>& c, const nlohmann::json& d) {
+    std::string id = d.contains("session_id") && d["session_id"].is_string() ? d["session_id"].get<std::string>() : "";
+    auto it = sessions.find(id);
+    if (it == sessions.end()) {
+        send_op(c, 9, "false");
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.failed_resumes++;
+        return;
+    }
+    /* A session lives on one connection; one being resumed elsewhere is taken over */
+    for (auto& [fd, other] : connections) {
+        if (other != c && other->sess == it->second) {
+            other->sess.reset();
+            other->streaming = false;
+        }
+    }
+    c->sess = it->second;
+    c->next_create = c->sess->guilds.size();
+    c->streaming = true;
+    c->owed = 0;
+    dispatch(c, "RESUMED", "{}");
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.resumes++;
+}
+
+void gateway_loadgen::request_members(const std::shared_ptr<connection>& c, const nlohmann::json& d) {
+    std::vector<uint64_t> ids;
+    if (d.contains("guild_id")) {
+        const nlohmann::json& g = d["guild_id"];
+        if (g.is_array()) {
+            for (const auto& id : g) {
+                if (id.is_string()) {
+                    ids.push_back(parse_snowflake(id.get<std::string>()));
+                } else if (id.is_number_unsigned()) {
+                    ids.push_back(id.get<uint64_t>());
+                }
+            }
+        } else {
+            ids.push_back(json_snowflake(d, "guild_id"));
+        }
+    }
+    std::string nonce = d.contains("nonce") && d["nonce"].is_string() ? d["nonce"].get<std::string>() : "";
+    uint32_t count = (config.members_per_guild + config.chunk_size - 1) / config.chunk_size;
+    for (uint64_t id : ids) {
+        uint64_t index = (id >> 22) - 1;
+        if (id != 0 && index < config.guilds && guild_id(static_cast<uint32_t>(index)) == id) {
+            c->chunks.push_back({static_cast<uint32_t>(index), 0, std::max<uint32_t>(count, 1), nonce});
+        }
+    }
+}
+
+void gateway_loadgen::tick() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_tick).count();
+    last_tick = now;
+
+    if (config.storm_every > 0 && now >= next_storm) {
+        next_storm = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.storm_every));
+        storm();
+    }
+
+    size_t streaming = 0;
+    for (auto& [fd, c] : connections) {
+        streaming += c->streaming;
+    }
+    double share = streaming > 0 ? config.events_per_second * elapsed / static_cast<double>(streaming) : 0;
+
+    /* drop() erases from connections, so work on a copy */
+    std::vector<std::shared_ptr<connection>> live;
+    live.reserve(connections.size());
+    for (auto& [fd, c] : connections) {
+        live.push_back(c);
+    }
+    for (auto& c : live) {
+        if (c->fd == INVALID_SOCKET) {
+            continue;
+        }
+        if (c->sess) {
+            pump(c, c->streaming ? share : 0);
+        }
+        flush(c);
+    }
+
+    std::weak_ptr<bool> alive_now = alive;
+    tick_timer = loop.after(tick_interval, [this, alive_now] {
+        if (alive_now.lock()) {
+            tick();
+        }
+    });
+}
+
+void gateway_loadgen::storm() {
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::vector<std::shared_ptr<connection>> hit;
+    for (auto& [fd, c] : connections) {
+        if (c->sess && chance(random) < config.storm_fraction) {
+            hit.push_back(c);
+        }
+    }
+    for (auto& c : hit) {
+        switch (config.storm) {
+            case storm_reconnect:
+                /* The session stays resumable; this connection just stops sending */
+                send_op(c, 7, "null");
+                c->sess.reset();
+                c->streaming = false;
+                break;
+            case storm_drop:
+                drop(c);
+                break;
+            case storm_invalid_session:
+                sessions.erase(c->sess->id);
+                c->sess.reset();
+                c->streaming = false;
+                send_op(c, 9, "false");
+                break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.storms++;
+}
+
+void gateway_loadgen::pump(const std::shared_ptr<connection>& c, double events) {
+    const session& s = *c->sess;
+    while (c->next_create < s.guilds.size() && c->backlog() < config.max_backlog) {
+        uint32_t g = s.guilds[c->next_create++];
+        dispatch(c, "GUILD_CREATE", guild_create(g));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.guild_creates++;
+        }
+        if (config.chunk_flood) {
+            c->chunks.push_back({g, 0, (config.members_per_guild + config.chunk_size - 1) / config.chunk_size, ""});
+        }
+    }
+    if (c->next_create >= s.guilds.size() && !c->streaming) {
+        c->streaming = true;
+    }
+    /* Chunks take at most half the backlog, so the event stream still gets through a flood */
+    while (!c->chunks.empty() && c->backlog() < config.max_backlog / 2) {
+        auto& job = c->chunks.front();
+        dispatch(c, "GUILD_MEMBERS_CHUNK", member_chunk(job.guild, job.index, job.count, job.nonce));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.member_chunks++;
+        }
+        if (++job.index >= job.count) {
+            c->chunks.pop_front();
+        }
+    }
+
+    c->owed += events;
+    uint64_t due = static_cast<uint64_t>(c->owed);
+    c->owed -= static_cast<double>(due);
+    uint64_t generated = 0;
+    while (generated < due && c->backlog() < config.max_backlog && !s.guilds.empty()) {
+        const char* event = nullptr;
+        std::string d = stream_event(c, event);
+        dispatch(c, event, d);
+        generated++;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.events += generated;
+    counters.skipped += due - generated;
+}
+
+void gateway_loadgen::send_op(const std::shared_ptr<connection>& c, int op, const std::string& d) {
+    std::string frame = "{\"op\":" + std::to_string(op) + ",\"d\":" + d + "}";
+    ws_encode(c->out, ws_text, frame, false);
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.frames++;
+    counters.bytes += frame.size();
+}
+
+void gateway_loadgen::dispatch(const std::shared_ptr<connection>& c, const char* event, const std::string& d) {
+    std::string frame;
+    frame.reserve(d.size() + 96);
+    frame += "{\"_lg\":";
+    append_uint(frame, static_cast<uint64_t>(now_us()));
+    frame += ",\"op\":0,\"s\":";
+    append_uint(frame, ++c->sess->seq);
+    frame += ",\"t\":\"";
+    frame += event;
+    frame += "\",\"d\":";
+    frame += d;
+    frame += '}';
+    ws_encode(c->out, ws_text, frame, false);
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.frames++;
+    counters.bytes += frame.size();
+}
+
+void gateway_loadgen::flush(const std::shared_ptr<connection>& c) {
+    while (c->sent < c->out.size()) {
+        auto w = ::send(c->fd, c->out.data() + c->sent, static_cast<int>(std::min<size_t>(c->out.size() - c->sent, 1 << 20)), send_flags);
+        if (w > 0) {
+            c->sent += static_cast<size_t>(w);
+            continue;
+        }
+        if (w < 0 && error_is_transient(last_socket_error())) {
+            if (!c->writing) {
+                c->writing = true;
+                loop.set_flags(c->fd, WANT_READ | WANT_WRITE);
+            }
+            /* Keep the unsent tail at the front, so the buffer does not only grow */
+            if (c->sent > c->out.size() / 2) {
+                c->out.erase(0, c->sent);
+                c->sent = 0;
+            }
+            return;
+        }
+        drop(c);
+        return;
+    }
+    c->out.clear();
+    c->sent = 0;
+    if (c->writing) {
+        c->writing = false;
+        loop.set_flags(c->fd, WANT_READ);
+    }
+}
+
+void gateway_loadgen::drop(const std::shared_ptr<connection>& c) {
+    if (c->fd == INVALID_SOCKET) {
+        return;
+    }
+    loop.remove(c->fd);
+    close_socket(c->fd);
+    connections.erase(c->fd);
+    c->fd = INVALID_SOCKET;
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.connections = connections.size();
+}
+
+uint64_t gateway_loadgen::user_of(uint32_t guild, uint32_t member) const {
+    return (static_cast<uint64_t>(guild) * 7919 + member) % config.users;
+}
+
+std::string gateway_loadgen::guild_create(uint32_t g) {
+    std::string d;
+    uint32_t inline_members = std::min(config.create_members, config.members_per_guild);
+    d.reserve(512 + config.channels_per_guild * 200 + config.roles_per_guild * 160 + inline_members * 300);
+    d += "{\"id\":";
+    append_id(d, guild_id(g));
+    d += ",\"name\":\"Load Guild ";
+    append_uint(d, g);
+    d += "\",\"icon\":null,\"splash\":null,\"owner_id\":";
+    append_id(d, user_id(user_of(g, 0)));
+    d += ",\"afk_channel_id\":null,\"afk_timeout\":300,\"verification_level\":1,\"default_message_notifications\":1,\"explicit_content_filter\":2,\"features\":[],\"mfa_level\":0,\"system_channel_id\":";
+    append_id(d, channel_id(g, 0));
+    d += ",\"premium_tier\":0,\"preferred_locale\":\"en-US\",\"nsfw_level\":0,\"joined_at\":";
+    append_iso(d, 1650000000000ll + g * 1000ll);
+    d += ",\"large\":";
+    d += config.members_per_guild > 250 ? "true" : "false";
+    d += ",\"unavailable\":false,\"member_count\":";
+    append_uint(d, config.members_per_guild);
+    d += ",\"roles\":[";
+    for (uint32_t r = 0; r < config.roles_per_guild; ++r) {
+        if (r > 0) {
+            d += ',';
+        }
+        d += "{\"id\":";
+        append_id(d, role_id(g, r));
+        d += ",\"name\":\"";
+        d += r == 0 ? std::string("@everyone") : "role-" + std::to_string(r);
+        d += "\",\"color\":";
+        append_uint(d, r * 0x1f2f3f % 0xffffff);
+        d += ",\"hoist\":false,\"icon\":null,\"unicode_emoji\":null,\"position\":";
+        append_uint(d, r);
+        d += ",\"permissions\":\"";
+        d += r == 0 ? "1071698660929" : "2147483647";
+        d += "\",\"managed\":false,\"mentionable\":false,\"flags\":0}";
+    }
+    d += "],\"channels\":[";
+    for (uint32_t ch = 0; ch < config.channels_per_guild; ++ch) {
+        if (ch > 0) {
+            d += ',';
+        }
+        d += "{\"id\":";
+        append_id(d, channel_id(g, ch));
+        d += ",\"type\":0,\"guild_id\":";
+        append_id(d, guild_id(g));
+        d += ",\"name\":\"channel-";
+        append_uint(d, ch);
+        d += "\",\"position\":";
+        append_uint(d, ch);
+        d += ",\"topic\":null,\"nsfw\":false,\"last_message_id\":null,\"rate_limit_per_user\":0,\"parent_id\":null,\"flags\":0,\"permission_overwrites\":[";
+        if (config.roles_per_guild > 1) {
+            d += "{\"id\":";
+            append_id(d, role_id(g, 1 + ch % (config.roles_per_guild - 1)));
+            d += ",\"type\":0,\"allow\":\"1024\",\"deny\":\"2048\"}";
+        }
+        d += "]}";
+    }
+    d += "],\"members\":[";
+    for (uint32_t m = 0; m < inline_members; ++m) {
+        if (m > 0) {
+            d += ',';
+        }
+        append_member(d, g, user_of(g, m), config.roles_per_guild, true);
+    }
+    d += "],\"presences\":[],\"voice_states\":[],\"threads\":[],\"stage_instances\":[],\"guild_scheduled_events\":[],\"emojis\":[],\"stickers\":[]}";
+    return d;
+}
+
+std::string gateway_loadgen::member_chunk(uint32_t g, uint32_t index, uint32_t count, const std::string& nonce) {
+    uint32_t first = index * config.chunk_size;
+    uint32_t last = std::min(config.members_per_guild, first + config.chunk_size);
+    std::string d;
+    d.reserve(128 + (last - first) * 300);
+    d += "{\"guild_id\":";
+    append_id(d, guild_id(g));
+    d += ",\"members\":[";
+    for (uint32_t m = first; m < last; ++m) {
+        if (m > first) {
+            d += ',';
+        }
+        append_member(d, g, user_of(g, m), config.roles_per_guild, true);
+    }
+    d += "],\"chunk_index\":";
+    append_uint(d, index);
+    d += ",\"chunk_count\":";
+    append_uint(d, count);
+    if (!nonce.empty()) {
+        d += ",\"nonce\":";
+        d += nlohmann::json(nonce).dump();
+    }
+    d += '}';
+    return d;
+}
+
+std::string gateway_loadgen::stream_event(const std::shared_ptr<connection>& c, const char*& event) {
+    const session& s = *c->sess;
+    uint32_t g = s.guilds[random() % s.guilds.size()];
+    uint32_t ch = static_cast<uint32_t>(random() % config.channels_per_guild);
+    uint64_t u = user_of(g, config.members_per_guild > 0 ? static_cast<uint32_t>(random() % config.members_per_guild) : 0);
+    int64_t now_ms = now_us() / 1000;
+
+    double total = config.mix[0] + config.mix[1] + config.mix[2] + config.mix[3];
+    double pick = std::uniform_real_distribution<double>(0, total > 0 ? total : 1)(random);
+    size_t kind = 0;
+    while (kind < 3 && pick >= config.mix[kind]) {
+        pick -= config.mix[kind];
+        kind++;
+    }
+
+    std::string d;
+    d.reserve(768);
+    switch (kind) {
+        case 0: {
+            event = "MESSAGE_CREATE";
+            uint64_t seq = next_message++;
+            d += "{\"id\":";
+            append_id(d, ((static_cast<uint64_t>(now_ms) - discord_epoch_ms) << 22) | (seq & 0x3fffff));
+            d += ",\"channel_id\":";
+            append_id(d, channel_id(g, ch));
+            d += ",\"guild_id\":";
+            append_id(d, guild_id(g));
+            d += ",\"author\":";
+            append_user(d, u);
+            d += ",\"member\":";
+            append_member(d, g, u, config.roles_per_guild, false);
+            d += ",\"content\":\"load test message ";
+            append_uint(d, seq);
+            d += "\",\"timestamp\":";
+            append_iso(d, now_ms);
+            d += ",\"edited_timestamp\":null,\"tts\":false,\"mention_everyone\":false,\"mentions\":[],\"mention_roles\":[],\"attachments\":[],\"embeds\":[],\"pinned\":false,\"type\":0,\"flags\":0}";
+            break;
+        }
+        case 1: {
+            static const char* const statuses[] = {"online", "idle", "dnd"};
+            const char* status = statuses[random() % 3];
+            event = "PRESENCE_UPDATE";
+            d += "{\"user\":{\"id\":";
+            append_id(d, user_id(u));
+            d += "},\"guild_id\":";
+            append_id(d, guild_id(g));
+            d += ",\"status\":\"";
+            d += status;
+            d += "\",\"activities\":[],\"client_status\":{\"desktop\":\"";
+            d += status;
+            d += "\"}}";
+            break;
+        }
+        case 2:
+            event = "TYPING_START";
+            d += "{\"channel_id\":";
+            append_id(d, channel_id(g, ch));
+            d += ",\"guild_id\":";
+            append_id(d, guild_id(g));
+            d += ",\"user_id\":";
+            append_id(d, user_id(u));
+            d += ",\"timestamp\":";
+            append_uint(d, static_cast<uint64_t>(now_ms / 1000));
+            d += ",\"member\":";
+            append_member(d, g, u, config.roles_per_guild, true);
+            d += '}';
+            break;
+        default:
+            event = "MESSAGE_REACTION_ADD";
+            d += "{\"user_id\":";
+            append_id(d, user_id(u));
+            d += ",\"channel_id\":";
+            append_id(d, channel_id(g, ch));
+            d += ",\"message_id\":";
+            append_id(d, ((static_cast<uint64_t>(now_ms) - discord_epoch_ms - random() % 3600000) << 22) | (random() & 0x3fffff));
+            d += ",\"guild_id\":";
+            append_id(d, guild_id(g));
+            d += ",\"member\":";
+            append_member(d, g, u, config.roles_per_guild, true);
+            d += ",\"emoji\":{\"id\":null,\"name\":\"\\u2b50\"},\"burst\":false,\"type\":0}";
+            break;
+    }
+    return d;
+}
+
+std::string loadgen_report::str() const {
+    auto mib = [](uint64_t bytes) {
+        return std::to_string(bytes / (1024 * 1024)) + " MiB";
+    };
+    char lag[96];
+    snprintf(lag, sizeof(lag), "lag p50 %.2fms p99 %.2fms max %.2fms", lag_p50_ms, lag_p99_ms, lag_max_ms);
+    return std::to_string(events) + " events, " + lag + ", rss " + mib(rss) + " (start " + mib(rss_start) + ", peak " + mib(rss_peak) + "), "
+        + std::to_string(guilds) + " guilds and " + std::to_string(users) + " users cached";
+}
+
+loadgen_probe::~loadgen_probe() {
+    for (auto& fn : detach) {
+        fn();
+    }
+}
+
+void loadgen_probe::attach(dpp::cluster& bot) {
+    uint64_t rss = resident_memory();
+    rss_start = rss;
+    rss_peak = rss;
+    auto listen = [this](auto& router) {
+        auto handle = router([this](const auto& event) {
+            record(event.raw_event);
+        });
+        detach.push_back([&router, handle] {
+            router.detach(handle);
+        });
+    };
+    listen(bot.on_guild_create);
+    listen(bot.on_guild_members_chunk);
+    listen(bot.on_message_create);
+    listen(bot.on_presence_update);
+    listen(bot.on_typing_start);
+    listen(bot.on_message_reaction_add);
+}
+
+void loadgen_probe::record(const std::string& raw) {
+    static constexpr std::string_view prefix = "{\"_lg\":";
+    if (raw.size() <= prefix.size() || raw.compare(0, prefix.size(), prefix) != 0) {
+        return;
+    }
+    int64_t stamp = 0;
+    for (size_t i = prefix.size(); i < raw.size() && raw[i] >= '0' && raw[i] <= '9'; ++i) {
+        stamp = stamp * 10 + (raw[i] - '0');
+    }
+    int64_t lag = std::max<int64_t>(0, now_us() - stamp);
+    /* Bucket 0 is under a microsecond; after that, four buckets per doubling */
+    size_t bucket = lag < 1 ? 0 : std::min(bucket_count - 1, static_cast<size_t>(std::log2(static_cast<double>(lag)) * 4) + 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    int64_t seen = max_us.load(std::memory_order_relaxed);
+    while (lag > seen && !max_us.compare_exchange_weak(seen, lag, std::memory_order_relaxed)) {
+    }
+}
+
+loadgen_report loadgen_probe::report() {
+    loadgen_report r;
+    std::array<uint64_t, bucket_count> snapshot;
+    uint64_t total = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    auto percentile = [&](double p) {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += snapshot[i];
+            if (seen >= rank && snapshot[i] > 0) {
+                /* The geometric middle of the bucket */
+                return i == 0 ? 0.0005 : std::pow(2.0, (static_cast<double>(i) - 0.5) / 4) / 1000;
+            }
+        }
+        return 0.0;
+    };
+    r.events = total;
+    r.lag_p50_ms = total > 0 ? percentile(0.5) : 0;
+    r.lag_p99_ms = total > 0 ? percentile(0.99) : 0;
+    r.lag_max_ms = static_cast<double>(max_us.load()) / 1000;
+    r.rss = resident_memory();
+    uint64_t peak = rss_peak.load();
+    while (r.rss > peak && !rss_peak.compare_exchange_weak(peak, r.rss)) {
+    }
+    r.rss_peak = std::max(peak, r.rss);
+    r.rss_start = rss_start.load();
+    r.guilds = dpp::get_guild_count();
+    r.users = dpp::get_user_count();
+    return r;
+}
+
+uint64_t loadgen_probe::resident_memory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident) {
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+}
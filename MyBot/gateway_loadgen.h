@@ -0,0 +1,395 @@
+#pragma once
+#include "io_loop.h"
+#include "ws_codec.h"
+#include <array>
+#include <random>
+
+namespace mybot {
+
+/**
+ * @brief What a storm does to each connection it hits
+ */
+enum loadgen_storm {
+    /**
+     * @brief Send op 7 RECONNECT; the shard reconnects and resumes
+     */
+    storm_reconnect,
+
+    /**
+     * @brief Close the TCP connection without a close frame; the shard
+     * notices, reconnects and resumes
+     */
+    storm_drop,
+
+    /**
+     * @brief Send op 9 INVALID_SESSION (not resumable); the shard must
+     * identify again and receives every GUILD_CREATE again
+     */
+    storm_invalid_session,
+};
+
+/**
+ * @brief Shape of the traffic gateway_loadgen generates
+ */
+struct loadgen_config {
+    /**
+     * @brief Guilds, spread over the shards which identify
+     */
+    uint32_t guilds{1000};
+
+    /**
+     * @brief Members in each guild
+     */
+    uint32_t members_per_guild{200};
+
+    /**
+     * @brief Text channels in each guild
+     */
+    uint32_t channels_per_guild{20};
+
+    /**
+     * @brief Roles in each guild, including @everyone
+     */
+    uint32_t roles_per_guild{10};
+
+    /**
+     * @brief Distinct users across all guilds; guilds share users, as on
+     * Discord. Zero for half the total membership.
+     */
+    uint32_t users{0};
+
+    /**
+     * @brief Members sent inline in each GUILD_CREATE; Discord sends only a
+     * handful for large guilds
+     */
+    uint32_t create_members{50};
+
+    /**
+     * @brief Follow every GUILD_CREATE with the guild's whole member list as
+     * GUILD_MEMBERS_CHUNK events, as if the bot had requested it
+     */
+    bool chunk_flood{false};
+
+    /**
+     * @brief Members in each GUILD_MEMBERS_CHUNK; Discord's limit is 1000
+     */
+    uint32_t chunk_size{1000};
+
+    /**
+     * @brief Events per second once the shards are ready, across all of them
+     */
+    double events_per_second{1000};
+
+    /**
+     * @brief Relative weights of MESSAGE_CREATE, PRESENCE_UPDATE,
+     * TYPING_START and MESSAGE_REACTION_ADD in the event stream
+     */
+    std::array<double, 4> mix{60, 25, 10, 5};
+
+    /**
+     * @brief Seconds between storms; zero for none
+     */
+    double storm_every{0};
+
+    /**
+     * @brief What a storm does
+     */
+    loadgen_storm storm{storm_reconnect};
+
+    /**
+     * @brief Share of connections each storm hits
+     */
+    double storm_fraction{1};
+
+    /**
+     * @brief Heartbeat interval sent in HELLO
+     */
+    std::chrono::milliseconds heartbeat_interval{41250};
+
+    /**
+     * @brief Stop generating for a connection while this many bytes are
+     * waiting to be sent to it. Events due meanwhile are counted as skipped,
+     * not queued, so a slow bot sees back-pressure rather than unbounded
+     * buffering on this side.
+     */
+    size_t max_backlog{4 * 1024 * 1024};
+
+    /**
+     * @brief Random seed; the same seed and settings give the same stream
+     */
+    uint32_t seed{1};
+};
+
+/**
+ * @brief Counters kept by gateway_loadgen
+ */
+struct loadgen_stats {
+    /**
+     * @brief Connections open now
+     */
+    uint64_t connections{0};
+
+    /**
+     * @brief Connections accepted
+     */
+    uint64_t accepted{0};
+
+    /**
+     * @brief IDENTIFYs answered with READY
+     */
+    uint64_t identifies{0};
+
+    /**
+     * @brief RESUMEs answered with RESUMED
+     */
+    uint64_t resumes{0};
+
+    /**
+     * @brief RESUMEs for unknown sessions, answered with INVALID_SESSION
+     */
+    uint64_t failed_resumes{0};
+
+    /**
+     * @brief Storms started
+     */
+    uint64_t storms{0};
+
+    /**
+     * @brief GUILD_CREATE events sent
+     */
+    uint64_t guild_creates{0};
+
+    /**
+     * @brief GUILD_MEMBERS_CHUNK events sent
+     */
+    uint64_t member_chunks{0};
+
+    /**
+     * @brief Stream events (messages, presences, typing, reactions) sent
+     */
+    uint64_t events{0};
+
+    /**
+     * @brief Stream events not generated because the connection's backlog
+     * was full
+     */
+    uint64_t skipped{0};
+
+    /**
+     * @brief Frames sent, of every kind
+     */
+    uint64_t frames{0};
+
+    /**
+     * @brief Payload bytes sent
+     */
+    uint64_t bytes{0};
+};
+
+/**
+ * @brief A local Discord gateway which serves synthetic traffic, for scale
+ * testing the bot without Discord.
+ *
+ * It speaks the gateway protocol over plain ws:// with JSON encoding and no
+ * transport compression: HELLO, heartbeats, IDENTIFY answered with READY and a
+ * GUILD_CREATE for each of the shard's guilds, RESUME, and REQUEST_GUILD_MEMBERS
+ * answered with member chunks. After READY each shard receives its share of
+ * events_per_second. Guilds go to shards by (guild_id >> 22) % shard_count,
+ * as on Discord.
+ *
+ * Every dispatch frame starts with "_lg", the wall clock time it was generated
+ * in microseconds, which loadgen_probe reads to measure lag in the bot. D++
+ * ignores the extra key.
+ *
+ * Payloads are built by string concatenation from deterministic ids, so one
+ * loop thread can generate tens of thousands of events a second. Startup
+ * bursts (GUILD_CREATE, chunk floods) are paced by max_backlog rather than
+ * written all at once.
+ *
+ * D++ 10.0's discord_client always connects with TLS to port 443 of
+ * cluster::default_gateway. To point a shard here, terminate TLS on
+ * 127.0.0.1:443 in front of port() (stunnel or similar), call
+ * cluster::set_default_gateway("127.0.0.1"), and create the cluster with
+ * compression off.
+ */
+class gateway_loadgen {
+    struct session;
+    struct connection;
+
+    io_loop& loop;
+    loadgen_config config;
+    dpp::socket listen_fd{INVALID_SOCKET};
+    uint16_t bound_port{0};
+    mutable std::mutex mutex;
+    loadgen_stats counters;
+    std::mt19937_64 random;
+    std::unordered_map<dpp::socket, std::shared_ptr<connection>> connections;
+    std::unordered_map<std::string, std::shared_ptr<session>> sessions;
+    uint64_t next_session{1};
+    uint64_t next_message{0};
+    io_timer tick_timer{0};
+    std::chrono::steady_clock::time_point last_tick;
+    std::chrono::steady_clock::time_point next_storm;
+    std::shared_ptr<bool> alive;
+
+    void accept_all();
+    void on_readable(const std::shared_ptr<connection>& c);
+    bool upgrade(const std::shared_ptr<connection>& c);
+    void on_message(const std::shared_ptr<connection>& c, const ws_message& m);
+    void identify(const std::shared_ptr<connection>& c, const nlohmann::json& d);
+    void resume(const std::shared_ptr<connection>& c, const nlohmann::json& d);
+    void request_members(const std::shared_ptr<connection>& c, const nlohmann::json& d);
+    void tick();
+    void storm();
+    void pump(const std::shared_ptr<connection>& c, double events);
+    void send_op(const std::shared_ptr<connection>& c, int op, const std::string& d);
+    void dispatch(const std::shared_ptr<connection>& c, const char* event, const std::string& d);
+    void flush(const std::shared_ptr<connection>& c);
+    void drop(const std::shared_ptr<connection>& c);
+
+    std::string guild_create(uint32_t guild);
+    std::string member_chunk(uint32_t guild, uint32_t index, uint32_t count, const std::string& nonce);
+    std::string stream_event(const std::shared_ptr<connection>& c, const char*& event);
+    uint64_t user_of(uint32_t guild, uint32_t member) const;
+
+public:
+    /**
+     * @brief Start listening on 127.0.0.1
+     * @param io loop to serve on. It must outlive the generator.
+     * @param cfg traffic shape
+     * @param port port, or zero for any free port
+     * @throw dpp::connection_exception if the port can't be bound
+     */
+    gateway_loadgen(io_loop& io, const loadgen_config& cfg = {}, uint16_t port = 0);
+
+    /**
+     * @brief Close every connection and stop listening
+     */
+    ~gateway_loadgen();
+
+    gateway_loadgen(const gateway_loadgen&) = delete;
+    gateway_loadgen& operator=(const gateway_loadgen&) = delete;
+
+    /**
+     * @brief Port listened on
+     */
+    uint16_t port() const;
+
+    /**
+     * @brief "ws://127.0.0.1:port"
+     */
+    std::string url() const;
+
+    /**
+     * @brief Counters so far
+     */
+    loadgen_stats stats() const;
+};
+
+/**
+ * @brief What loadgen_probe has measured
+ */
+struct loadgen_report {
+    /**
+     * @brief Generated events which reached a handler
+     */
+    uint64_t events{0};
+
+    /**
+     * @brief Median lag from generation to the first handler, in milliseconds
+     */
+    double lag_p50_ms{0};
+
+    /**
+     * @brief 99th percentile lag
+     */
+    double lag_p99_ms{0};
+
+    /**
+     * @brief Largest lag
+     */
+    double lag_max_ms{0};
+
+    /**
+     * @brief Resident memory when the probe was attached, in bytes
+     */
+    uint64_t rss_start{0};
+
+    /**
+     * @brief Resident memory now
+     */
+    uint64_t rss{0};
+
+    /**
+     * @brief Largest resident memory seen by report()
+     */
+    uint64_t rss_peak{0};
+
+    /**
+     * @brief Guilds in D++'s cache
+     */
+    uint64_t guilds{0};
+
+    /**
+     * @brief Users in D++'s cache
+     */
+    uint64_t users{0};
+
+    /**
+     * @brief One line summary for the log
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief Measures, inside the bot, how far behind the generated traffic its
+ * event handlers run and how its memory grows.
+ *
+ * attach() adds a listener to each event type gateway_loadgen sends. Attach
+ * before the bot's own handlers: D++ runs listeners in the order they were
+ * attached, so the lag measured is up to the start of the first handler.
+ * Lags go into a lock-free histogram of quarter-octave buckets, so
+ * percentiles are accurate to about 20%.
+ */
+class loadgen_probe {
+    static constexpr size_t bucket_count = 112;
+
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> max_us{0};
+    std::atomic<uint64_t> rss_start{0};
+    std::atomic<uint64_t> rss_peak{0};
+    std::vector<std::function<void()>> detach;
+
+    void record(const std::string& raw);
+
+public:
+    loadgen_probe() = default;
+
+    /**
+     * @brief Detach from the cluster
+     */
+    ~loadgen_probe();
+
+    loadgen_probe(const loadgen_probe&) = delete;
+    loadgen_probe& operator=(const loadgen_probe&) = delete;
+
+    /**
+     * @brief Start measuring a cluster's events. The cluster must outlive
+     * the probe, or the probe must be destroyed first.
+     * @param bot cluster
+     */
+    void attach(dpp::cluster& bot);
+
+    /**
+     * @brief Measurements so far; also samples memory
+     */
+    loadgen_report report();
+
+    /**
+     * @brief Resident memory of this process in bytes, or zero if unknown
+     */
+    static uint64_t resident_memory();
+};
+
+}
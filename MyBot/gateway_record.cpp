@@ -0,0 +1,277 @@
+#include "gateway_record.h"
+#include "rest_request.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace mybot {
+
+namespace {
+
+constexpr char file_magic[8] = {'M', 'B', 'G', 'W', 'R', 'E', 'C', '1'};
+constexpr char tag_session = 'S';
+constexpr char tag_frame = 'F';
+
+void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+bool get_varint(std::istream& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) {
+            return false;
+        }
+        v |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Restores normal REST when a replay ends, however it ends */
+struct rest_stub_guard {
+    bool active;
+
+    explicit rest_stub_guard(bool stub) : active(stub) {
+        if (active) {
+            set_rest_stub([](const rest_request&) {
+                dpp::http_request_completion_t http;
+                http.status = 200;
+                http.body = "{}";
+                return http;
+            });
+        }
+    }
+
+    ~rest_stub_guard() {
+        if (active) {
+            set_rest_stub(nullptr);
+        }
+    }
+};
+
+}
+
+gateway_recorder::gateway_recorder(const std::string& file, size_t buffer_size) : buffer_bytes(std::max<size_t>(buffer_size, 4096)) {
+    std::ifstream existing(file, std::ios::binary | std::ios::ate);
+    bool empty = !existing || existing.tellg() <= 0;
+    existing.close();
+    out.open(file, std::ios::binary | std::ios::app);
+    if (!out) {
+        throw dpp::file_exception("gateway_recorder: can't open " + file);
+    }
+    buffer.reserve(buffer_bytes + 4096);
+    if (empty) {
+        buffer.append(file_magic, sizeof(file_magic));
+    }
+    started = last_flush = std::chrono::steady_clock::now();
+}
+
+gateway_recorder::~gateway_recorder() {
+    if (attached != nullptr) {
+        attached->on_log.detach(log_handle);
+    }
+    flush();
+}
+
+void gateway_recorder::attach(dpp::cluster& bot) {
+    attached = &bot;
+    log_handle = bot.on_log([this](const dpp::log_t& event) {
+        if (event.severity == dpp::ll_trace && event.message.size() > 3 && event.message.compare(0, 3, "R: ") == 0) {
+            write(event.from != nullptr ? event.from->shard_id : 0, std::string_view(event.message).substr(3));
+        }
+    });
+}
+
+void gateway_recorder::write(uint32_t shard, std::string_view payload) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - started).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (first) {
+        buffer += tag_session;
+        put_varint(buffer, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        first = false;
+    }
+    /* Frames from different shards can race here; never store a negative delta */
+    us = std::max(us, last_us);
+    buffer += tag_frame;
+    put_varint(buffer, us - last_us);
+    put_varint(buffer, shard);
+    put_varint(buffer, payload.size());
+    buffer.append(payload.data(), payload.size());
+    last_us = us;
+    frame_count++;
+    byte_count += payload.size();
+    if (buffer.size() >= buffer_bytes || now - last_flush >= std::chrono::seconds(1)) {
+        last_flush = now;
+        flush_locked();
+    }
+}
+
+void gateway_recorder::flush_locked() {
+    if (!buffer.empty()) {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.flush();
+        buffer.clear();
+    }
+}
+
+void gateway_recorder::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flush_locked();
+}
+
+uint64_t gateway_recorder::frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frame_count;
+}
+
+uint64_t gateway_recorder::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return byte_count;
+}
+
+gateway_reader::gateway_reader(const std::string& file) : in(file, std::ios::binary) {
+    char magic[sizeof(file_magic)] = {0};
+    if (!in || !in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), file_magic)) {
+        throw dpp::file_exception("gateway_reader: " + file + " is not a gateway recording");
+    }
+}
+
+bool gateway_reader::next(gateway_frame& frame) {
+    frame.session_start = false;
+    for (;;) {
+        int tag = in.get();
+        if (tag == tag_session) {
+            uint64_t wall_ms;
+            if (!get_varint(in, wall_ms)) {
+                return false;
+            }
+            session_us = 0;
+            frame.session_start = true;
+            continue;
+        }
+        if (tag != tag_frame) {
+            return false;
+        }
+        uint64_t delta, shard, length;
+        if (!get_varint(in, delta) || !get_varint(in, shard) || !get_varint(in, length)) {
+            return false;
+        }
+        frame.payload.resize(length);
+        if (!in.read(frame.payload.data(), static_cast<std::streamsize>(length))) {
+            return false;
+        }
+        session_us += delta;
+        frame.at_us = session_us;
+        frame.shard = static_cast<uint32_t>(shard);
+        return true;
+    }
+}
+
+gateway_replay::gateway_replay(dpp::cluster& cluster, const std::string& path, const replay_config& cfg) : bot(cluster), file(path), config(cfg) {
+}
+
+gateway_replay::~gateway_replay() {
+    stop();
+}
+
+replay_stats gateway_replay::run() {
+    gateway_reader reader(file);
+    const dpp::shard_list& shards = bot.get_shards();
+    if (shards.empty()) {
+        throw dpp::logic_exception("gateway_replay: the cluster has no shards; start it first");
+    }
+    rest_stub_guard stub(config.stub_rest);
+
+    replay_stats stats;
+    gateway_frame frame;
+    auto start = std::chrono::steady_clock::now();
+    /* Sessions are played back to back: each starts where the last one ended */
+    uint64_t session_offset_us = 0;
+    uint64_t last_at_us = 0;
+    while (!stopping && reader.next(frame)) {
+        if (frame.session_start) {
+            session_offset_us += last_at_us;
+        }
+        last_at_us = frame.at_us;
+        stats.frames++;
+        stats.bytes += frame.payload.size();
+
+        if (config.speed > 0) {
+            auto due = start + std::chrono::microseconds(static_cast<int64_t>((session_offset_us + frame.at_us) / config.speed));
+            auto now = std::chrono::steady_clock::now();
+            if (now < due) {
+                /* In slices, so that stop() is not kept waiting through a quiet spell */
+                while (!stopping && std::chrono::steady_clock::now() < due) {
+                    std::this_thread::sleep_until(std::min(due, std::chrono::steady_clock::now() + std::chrono::milliseconds(100)));
+                }
+            } else {
+                stats.max_behind_ms = std::max(stats.max_behind_ms, std::chrono::duration<double, std::milli>(now - due).count());
+            }
+        }
+
+        nlohmann::json j;
+        {
+            trace_span span("parse", "gateway");
+            j = nlohmann::json::parse(frame.payload, nullptr, false);
+        }
+        if (j.is_discarded() || !j.is_object() || j.value("op", -1) != 0 || !j.contains("t") || !j["t"].is_string()) {
+            stats.skipped++;
+            continue;
+        }
+        std::string event = j["t"].get<std::string>();
+        if (std::find(config.skip.begin(), config.skip.end(), event) != config.skip.end()) {
+            stats.skipped++;
+            continue;
+        }
+        uint32_t id = config.shard >= 0 ? static_cast<uint32_t>(config.shard) : frame.shard % static_cast<uint32_t>(shards.size());
+        auto it = shards.find(id);
+        dpp::discord_client* client = it != shards.end() ? it->second : shards.begin()->second;
+        try {
+            /* D++'s decode, cache update and listeners, and any REST calls they make */
+            trace_cause span("handle_event", "gateway", event);
+            client->handle_event(event, j, frame.payload);
+            stats.dispatched++;
+        }
+        catch (const std::exception& e) {
+            bot.log(dpp::ll_warning, "gateway_replay: " + event + " failed: " + e.what());
+            stats.skipped++;
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.events_per_second = stats.seconds > 0 ? stats.dispatched / stats.seconds : 0;
+    return stats;
+}
+
+void gateway_replay::start(replay_done_t done) {
+    stop();
+    stopping = false;
+    thread = std::thread([this, done = std::move(done)] {
+        replay_stats stats;
+        try {
+            stats = run();
+        }
+        catch (const std::exception& e) {
+            bot.log(dpp::ll_error, std::string("gateway_replay: ") + e.what());
+        }
+        if (done) {
+            done(stats);
+        }
+    });
+}
+
+void gateway_replay::stop() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+}
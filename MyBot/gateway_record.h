@@ -0,0 +1,272 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+namespace mybot {
+
+/**
+ * @brief One gateway frame read back from a recording
+ */
+struct gateway_frame {
+    /**
+     * @brief Shard which received the frame
+     */
+    uint32_t shard{0};
+
+    /**
+     * @brief When the frame arrived, in microseconds since the recording
+     * started. Each session appended to a file starts again from zero.
+     */
+    uint64_t at_us{0};
+
+    /**
+     * @brief True for the first frame of a recording session
+     */
+    bool session_start{false};
+
+    /**
+     * @brief Decompressed frame, usually JSON
+     */
+    std::string payload;
+};
+
+/**
+ * @brief Records every frame the cluster's shards receive, after
+ * decompression, to an append-only file.
+ *
+ * D++ 10.0 has no hook on the shard's websocket, but it logs each decompressed
+ * frame at ll_trace as "R: " followed by the payload; the recorder listens
+ * for those. Each frame is stored as a tag byte, then LEB128 varints for the
+ * microseconds since the previous frame, the shard and the length, then the
+ * payload, so the overhead is usually five bytes a frame. Starting a recorder
+ * on an existing file appends a new session.
+ *
+ * Writes are buffered and flushed every buffer_bytes or second, and on
+ * destruction. A crash loses at most the unflushed tail; the reader stops
+ * cleanly at a truncated frame.
+ */
+class gateway_recorder {
+    std::ofstream out;
+    std::string buffer;
+    size_t buffer_bytes;
+    mutable std::mutex mutex;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point last_flush;
+    uint64_t last_us{0};
+    bool first{true};
+    uint64_t frame_count{0};
+    uint64_t byte_count{0};
+    dpp::cluster* attached{nullptr};
+    dpp::event_handle log_handle{0};
+
+    void flush_locked();
+
+public:
+    /**
+     * @brief Open a recording file, creating it if needed
+     * @param file path
+     * @param buffer_size bytes to buffer before writing
+     * @throw dpp::file_exception if the file can't be opened
+     */
+    explicit gateway_recorder(const std::string& file, size_t buffer_size = 256 * 1024);
+
+    /**
+     * @brief Detach from the cluster and flush
+     */
+    ~gateway_recorder();
+
+    gateway_recorder(const gateway_recorder&) = delete;
+    gateway_recorder& operator=(const gateway_recorder&) = delete;
+
+    /**
+     * @brief Start recording a cluster's frames. The cluster must outlive
+     * the recorder, or the recorder must be destroyed first.
+     * @param bot cluster
+     */
+    void attach(dpp::cluster& bot);
+
+    /**
+     * @brief Record a frame
+     * @param shard shard id
+     * @param payload decompressed frame
+     */
+    void write(uint32_t shard, std::string_view payload);
+
+    /**
+     * @brief Write out anything buffered
+     */
+    void flush();
+
+    /**
+     * @brief Frames recorded
+     */
+    uint64_t frames() const;
+
+    /**
+     * @brief Payload bytes recorded
+     */
+    uint64_t bytes() const;
+};
+
+/**
+ * @brief Reads frames back from a recording
+ */
+class gateway_reader {
+    std::ifstream in;
+    uint64_t session_us{0};
+
+public:
+    /**
+     * @brief Open a recording
+     * @param file path
+     * @throw dpp::file_exception if the file can't be opened or is not a recording
+     */
+    explicit gateway_reader(const std::string& file);
+
+    /**
+     * @brief Read the next frame
+     * @param frame frame, overwritten
+     * @return false at the end of the file or at a truncated frame
+     */
+    bool next(gateway_frame& frame);
+};
+
+/**
+ * @brief How to replay a recording
+ */
+struct replay_config {
+    /**
+     * @brief Playback speed: 1 is real time, 10 is ten times faster, and
+     * zero is as fast as the bot can take them.
+     */
+    double speed{1};
+
+    /**
+     * @brief Answer the bot's own REST requests with a stub for the duration,
+     * see set_rest_stub()
+     */
+    bool stub_rest{true};
+
+    /**
+     * @brief Events not replayed. READY and RESUMED would overwrite the live
+     * shard's session.
+     */
+    std::vector<std::string> skip{"READY", "RESUMED"};
+
+    /**
+     * @brief Replay every frame on this shard; -1 to use the recorded shard
+     * (modulo the number of shards this cluster has)
+     */
+    int32_t shard{-1};
+};
+
+/**
+ * @brief Results of a replay
+ */
+struct replay_stats {
+    /**
+     * @brief Frames read
+     */
+    uint64_t frames{0};
+
+    /**
+     * @brief Events handed to D++
+     */
+    uint64_t dispatched{0};
+
+    /**
+     * @brief Frames not replayed: non-dispatch opcodes, skipped events and
+     * unparseable payloads
+     */
+    uint64_t skipped{0};
+
+    /**
+     * @brief Payload bytes read
+     */
+    uint64_t bytes{0};
+
+    /**
+     * @brief Wall time taken
+     */
+    double seconds{0};
+
+    /**
+     * @brief Events dispatched per second
+     */
+    double events_per_second{0};
+
+    /**
+     * @brief Furthest the replay fell behind its schedule; at speed zero,
+     * always zero
+     */
+    double max_behind_ms{0};
+};
+
+/**
+ * @brief Called when a replay has finished
+ */
+using replay_done_t = std::function<void(const replay_stats&)>;
+
+/**
+ * @brief Feeds a recording into a running cluster, as if its shards had
+ * received the frames.
+ *
+ * Dispatch frames (op 0) are parsed and passed to
+ * dpp::discord_client::handle_event() on a live shard, so they go through
+ * D++'s own decoding, cache updates and the bot's event handlers exactly as
+ * received traffic does. Other opcodes (hello, heartbeat ACKs, reconnects)
+ * are skipped; they would disturb the shard's real connection. D++ 10.0
+ * connects a shard as it is constructed, so there is no offline shard to
+ * replay into: the cluster must have been started.
+ *
+ * Replays are repeatable: the same file at speed zero presents the same events
+ * in the same order every time, giving an end-to-end throughput benchmark for
+ * cache and handler changes.
+ */
+class gateway_replay {
+    dpp::cluster& bot;
+    std::string file;
+    replay_config config;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+public:
+    /**
+     * @brief Prepare a replay
+     * @param cluster running cluster
+     * @param path recording
+     * @param cfg settings
+     */
+    gateway_replay(dpp::cluster& cluster, const std::string& path, const replay_config& cfg = {});
+
+    /**
+     * @brief Stop the replay if it is running, and wait for it
+     */
+    ~gateway_replay();
+
+    gateway_replay(const gateway_replay&) = delete;
+    gateway_replay& operator=(const gateway_replay&) = delete;
+
+    /**
+     * @brief Replay the whole file on this thread
+     * @return results
+     * @throw dpp::file_exception if the file can't be read
+     * @throw dpp::logic_exception if the cluster has no shards
+     */
+    replay_stats run();
+
+    /**
+     * @brief Replay on a new thread
+     * @param done called on that thread when the replay finishes or is stopped
+     */
+    void start(replay_done_t done = {});
+
+    /**
+     * @brief Stop a replay started with start(), and wait for it
+     */
+    void stop();
+};
+
+}
@@ -0,0 +1,193 @@
+#include "http_headers.h"
+#include <charconv>
+#include <cstring>
+#include <cstdlib>
+
+namespace mybot {
+
+namespace {
+
+constexpr std::array<std::string_view, known_header_count> known_names = {
+    "content-length",
+    "content-type",
+    "transfer-encoding",
+    "connection",
+    "retry-after",
+    "x-ratelimit-bucket",
+    "x-ratelimit-limit",
+    "x-ratelimit-remaining",
+    "x-ratelimit-reset",
+    "x-ratelimit-reset-after",
+    "x-ratelimit-global",
+    "x-ratelimit-scope",
+};
+
+char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+/* lower must already be lower case */
+bool equals_lower(std::string_view lower, std::string_view any) {
+    if (lower.size() != any.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lower.size(); ++i) {
+        if (lower[i] != ascii_lower(any[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+}
+
+std::string_view known_header_name(known_header h) {
+    return h < known_header_count ? known_names[h] : std::string_view();
+}
+
+flat_headers::flat_headers() {
+    known.fill(-1);
+}
+
+flat_headers::flat_headers(const std::multimap<std::string, std::string>& headers) : flat_headers() {
+    size_t bytes = 0;
+    for (const auto& [name, value] : headers) {
+        bytes += name.size() + value.size();
+    }
+    reserve(headers.size(), bytes);
+    for (const auto& [name, value] : headers) {
+        add(name, value);
+    }
+}
+
+flat_headers flat_headers::parse(std::string_view block) {
+    flat_headers h;
+    h.reserve(24, block.size());
+    while (!block.empty()) {
+        size_t eol = block.find('\n');
+        std::string_view line = block.substr(0, eol);
+        block = eol == std::string_view::npos ? std::string_view() : block.substr(eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            break;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            continue;
+        }
+        h.add(trim(line.substr(0, colon)), trim(line.substr(colon + 1)));
+    }
+    return h;
+}
+
+void flat_headers::reserve(size_t count, size_t bytes) {
+    entries.reserve(count);
+    storage.reserve(bytes);
+}
+
+void flat_headers::add(std::string_view name, std::string_view value) {
+    entry e;
+    e.name_at = static_cast<uint32_t>(storage.size());
+    e.name_len = static_cast<uint32_t>(name.size());
+    for (char c : name) {
+        storage += ascii_lower(c);
+    }
+    e.value_at = static_cast<uint32_t>(storage.size());
+    e.value_len = static_cast<uint32_t>(value.size());
+    storage.append(value.data(), value.size());
+
+    std::string_view lower(storage.data() + e.name_at, e.name_len);
+    for (size_t k = 0; k < known_header_count; ++k) {
+        if (known[k] < 0 && known_names[k] == lower) {
+            known[k] = static_cast<int16_t>(entries.size());
+            break;
+        }
+    }
+    entries.push_back(e);
+}
+
+void flat_headers::clear() {
+    storage.clear();
+    entries.clear();
+    known.fill(-1);
+}
+
+std::string_view flat_headers::get(std::string_view name) const {
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (equals_lower(this->name(i), name)) {
+            return value(i);
+        }
+    }
+    return {};
+}
+
+std::string_view flat_headers::get(known_header h) const {
+    return has(h) ? value(static_cast<size_t>(known[h])) : std::string_view();
+}
+
+bool flat_headers::has(known_header h) const {
+    return h < known_header_count && known[h] >= 0;
+}
+
+uint64_t flat_headers::get_uint(known_header h, uint64_t fallback) const {
+    std::string_view v = get(h);
+    uint64_t out = 0;
+    auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), out);
+    return (v.empty() || ec != std::errc()) ? fallback : out;
+}
+
+double flat_headers::get_seconds(known_header h, double fallback) const {
+    std::string_view v = get(h);
+    if (v.empty() || v.size() > 63) {
+        return fallback;
+    }
+    /* Header values are short; copy so strtod has a terminator */
+    char buffer[64];
+    memcpy(buffer, v.data(), v.size());
+    buffer[v.size()] = 0;
+    char* end = nullptr;
+    double out = std::strtod(buffer, &end);
+    return end == buffer ? fallback : out;
+}
+
+size_t flat_headers::count(std::string_view name) const {
+    size_t n = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        n += equals_lower(this->name(i), name) ? 1 : 0;
+    }
+    return n;
+}
+
+size_t flat_headers::size() const {
+    return entries.size();
+}
+
+std::string_view flat_headers::name(size_t i) const {
+    return std::string_view(storage.data() + entries[i].name_at, entries[i].name_len);
+}
+
+std::string_view flat_headers::value(size_t i) const {
+    return std::string_view(storage.data() + entries[i].value_at, entries[i].value_len);
+}
+
+std::multimap<std::string, std::string> flat_headers::to_multimap() const {
+    std::multimap<std::string, std::string> out;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        out.emplace(std::string(name(i)), std::string(value(i)));
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <array>
+#include <string_view>
+
+namespace mybot {
+
+/**
+ * @brief Headers read on every response, which flat_headers can find
+ * without searching
+ */
+enum known_header : uint8_t {
+    hdr_content_length,
+    hdr_content_type,
+    hdr_transfer_encoding,
+    hdr_connection,
+    hdr_retry_after,
+    hdr_ratelimit_bucket,
+    hdr_ratelimit_limit,
+    hdr_ratelimit_remaining,
+    hdr_ratelimit_reset,
+    hdr_ratelimit_reset_after,
+    hdr_ratelimit_global,
+    hdr_ratelimit_scope,
+    known_header_count
+};
+
+/**
+ * @brief Lower case name of a known header, e.g. "x-ratelimit-remaining"
+ * @param h header
+ */
+std::string_view known_header_name(known_header h);
+
+/**
+ * @brief A set of HTTP headers in one contiguous buffer.
+ *
+ * Names are stored lower case and values as received, back to back in a
+ * single string, with a small table of offsets into it. Lookups return
+ * string_views into the buffer and compare case-insensitively without
+ * making a lower case copy of the name asked for. The position of each
+ * known_header is recorded as it is added, so reading the rate limit
+ * headers of a response is an array index rather than a search.
+ *
+ * Moving a flat_headers moves two buffers; copy it only if you mean to.
+ */
+class flat_headers {
+    struct entry {
+        uint32_t name_at;
+        uint32_t name_len;
+        uint32_t value_at;
+        uint32_t value_len;
+    };
+
+    std::string storage;
+    std::vector<entry> entries;
+    std::array<int16_t, known_header_count> known;
+
+public:
+    flat_headers();
+
+    flat_headers(flat_headers&&) noexcept = default;
+    flat_headers& operator=(flat_headers&&) noexcept = default;
+    flat_headers(const flat_headers&) = default;
+    flat_headers& operator=(const flat_headers&) = default;
+
+    /**
+     * @brief Build from the header multimap D++ returns, sizing the buffer once
+     * @param headers headers
+     */
+    explicit flat_headers(const std::multimap<std::string, std::string>& headers);
+
+    /**
+     * @brief Parse a raw header block: "Name: value" lines separated by CRLF
+     * (or bare LF), without the status line. Parsing stops at an empty line.
+     * @param block header block
+     * @return headers
+     */
+    static flat_headers parse(std::string_view block);
+
+    /**
+     * @brief Reserve space ahead of adding headers
+     * @param count number of headers
+     * @param bytes total length of names and values
+     */
+    void reserve(size_t count, size_t bytes);
+
+    /**
+     * @brief Add a header. Duplicates are kept; a known header keeps
+     * the first value added.
+     * @param name name, any case
+     * @param value value
+     */
+    void add(std::string_view name, std::string_view value);
+
+    /**
+     * @brief Remove every header, keeping the allocated space
+     */
+    void clear();
+
+    /**
+     * @brief Get a header by name, case-insensitively
+     * @param name name
+     * @return first value, or an empty view if not present
+     */
+    std::string_view get(std::string_view name) const;
+
+    /**
+     * @brief Get a known header without searching
+     * @param h header
+     * @return first value, or an empty view if not present
+     */
+    std::string_view get(known_header h) const;
+
+    /**
+     * @brief True if a known header is present
+     * @param h header
+     */
+    bool has(known_header h) const;
+
+    /**
+     * @brief Read a known header as an unsigned integer
+     * @param h header
+     * @param fallback returned if absent or not a number
+     */
+    uint64_t get_uint(known_header h, uint64_t fallback = 0) const;
+
+    /**
+     * @brief Read a known header as a number of seconds, which Discord
+     * sends with a fractional part (e.g. x-ratelimit-reset-after: 1.234)
+     * @param h header
+     * @param fallback returned if absent or not a number
+     */
+    double get_seconds(known_header h, double fallback = 0) const;
+
+    /**
+     * @brief Number of headers with this name
+     * @param name name, any case
+     */
+    size_t count(std::string_view name) const;
+
+    /**
+     * @brief Number of headers
+     */
+    size_t size() const;
+
+    /**
+     * @brief Name of the i-th header, lower case
+     */
+    std::string_view name(size_t i) const;
+
+    /**
+     * @brief Value of the i-th header
+     */
+    std::string_view value(size_t i) const;
+
+    /**
+     * @brief Convert back to a multimap, for code expecting the D++ form
+     */
+    std::multimap<std::string, std::string> to_multimap() const;
+};
+
+}
@@ -0,0 +1,215 @@
+#include "io_loop.h"
+#include <algorithm>
+
+namespace mybot {
+
+io_loop::io_loop() {
+    net_init();
+    /* The loop wakes itself by sending a datagram to its own loopback socket,
+     * which works the same on Windows (where pipes can't be polled) and POSIX.
+     */
+    wake_fd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake_fd == INVALID_SOCKET) {
+        throw dpp::connection_exception("io_loop: can't create wake socket");
+    }
+    ip_address::parse("127.0.0.1", 0, wake_addr);
+    if (::bind(wake_fd, reinterpret_cast<sockaddr*>(&wake_addr.addr), wake_addr.len) != 0 ||
+        getsockname(wake_fd, reinterpret_cast<sockaddr*>(&wake_addr.addr), &wake_addr.len) != 0) {
+        close_socket(wake_fd);
+        throw dpp::connection_exception("io_loop: can't bind wake socket");
+    }
+    set_nonblocking(wake_fd);
+    thread = std::thread([this] { run(); });
+}
+
+io_loop::~io_loop() {
+    terminating = true;
+    wake();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close_socket(wake_fd);
+}
+
+void io_loop::wake() {
+    char b = 0;
+    ::sendto(wake_fd, &b, 1, 0, reinterpret_cast<sockaddr*>(&wake_addr.addr), wake_addr.len);
+}
+
+bool io_loop::add(const io_events& e) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!sockets.emplace(e.fd, e).second) {
+            return false;
+        }
+    }
+    wake();
+    return true;
+}
+
+bool io_loop::set_flags(dpp::socket fd, uint8_t flags) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sockets.find(fd);
+        if (it == sockets.end()) {
+            return false;
+        }
+        it->second.flags = flags;
+    }
+    if (!in_loop_thread()) {
+        wake();
+    }
+    return true;
+}
+
+void io_loop::remove(dpp::socket fd) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sockets.erase(fd);
+}
+
+io_timer io_loop::after(std::chrono::milliseconds delay, std::function<void()> fn) {
+    io_timer id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = next_timer++;
+        timers.emplace(id, std::move(fn));
+        timer_queue.emplace(std::chrono::steady_clock::now() + delay, id);
+    }
+    if (!in_loop_thread()) {
+        wake();
+    }
+    return id;
+}
+
+bool io_loop::cancel(io_timer t) {
+    std::lock_guard<std::mutex> lock(mutex);
+    /* The entry in timer_queue is skipped when it comes due */
+    return timers.erase(t) > 0;
+}
+
+void io_loop::post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.emplace_back(std::move(fn));
+    }
+    if (!in_loop_thread()) {
+        wake();
+    }
+}
+
+bool io_loop::in_loop_thread() const {
+    return std::this_thread::get_id() == loop_id.load();
+}
+
+size_t io_loop::socket_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sockets.size();
+}
+
+void io_loop::run_timers() {
+    std::vector<std::function<void()>> due;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        while (!timer_queue.empty() && timer_queue.begin()->first <= now) {
+            auto it = timers.find(timer_queue.begin()->second);
+            if (it != timers.end()) {
+                due.emplace_back(std::move(it->second));
+                timers.erase(it);
+            }
+            timer_queue.erase(timer_queue.begin());
+        }
+    }
+    for (auto& fn : due) {
+        fn();
+    }
+}
+
+void io_loop::run() {
+    loop_id = std::this_thread::get_id();
+    std::vector<pollfd> pfds;
+    while (!terminating) {
+        int timeout = 1000;
+        pfds.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pollfd wake_pfd{};
+            wake_pfd.fd = wake_fd;
+            wake_pfd.events = POLLIN;
+            pfds.push_back(wake_pfd);
+            for (const auto& [fd, e] : sockets) {
+                pollfd p{};
+                p.fd = fd;
+                p.events = static_cast<short>(((e.flags & WANT_READ) ? POLLIN : 0) | ((e.flags & WANT_WRITE) ? POLLOUT : 0));
+                pfds.push_back(p);
+            }
+            if (!posted.empty()) {
+                timeout = 0;
+            } else if (!timer_queue.empty()) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(timer_queue.begin()->first - std::chrono::steady_clock::now()).count();
+                timeout = static_cast<int>(std::clamp<long long>(wait, 0, timeout));
+            }
+        }
+
+        int ready = net_poll(pfds.data(), pfds.size(), timeout);
+        for (size_t i = 0; ready > 0 && i < pfds.size(); ++i) {
+            const pollfd& p = pfds[i];
+            if (p.revents == 0) {
+                continue;
+            }
+            if (p.fd == wake_fd) {
+                char drain[64];
+                while (::recv(wake_fd, drain, sizeof(drain), 0) > 0) {
+                }
+                continue;
+            }
+            io_events e;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = sockets.find(p.fd);
+                if (it == sockets.end()) {
+                    continue;
+                }
+                e = it->second;
+                if (p.revents & POLLOUT) {
+                    it->second.flags &= ~WANT_WRITE;
+                }
+            }
+            if ((p.revents & (POLLERR | POLLNVAL)) || ((p.revents & POLLHUP) && !(p.revents & POLLIN))) {
+                int err = 0;
+                socklen len = sizeof(err);
+                getsockopt(p.fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len);
+                if (e.on_error) {
+                    e.on_error(p.fd, err);
+                }
+                continue;
+            }
+            if ((p.revents & POLLIN) && e.on_read) {
+                e.on_read(p.fd);
+            }
+            if ((p.revents & POLLOUT) && e.on_write) {
+                bool still_registered;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    still_registered = sockets.count(p.fd) > 0;
+                }
+                if (still_registered) {
+                    e.on_write(p.fd);
+                }
+            }
+        }
+
+        run_timers();
+
+        std::vector<std::function<void()>> work;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            work.swap(posted);
+        }
+        for (auto& fn : work) {
+            fn();
+        }
+    }
+}
+
+}
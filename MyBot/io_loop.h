@@ -0,0 +1,181 @@
+#pragma once
+#include "net.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mybot {
+
+/**
+ * @brief Types of IO event a socket may subscribe to. These have the same
+ * names and values as dpp::socket_event_flags in newer D++ releases.
+ */
+enum io_event_flags : uint8_t {
+    /**
+     * @brief Socket wants to be told when it can be read from
+     */
+    WANT_READ = 1,
+
+    /**
+     * @brief Socket wants to be told when it can be written to. One-off;
+     * request it again each time you have more to send.
+     */
+    WANT_WRITE = 2,
+
+    /**
+     * @brief Socket wants error events. Errors are always reported, so this is
+     * accepted for compatibility and otherwise ignored.
+     */
+    WANT_ERROR = 4,
+};
+
+/**
+ * @brief Read ready callback
+ */
+using io_read_event = std::function<void(dpp::socket fd)>;
+
+/**
+ * @brief Write ready callback
+ */
+using io_write_event = std::function<void(dpp::socket fd)>;
+
+/**
+ * @brief Error callback, with the socket error code
+ */
+using io_error_event = std::function<void(dpp::socket fd, int error_code)>;
+
+/**
+ * @brief A socket registered with an io_loop, and the events it wants
+ */
+struct io_events {
+    /**
+     * @brief Socket
+     */
+    dpp::socket fd{INVALID_SOCKET};
+
+    /**
+     * @brief Bit mask of io_event_flags.
+     * WANT_WRITE is one-off and is cleared when the write event fires;
+     * request it again if you still have data to send.
+     */
+    uint8_t flags{0};
+
+    /**
+     * @brief Called when the socket can be read
+     */
+    io_read_event on_read{};
+
+    /**
+     * @brief Called when the socket can be written
+     */
+    io_write_event on_write{};
+
+    /**
+     * @brief Called when the socket is in error
+     */
+    io_error_event on_error{};
+};
+
+/**
+ * @brief Identifies a timer added with io_loop::after()
+ */
+using io_timer = uint64_t;
+
+/**
+ * @brief A small poll() based reactor with timers, running on its own thread.
+ *
+ * The D++ build this template ships against does not export its socket engine,
+ * so bot-side networking (DNS lookups, the metrics listener, local stand-in
+ * servers) runs here instead. All callbacks run on the loop thread; keep them
+ * short and hand real work to another thread.
+ */
+class io_loop {
+    std::thread thread;
+    std::atomic<bool> terminating{false};
+    mutable std::mutex mutex;
+    std::unordered_map<dpp::socket, io_events> sockets;
+    std::multimap<std::chrono::steady_clock::time_point, io_timer> timer_queue;
+    std::unordered_map<io_timer, std::function<void()>> timers;
+    std::vector<std::function<void()>> posted;
+    io_timer next_timer{1};
+    dpp::socket wake_fd{INVALID_SOCKET};
+    ip_address wake_addr;
+    std::atomic<std::thread::id> loop_id{};
+
+    void run();
+    void wake();
+    void run_timers();
+
+public:
+    /**
+     * @brief Create the loop and start its thread
+     */
+    io_loop();
+
+    /**
+     * @brief Stop the loop and join its thread. Registered sockets are not closed.
+     */
+    ~io_loop();
+
+    io_loop(const io_loop&) = delete;
+    io_loop& operator=(const io_loop&) = delete;
+
+    /**
+     * @brief Register a socket. The socket should be non-blocking.
+     * @param e events
+     * @return false if the socket was already registered
+     */
+    bool add(const io_events& e);
+
+    /**
+     * @brief Change the flags of a registered socket
+     * @param fd socket
+     * @param flags new flags
+     * @return false if the socket is not registered
+     */
+    bool set_flags(dpp::socket fd, uint8_t flags);
+
+    /**
+     * @brief Stop watching a socket. It is not closed.
+     * @param fd socket
+     */
+    void remove(dpp::socket fd);
+
+    /**
+     * @brief Run a function on the loop thread after a delay
+     * @param delay delay
+     * @param fn function to run
+     * @return timer id, for cancel()
+     */
+    io_timer after(std::chrono::milliseconds delay, std::function<void()> fn);
+
+    /**
+     * @brief Cancel a timer which has not yet fired
+     * @param t timer id
+     * @return true if the timer was cancelled
+     */
+    bool cancel(io_timer t);
+
+    /**
+     * @brief Run a function on the loop thread as soon as possible
+     * @param fn function to run
+     */
+    void post(std::function<void()> fn);
+
+    /**
+     * @brief Returns true if called from the loop thread
+     */
+    bool in_loop_thread() const;
+
+    /**
+     * @brief Number of registered sockets
+     */
+    size_t socket_count() const;
+};
+
+}
@@ -0,0 +1,27 @@
+#include "keyed_collector.h"
+
+namespace mybot {
+
+reaction_record::reaction_record(const dpp::message_reaction_add_t& event)
+    : message_id(event.message_id), channel_id(event.channel_id), user_id(event.reacting_user.id),
+      emoji_id(event.reacting_emoji.id), emoji_name(event.reacting_emoji.name) {
+    guild_id = event.reacting_guild != nullptr ? event.reacting_guild->id : event.reacting_member.guild_id;
+}
+
+reaction_collectors::reaction_collectors(dpp::cluster& bot)
+    : keyed_collectors(bot, bot.on_message_reaction_add, [](const dpp::message_reaction_add_t& event) {
+        return event.message_id;
+    }, [](const dpp::message_reaction_add_t& event) {
+        return reaction_record(event);
+    }) {
+}
+
+message_collectors::message_collectors(dpp::cluster& bot)
+    : keyed_collectors(bot, bot.on_message_create, [](const dpp::message_create_t& event) {
+        return event.msg.channel_id;
+    }, [](const dpp::message_create_t& event) {
+        return compact_message(event.msg);
+    }) {
+}
+
+}
@@ -0,0 +1,362 @@
+#pragma once
+#include "compact_types.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace mybot {
+
+/**
+ * @brief Why a keyed collector finished
+ */
+enum collector_end {
+    /**
+     * @brief It kept complete_at records
+     */
+    collector_filled,
+
+    /**
+     * @brief Its duration ran out
+     */
+    collector_expired,
+
+    /**
+     * @brief It was cancelled, or its keyed_collectors destroyed
+     */
+    collector_cancelled,
+};
+
+/**
+ * @brief Settings for one keyed collector
+ */
+struct collector_options {
+    /**
+     * @brief How long to collect for, in seconds. D++ 10.0 ticks timers once
+     * a second, so collectors end up to a second late.
+     */
+    uint64_t duration{60};
+
+    /**
+     * @brief Records kept at most; any after that are only counted
+     */
+    size_t capacity{100};
+
+    /**
+     * @brief Finish as soon as this many records are kept, or zero to run for
+     * the whole duration. Values above capacity are treated as capacity.
+     */
+    size_t complete_at{0};
+};
+
+/**
+ * @brief What a keyed collector gathered
+ * @tparam Record record type
+ */
+template<typename Record> struct collected {
+    /**
+     * @brief Key collected for, e.g. a message id
+     */
+    dpp::snowflake key;
+
+    /**
+     * @brief Records kept, in the order their events arrived
+     */
+    std::vector<Record> records;
+
+    /**
+     * @brief Records which matched after capacity was reached
+     */
+    size_t dropped{0};
+
+    /**
+     * @brief Why it finished
+     */
+    collector_end end{collector_expired};
+};
+
+/**
+ * @brief Collectors for one event, indexed by a key such as a message or
+ * channel id.
+ *
+ * A dpp::collector attaches its own listener to the event router, so every
+ * event runs every collector's filter, and keeps a full copy of each object
+ * in an unbounded vector. Here one listener serves every collector: it looks
+ * up the event's key, and only if something is collecting for it builds one
+ * compact record, which the collectors for that key filter and keep up to
+ * their capacity. A collector finishes when it has complete_at records, when
+ * its duration runs out, or when cancelled, calling its callback once.
+ *
+ * Callbacks and filters run on the shard thread that delivered the event, or
+ * for expiry on the timer's, without any lock held.
+ * @tparam Event event type, e.g. dpp::message_reaction_add_t
+ * @tparam Record record kept per event
+ */
+template<typename Event, typename Record> class keyed_collectors {
+public:
+    /**
+     * @brief Returns the key of an event
+     */
+    using key_t = std::function<dpp::snowflake(const Event&)>;
+
+    /**
+     * @brief Builds the record for an event
+     */
+    using extract_t = std::function<Record(const Event&)>;
+
+    /**
+     * @brief Returns true to keep a record
+     */
+    using accept_t = std::function<bool(const Record&)>;
+
+    /**
+     * @brief Receives what a collector gathered
+     */
+    using completed_t = std::function<void(collected<Record>&&)>;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        uint64_t id{0};
+        collector_options options;
+        accept_t accept;
+        completed_t on_completed;
+        typename std::multimap<clock::time_point, uint64_t>::iterator deadline;
+        collected<Record> result;
+        bool done{false};
+    };
+
+    /* Shared with the listener and timer, which may still be running on a
+     * shard thread while the keyed_collectors is destroyed
+     */
+    struct state {
+        std::mutex mutex;
+        key_t key;
+        extract_t extract;
+        std::unordered_map<dpp::snowflake, std::vector<std::shared_ptr<entry>>> by_key;
+        std::unordered_map<uint64_t, std::shared_ptr<entry>> by_id;
+        std::multimap<clock::time_point, uint64_t> by_deadline;
+        uint64_t next_id{1};
+
+        /* Under the lock; the caller runs the callback afterwards */
+        void finish(const std::shared_ptr<entry>& e, collector_end end) {
+            e->done = true;
+            e->result.end = end;
+            by_deadline.erase(e->deadline);
+            by_id.erase(e->id);
+            auto list = by_key.find(e->result.key);
+            if (list != by_key.end()) {
+                auto& entries = list->second;
+                entries.erase(std::remove(entries.begin(), entries.end(), e), entries.end());
+                if (entries.empty()) {
+                    by_key.erase(list);
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<state> shared;
+    dpp::cluster* owner;
+    dpp::event_router_t<Event>* router;
+    dpp::event_handle handle{0};
+    dpp::timer ticker{0};
+
+    static void complete(std::vector<std::shared_ptr<entry>>& finished) {
+        for (auto& e : finished) {
+            if (e->on_completed) {
+                e->on_completed(std::move(e->result));
+            }
+        }
+    }
+
+    static void on_event(state& s, const Event& event) {
+        dpp::snowflake key = s.key(event);
+        std::vector<std::shared_ptr<entry>> entries;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto list = s.by_key.find(key);
+            if (list == s.by_key.end()) {
+                return;
+            }
+            entries = list->second;
+        }
+        Record record = s.extract(event);
+        std::vector<std::shared_ptr<entry>> finished;
+        for (auto& e : entries) {
+            if (e->accept && !e->accept(record)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (e->done) {
+                continue;
+            }
+            if (e->result.records.size() < e->options.capacity) {
+                e->result.records.push_back(record);
+            } else {
+                e->result.dropped++;
+            }
+            if (e->options.complete_at > 0 && e->result.records.size() >= e->options.complete_at) {
+                s.finish(e, collector_filled);
+                finished.push_back(e);
+            }
+        }
+        complete(finished);
+    }
+
+    static void on_tick(state& s) {
+        std::vector<std::shared_ptr<entry>> finished;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto now = clock::now();
+            while (!s.by_deadline.empty() && s.by_deadline.begin()->first <= now) {
+                std::shared_ptr<entry> e = s.by_id.at(s.by_deadline.begin()->second);
+                s.finish(e, collector_expired);
+                finished.push_back(e);
+            }
+        }
+        complete(finished);
+    }
+
+public:
+    /**
+     * @brief Attach to an event
+     * @param bot cluster, for the expiry timer
+     * @param event event to attach to, e.g. bot.on_message_reaction_add
+     * @param key returns an event's key
+     * @param extract builds an event's record
+     */
+    keyed_collectors(dpp::cluster& bot, dpp::event_router_t<Event>& event, key_t key, extract_t extract)
+        : shared(std::make_shared<state>()), owner(&bot), router(&event) {
+        shared->key = std::move(key);
+        shared->extract = std::move(extract);
+        handle = event([s = shared](const Event& e) {
+            on_event(*s, e);
+        });
+        ticker = bot.start_timer([s = shared](dpp::timer) {
+            on_tick(*s);
+        }, 1);
+    }
+
+    /**
+     * @brief Detach, finishing any collectors still running as cancelled
+     */
+    ~keyed_collectors() {
+        router->detach(handle);
+        owner->stop_timer(ticker);
+        std::vector<std::shared_ptr<entry>> finished;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            while (!shared->by_id.empty()) {
+                std::shared_ptr<entry> e = shared->by_id.begin()->second;
+                shared->finish(e, collector_cancelled);
+                finished.push_back(e);
+            }
+        }
+        complete(finished);
+    }
+
+    keyed_collectors(const keyed_collectors&) = delete;
+    keyed_collectors& operator=(const keyed_collectors&) = delete;
+
+    /**
+     * @brief Start collecting for a key
+     * @param key key, e.g. the id of a poll message
+     * @param options duration, capacity and early completion
+     * @param on_completed called once when the collector finishes
+     * @param accept returns true for records to keep, or empty to keep all
+     * @return collector id, for cancel()
+     */
+    uint64_t collect(dpp::snowflake key, const collector_options& options, completed_t on_completed, accept_t accept = {}) {
+        auto e = std::make_shared<entry>();
+        e->options = options;
+        /* Only capacity records are ever kept, so more could never be reached */
+        e->options.complete_at = std::min(options.complete_at, options.capacity);
+        e->accept = std::move(accept);
+        e->on_completed = std::move(on_completed);
+        e->result.key = key;
+        e->result.records.reserve(std::min<size_t>(options.capacity, 16));
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        e->id = shared->next_id++;
+        e->deadline = shared->by_deadline.emplace(clock::now() + std::chrono::seconds(options.duration), e->id);
+        shared->by_id.emplace(e->id, e);
+        shared->by_key[key].push_back(e);
+        return e->id;
+    }
+
+    /**
+     * @brief Finish a collector now, calling its callback with what it has
+     * @param id collector id
+     * @return false if it had already finished
+     */
+    bool cancel(uint64_t id) {
+        std::vector<std::shared_ptr<entry>> finished;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            auto e = shared->by_id.find(id);
+            if (e == shared->by_id.end()) {
+                return false;
+            }
+            finished.push_back(e->second);
+            shared->finish(finished.back(), collector_cancelled);
+        }
+        complete(finished);
+        return true;
+    }
+
+    /**
+     * @brief Collectors running
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->by_id.size();
+    }
+};
+
+/**
+ * @brief A reaction as a collector keeps it, rather than the guild, member,
+ * user and channel copies dpp::collected_reaction takes
+ */
+struct reaction_record {
+    dpp::snowflake message_id;
+    dpp::snowflake channel_id;
+    dpp::snowflake guild_id;
+    dpp::snowflake user_id;
+    dpp::snowflake emoji_id;
+    std::string emoji_name;
+
+    reaction_record() = default;
+
+    /**
+     * @brief Build from a reaction event
+     * @param event event to copy from
+     */
+    explicit reaction_record(const dpp::message_reaction_add_t& event);
+};
+
+/**
+ * @brief Reaction collectors keyed by message id, e.g. for polls
+ */
+class reaction_collectors : public keyed_collectors<dpp::message_reaction_add_t, reaction_record> {
+public:
+    /**
+     * @brief Attach to the cluster's reaction add event
+     * @param bot cluster
+     */
+    explicit reaction_collectors(dpp::cluster& bot);
+};
+
+/**
+ * @brief Message collectors keyed by channel id
+ */
+class message_collectors : public keyed_collectors<dpp::message_create_t, compact_message> {
+public:
+    /**
+     * @brief Attach to the cluster's message create event
+     * @param bot cluster
+     */
+    explicit message_collectors(dpp::cluster& bot);
+};
+
+}
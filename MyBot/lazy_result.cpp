@@ -0,0 +1,97 @@
+#include "lazy_result.h"
+#include "trace.h"
+
+namespace mybot {
+
+rest_copy_counters& rest_copies() {
+    static rest_copy_counters counters;
+    return counters;
+}
+
+lazy_result::lazy_result(const decode_context& ctx, nlohmann::json& j, const dpp::http_request_completion_t& http)
+    : body(std::move(j)), context(ctx), headers(http.headers)
+{
+    /* Copy everything except the body, which we already hold in parsed form,
+     * and the header multimap, which is flattened into headers above.
+     * On error the body is tiny and get_error() needs it, so keep it then.
+     */
+    http_info.status = http.status;
+    http_info.error = http.error;
+    http_info.ratelimit_bucket = http.ratelimit_bucket;
+    http_info.ratelimit_limit = http.ratelimit_limit;
+    http_info.ratelimit_remaining = http.ratelimit_remaining;
+    http_info.ratelimit_reset_after = http.ratelimit_reset_after;
+    http_info.ratelimit_retry_after = http.ratelimit_retry_after;
+    http_info.ratelimit_global = http.ratelimit_global;
+    http_info.latency = http.latency;
+    rest_copies().results++;
+    rest_copies().body_bytes_received += http.body.size();
+    if (is_error()) {
+        http_info.body = http.body;
+        rest_copies().body_copies++;
+        rest_copies().body_bytes_copied += http.body.size();
+    }
+}
+
+lazy_result::lazy_result(lazy_result&& other)
+    : body(std::move(other.body)), decoded(std::move(other.decoded)), context(other.context), http_info(std::move(other.http_info)), headers(std::move(other.headers))
+{
+    rest_copies().moves++;
+}
+
+lazy_result& lazy_result::operator=(lazy_result&& other) {
+    body = std::move(other.body);
+    decoded = std::move(other.decoded);
+    context = other.context;
+    http_info = std::move(other.http_info);
+    headers = std::move(other.headers);
+    rest_copies().moves++;
+    return *this;
+}
+
+bool lazy_result::is_error() const {
+    if (http_info.error != dpp::h_success || http_info.status == 0 || http_info.status >= 400) {
+        return true;
+    }
+    /* Same test as dpp::confirmation_callback_t::is_error(), on the body we already parsed */
+    return body.is_object() && body.contains("code") && body.contains("errors");
+}
+
+dpp::error_info lazy_result::get_error() const {
+    return dpp::confirmation_callback_t(http_info).get_error();
+}
+
+const nlohmann::json& lazy_result::get_json() const {
+    return body;
+}
+
+nlohmann::json lazy_result::take_json() {
+    return std::move(body);
+}
+
+void lazy_rest(dpp::cluster& bot, const std::string& endpoint, const std::string& major_parameters, const std::string& parameters, dpp::http_method method, const std::string& postdata, lazy_completion_t callback, dpp::snowflake guild_id) {
+    decode_context ctx{&bot, guild_id};
+    if (tracing_enabled()) {
+        /* Traced like pooled requests; see lazy_rest(cluster&, rest_request_ptr) */
+        uint64_t cause = trace_current_cause();
+        uint64_t flow = trace_flow_begin();
+        int64_t started = trace_now_us();
+        std::string route = endpoint.substr(endpoint.rfind('/') + 1) + "/" + major_parameters;
+        bot.post_rest(endpoint, major_parameters, parameters, method, postdata, [ctx, cause, flow, started, route, callback = std::move(callback)](nlohmann::json& j, const dpp::http_request_completion_t& http) {
+            trace_async("rest", "rest", started, trace_now_us(), route, cause, http.status);
+            trace_cause span("rest_callback", "rest", route, cause);
+            span.set_flow_in(flow);
+            if (callback) {
+                callback(lazy_result(ctx, j, http));
+            }
+        });
+        return;
+    }
+    bot.post_rest(endpoint, major_parameters, parameters, method, postdata, [ctx, callback = std::move(callback)](nlohmann::json& j, const dpp::http_request_completion_t& http) {
+        if (callback) {
+            callback(lazy_result(ctx, j, http));
+        }
+    });
+}
+
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include <dpp/dpp.h>
+#include "fast_parse.h"
+#include "http_headers.h"
+#include <any>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+namespace mybot {
+
+/**
+ * @brief Context needed to decode some REST objects which do not carry
+ * everything they need in their own JSON (e.g. guild members do not
+ * include the guild id).
+ */
+struct decode_context {
+    /**
+     * @brief Owning cluster, passed on to objects which keep an owner pointer
+     */
+    dpp::cluster* owner{nullptr};
+
+    /**
+     * @brief Guild the request was made against, if any
+     */
+    dpp::snowflake guild_id;
+};
+
+/**
+ * @brief How to build, fill and key a single REST object of type T.
+ * The default works for any json_interface type with an `id` member.
+ * Specialise this for types which need something different.
+ * @tparam T object type
+ */
+template<typename T> struct rest_traits {
+    static T make(const decode_context&) {
+        return T();
+    }
+    static void fill(T& obj, nlohmann::json& j, const decode_context&) {
+        obj.fill_from_json(&j);
+    }
+    static dpp::snowflake key(const T& obj) {
+        return obj.id;
+    }
+};
+
+template<> struct rest_traits<dpp::guild_member> {
+    static dpp::guild_member make(const decode_context&) {
+        return dpp::guild_member();
+    }
+    static void fill(dpp::guild_member& obj, nlohmann::json& j, const decode_context& ctx) {
+        auto user = j.find("user");
+        dpp::snowflake user_id = user != j.end() ? json_snowflake(*user, "id") : dpp::snowflake();
+        obj.fill_from_json(&j, ctx.guild_id, user_id);
+    }
+    static dpp::snowflake key(const dpp::guild_member& obj) {
+        return obj.user_id;
+    }
+};
+
+template<> struct rest_traits<dpp::ban> {
+    static dpp::ban make(const decode_context&) {
+        return dpp::ban();
+    }
+    static void fill(dpp::ban& obj, nlohmann::json& j, const decode_context&) {
+        obj.fill_from_json(&j);
+    }
+    static dpp::snowflake key(const dpp::ban& obj) {
+        return obj.user_id;
+    }
+};
+
+template<> struct rest_traits<dpp::message> {
+    static dpp::message make(const decode_context& ctx) {
+        return dpp::message(ctx.owner);
+    }
+    static void fill(dpp::message& obj, nlohmann::json& j, const decode_context&) {
+        obj.fill_from_json(&j);
+    }
+    static dpp::snowflake key(const dpp::message& obj) {
+        return obj.id;
+    }
+};
+
+/**
+ * @brief Counts of work done on the REST completion path, process wide.
+ * A successful response is never copied between D++ and the callback, so
+ * body_copies stays zero however large the responses; compare
+ * body_bytes_copied with body_bytes_received.
+ */
+struct rest_copy_counters {
+    /**
+     * @brief lazy_result objects constructed from a completion
+     */
+    std::atomic<uint64_t> results{0};
+
+    /**
+     * @brief Times a lazy_result was moved
+     */
+    std::atomic<uint64_t> moves{0};
+
+    /**
+     * @brief Bytes of response body received from D++
+     */
+    std::atomic<uint64_t> body_bytes_received{0};
+
+    /**
+     * @brief Response bodies copied (only error responses, for get_error())
+     */
+    std::atomic<uint64_t> body_copies{0};
+
+    /**
+     * @brief Bytes of response body copied
+     */
+    std::atomic<uint64_t> body_bytes_copied{0};
+};
+
+/**
+ * @brief Get the process wide REST copy counters
+ */
+rest_copy_counters& rest_copies();
+
+/**
+ * @brief True for the `std::unordered_map<snowflake, V>` containers D++ uses
+ * for list results (message_map, guild_member_map, ban_map etc).
+ */
+template<typename T> struct is_snowflake_map : std::false_type {};
+template<typename V> struct is_snowflake_map<std::unordered_map<dpp::snowflake, V>> : std::true_type {};
+
+/**
+ * @brief The result of a REST call, decoded only when it is asked for.
+ *
+ * dpp::confirmation_callback_t converts the whole response into its concrete
+ * type before the callback runs, even when the caller only looks at is_error()
+ * or a single id. A lazy_result instead keeps the parsed JSON document and
+ * builds the typed object on the first call to get<T>(). Map-typed results
+ * can also be walked one element at a time with for_each(), which never
+ * builds the map at all.
+ *
+ * A lazy_result can be moved but not copied, so the parsed body is never
+ * duplicated by accident on its way to the code that uses it. The callback
+ * receives it as an rvalue; move it into a lambda or a queue to keep it,
+ * and use take() or take_json() to move the contents out.
+ *
+ * @note Like dpp::confirmation_callback_t this is not thread safe; if you
+ * hand it to another thread, decode it there and nowhere else.
+ */
+class lazy_result {
+    /**
+     * @brief Parsed response body
+     */
+    mutable nlohmann::json body;
+
+    /**
+     * @brief Decoded value, set on first call to get()
+     */
+    mutable std::any decoded;
+
+    /**
+     * @brief Context for building objects
+     */
+    decode_context context;
+
+public:
+    /**
+     * @brief HTTP metadata for the request. On success the body is not
+     * copied in here, as it has already been parsed into JSON. On failure
+     * the body is kept so that get_error() can report it. The headers are
+     * in `headers` instead; http_info.headers is left empty.
+     */
+    dpp::http_request_completion_t http_info;
+
+    /**
+     * @brief Response headers
+     */
+    flat_headers headers;
+
+    /**
+     * @brief Construct a new lazy result
+     * @param ctx decoding context
+     * @param j parsed body, moved from
+     * @param http HTTP metadata
+     */
+    lazy_result(const decode_context& ctx, nlohmann::json& j, const dpp::http_request_completion_t& http);
+
+    /**
+     * @brief Move a lazy result. Not noexcept, as moving http_info moves its
+     * header multimap, which allocates a new sentinel node with MSVC's
+     * standard library.
+     */
+    lazy_result(lazy_result&& other);
+    lazy_result& operator=(lazy_result&& other);
+    lazy_result(const lazy_result&) = delete;
+    lazy_result& operator=(const lazy_result&) = delete;
+
+    /**
+     * @brief Returns true if the request failed, either at the HTTP level
+     * or because Discord returned an error object (a body with both
+     * `code` and `errors`). After take_json() only the HTTP level is checked.
+     */
+    bool is_error() const;
+
+    /**
+     * @brief Get details of the error, if is_error() is true
+     * @return error_info error details
+     */
+    dpp::error_info get_error() const;
+
+    /**
+     * @brief Access the raw JSON document without decoding anything
+     * @return const reference to the parsed body
+     */
+    const nlohmann::json& get_json() const;
+
+    /**
+     * @brief Move the raw JSON document out. The lazy_result is left with a
+     * null body; call this last.
+     * @return the parsed body
+     */
+    nlohmann::json take_json();
+
+    /**
+     * @brief Decode and return the result as T. The first call decodes,
+     * later calls return the same object.
+     * @tparam T a D++ object type (e.g. dpp::message) or a snowflake map
+     * of them (e.g. dpp::guild_member_map)
+     * @return reference to the decoded value, valid for the lifetime of the lazy_result
+     * @throw dpp::logic_exception if the result was already decoded as another type
+     */
+    template<typename T> const T& get() const {
+        if (!decoded.has_value()) {
+            decoded = decode<T>();
+        }
+        const T* value = std::any_cast<T>(&decoded);
+        if (value == nullptr) {
+            throw dpp::logic_exception("lazy_result was already decoded as a different type");
+        }
+        return *value;
+    }
+
+    /**
+     * @brief Move the result out as T, decoding it first if get() has not
+     * already. The cached value is released; call this last.
+     * @tparam T as for get()
+     * @return the decoded value
+     * @throw dpp::logic_exception if the result was already decoded as another type
+     */
+    template<typename T> T take() {
+        if (!decoded.has_value()) {
+            return decode<T>();
+        }
+        T* value = std::any_cast<T>(&decoded);
+        if (value == nullptr) {
+            throw dpp::logic_exception("lazy_result was already decoded as a different type");
+        }
+        T out = std::move(*value);
+        decoded.reset();
+        return out;
+    }
+
+    /**
+     * @brief Walk an array result one object at a time without building a container.
+     * Each element is decoded into a fresh V, passed to the visitor, then discarded.
+     * @tparam V element type, e.g. dpp::guild_member
+     * @param visitor called for each element, return false to stop early
+     * @param array_key if the array is nested inside an object (as with audit log
+     * entries), the key of the array. nullptr if the body itself is the array.
+     * @return number of elements visited
+     */
+    template<typename V> size_t for_each(const std::function<bool(const V&)>& visitor, const char* array_key = nullptr) const {
+        return visit<V>([&visitor](V&& obj) {
+            return visitor(obj);
+        }, array_key);
+    }
+
+private:
+    template<typename V, typename F> size_t visit(F&& visitor, const char* array_key = nullptr) const {
+        nlohmann::json* array = &body;
+        if (array_key != nullptr) {
+            auto it = body.find(array_key);
+            if (it == body.end()) {
+                return 0;
+            }
+            array = &*it;
+        }
+        if (!array->is_array()) {
+            return 0;
+        }
+        size_t visited = 0;
+        for (auto& element : *array) {
+            V obj = rest_traits<V>::make(context);
+            rest_traits<V>::fill(obj, element, context);
+            visited++;
+            if (!visitor(std::move(obj))) {
+                break;
+            }
+        }
+        return visited;
+    }
+
+    template<typename T> T decode() const {
+        if constexpr (is_snowflake_map<T>::value) {
+            using V = typename T::mapped_type;
+            T map;
+            if (body.is_array()) {
+                map.reserve(body.size());
+            }
+            visit<V>([&map](V&& obj) {
+                dpp::snowflake key = rest_traits<V>::key(obj);
+                map.emplace(key, std::move(obj));
+                return true;
+            });
+            return map;
+        } else {
+            T obj = rest_traits<T>::make(context);
+            rest_traits<T>::fill(obj, body, context);
+            return obj;
+        }
+    }
+};
+
+/**
+ * @brief Callback for a lazily decoded REST call. The result is passed as
+ * an rvalue; a handler taking `const lazy_result&` works too.
+ */
+using lazy_completion_t = std::function<void(lazy_result&&)>;
+
+/**
+ * @brief Make a REST call to Discord, with the same rate limiting as the
+ * built in D++ methods, returning a lazy_result rather than a fully decoded
+ * dpp::confirmation_callback_t.
+ *
+ * @param bot cluster to make the request with
+ * @param endpoint API endpoint, e.g. `API_PATH "/guilds"`
+ * @param major_parameters major parameter (the rate limit bucket id), e.g. the guild id
+ * @param parameters remainder of the path and any query string
+ * @param method HTTP method
+ * @param postdata request body, if any
+ * @param callback called with the result
+ * @param guild_id guild the request is for, needed to decode guild members
+ */
+void lazy_rest(dpp::cluster& bot, const std::string& endpoint, const std::string& major_parameters, const std::string& parameters, dpp::http_method method, const std::string& postdata, lazy_completion_t callback, dpp::snowflake guild_id = {});
+
+}
@@ -0,0 +1,430 @@
+#include "metrics.h"
+#include "fair_queue.h"
+#include "retry_engine.h"
+#include "trace.h"
+#include "watchdog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <shared_mutex>
+
+namespace mybot {
+
+namespace {
+
+void atomic_add(std::atomic<double>& target, double n) {
+    double old = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(old, old + n, std::memory_order_relaxed)) {
+    }
+}
+
+const char* type_name(metric_type type) {
+    switch (type) {
+        case metric_counter_type: return "counter";
+        case metric_gauge_type: return "gauge";
+        default: return "histogram";
+    }
+}
+
+std::string format_value(double v) {
+    if (std::isnan(v)) {
+        return "NaN";
+    }
+    if (std::isinf(v)) {
+        return v > 0 ? "+Inf" : "-Inf";
+    }
+    /* The shortest of 15 or 17 digits that reads back as the same value, so
+     * that bounds like 0.1 print as written
+     */
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.15g", v);
+    if (std::strtod(buffer, nullptr) != v) {
+        snprintf(buffer, sizeof(buffer), "%.17g", v);
+    }
+    return buffer;
+}
+
+/* Label values may hold anything; backslash, quote and newline are escaped */
+void append_labels(std::string& out, const metric_labels& labels, const char* extra_name = nullptr, const std::string& extra_value = {}) {
+    if (labels.empty() && extra_name == nullptr) {
+        return;
+    }
+    out += '{';
+    bool first = true;
+    auto append = [&](const std::string& name, const std::string& value) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        out += name;
+        out += "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                out += '\\';
+                out += c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    };
+    for (const auto& [name, value] : labels) {
+        append(name, value);
+    }
+    if (extra_name != nullptr) {
+        append(extra_name, extra_value);
+    }
+    out += '}';
+}
+
+/* Help text escapes only backslash and newline */
+std::string escape_help(const std::string& help) {
+    std::string out;
+    out.reserve(help.size());
+    for (char c : help) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+/* Exposed buckets are cumulative; the count is taken from them so that it
+ * always matches the +Inf bucket
+ */
+void append_histogram(std::string& out, const std::string& name, const metric_labels& labels, const metric_histogram& h) {
+    const std::vector<double>& bounds = h.upper_bounds();
+    std::vector<uint64_t> counts = h.bucket_counts();
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        cumulative += counts[i];
+        out += name + "_bucket";
+        append_labels(out, labels, "le", i < bounds.size() ? format_value(bounds[i]) : "+Inf");
+        out += ' ' + std::to_string(cumulative) + '\n';
+    }
+    out += name + "_sum";
+    append_labels(out, labels);
+    out += ' ' + format_value(h.total_sum()) + '\n';
+    out += name + "_count";
+    append_labels(out, labels);
+    out += ' ' + std::to_string(cumulative) + '\n';
+}
+
+/* Samples gathered for one scrape, grouped by name so that each family's HELP
+ * and TYPE come once however many collectors report it
+ */
+struct rendered_family {
+    std::string help;
+    metric_type type{metric_gauge_type};
+    std::string samples;
+};
+
+class scrape_writer : public metric_writer {
+public:
+    std::map<std::string, rendered_family>& out;
+
+    explicit scrape_writer(std::map<std::string, rendered_family>& o) : out(o) {
+    }
+
+    void sample(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels, double value) override {
+        auto [f, inserted] = out.try_emplace(name);
+        if (inserted) {
+            f->second.help = help;
+            f->second.type = type;
+        }
+        f->second.samples += name;
+        append_labels(f->second.samples, labels);
+        f->second.samples += ' ';
+        f->second.samples += format_value(value);
+        f->second.samples += '\n';
+    }
+
+    void histogram(const std::string& name, const std::string& help, const metric_labels& labels, const metric_histogram& h) override {
+        auto [f, inserted] = out.try_emplace(name);
+        if (inserted) {
+            f->second.help = help;
+            f->second.type = metric_histogram_type;
+        }
+        append_histogram(f->second.samples, name, labels, h);
+    }
+};
+
+std::string shard_label(uint32_t id) {
+    return std::to_string(id);
+}
+
+}
+
+void metric_gauge::add(double n) {
+    atomic_add(value, n);
+}
+
+metric_histogram::metric_histogram(const std::vector<double>& upper_bounds) : bounds(upper_bounds) {
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    if (!bounds.empty() && std::isinf(bounds.back())) {
+        bounds.pop_back();
+    }
+    buckets = std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1);
+    for (size_t i = 0; i <= bounds.size(); ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void metric_histogram::observe(double v) {
+    size_t index = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+    atomic_add(sum, v);
+    total.fetch_add(1, std::memory_order_relaxed);
+}
+
+const std::vector<double>& metric_histogram::upper_bounds() const {
+    return bounds;
+}
+
+std::vector<uint64_t> metric_histogram::bucket_counts() const {
+    std::vector<uint64_t> out(bounds.size() + 1);
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return out;
+}
+
+uint64_t metric_histogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+double metric_histogram::total_sum() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+const std::vector<double>& default_duration_buckets() {
+    static const std::vector<double> bounds{0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+    return bounds;
+}
+
+metrics_registry::child& metrics_registry::find_or_add(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels) {
+    auto [f, inserted] = families.try_emplace(name);
+    if (inserted) {
+        f->second.help = help;
+        f->second.type = type;
+    } else if (f->second.type != type) {
+        throw dpp::logic_exception("metrics_registry: " + name + " is already a " + type_name(f->second.type));
+    }
+    for (auto& c : f->second.children) {
+        if (c.labels == labels) {
+            return c;
+        }
+    }
+    f->second.children.emplace_back();
+    f->second.children.back().labels = labels;
+    return f->second.children.back();
+}
+
+metric_counter& metrics_registry::counter(const std::string& name, const std::string& help, const metric_labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    child& c = find_or_add(name, help, metric_counter_type, labels);
+    if (!c.counter) {
+        c.counter = std::make_unique<metric_counter>();
+    }
+    return *c.counter;
+}
+
+metric_gauge& metrics_registry::gauge(const std::string& name, const std::string& help, const metric_labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    child& c = find_or_add(name, help, metric_gauge_type, labels);
+    if (!c.gauge) {
+        c.gauge = std::make_unique<metric_gauge>();
+    }
+    return *c.gauge;
+}
+
+metric_histogram& metrics_registry::histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const metric_labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    child& c = find_or_add(name, help, metric_histogram_type, labels);
+    if (!c.histogram) {
+        c.histogram = std::make_unique<metric_histogram>(bounds);
+    }
+    return *c.histogram;
+}
+
+size_t metrics_registry::add_collector(metric_collector_t fn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t id = next_collector++;
+    collectors.emplace(id, std::move(fn));
+    return id;
+}
+
+void metrics_registry::remove_collector(size_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    collectors.erase(id);
+}
+
+std::string metrics_registry::render() const {
+    std::map<std::string, rendered_family> out;
+    std::vector<metric_collector_t> polled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [name, f] : families) {
+            rendered_family& r = out[name];
+            r.help = f.help;
+            r.type = f.type;
+            for (const auto& c : f.children) {
+                if (c.counter) {
+                    r.samples += name;
+                    append_labels(r.samples, c.labels);
+                    r.samples += ' ' + std::to_string(c.counter->get()) + '\n';
+                } else if (c.gauge) {
+                    r.samples += name;
+                    append_labels(r.samples, c.labels);
+                    r.samples += ' ' + format_value(c.gauge->get()) + '\n';
+                } else if (c.histogram) {
+                    append_histogram(r.samples, name, c.labels, *c.histogram);
+                }
+            }
+        }
+        for (const auto& [id, fn] : collectors) {
+            polled.push_back(fn);
+        }
+    }
+
+    /* Collectors run without the lock, so that they may register metrics */
+    scrape_writer writer(out);
+    for (const auto& fn : polled) {
+        fn(writer);
+    }
+
+    std::string text;
+    for (const auto& [name, f] : out) {
+        text += "# HELP " + name + " " + escape_help(f.help) + "\n";
+        text += "# TYPE " + name + " " + type_name(f.type) + "\n";
+        text += f.samples;
+    }
+    return text;
+}
+
+metrics_server::metrics_server(io_loop& io, const metrics_registry& registry, uint16_t port)
+    : server(io, [&registry](const standin_request& request) {
+        standin_response response;
+        std::string path = request.path.substr(0, request.path.find('?'));
+        if (path == "/trace" && request.method == "GET" && tracing_enabled()) {
+            response.content_type = "application/json";
+            response.body = trace_dump();
+        } else if (path != "/metrics") {
+            response.status = 404;
+            response.content_type = "text/plain";
+            response.body = "Not found\n";
+        } else if (request.method != "GET") {
+            response.status = 405;
+            response.content_type = "text/plain";
+            response.body = "Method not allowed\n";
+        } else {
+            response.content_type = "text/plain; version=0.0.4; charset=utf-8";
+            response.body = registry.render();
+        }
+        return response;
+    }, port) {
+}
+
+uint16_t metrics_server::port() const {
+    return server.port();
+}
+
+size_t add_dpp_metrics(metrics_registry& registry, dpp::cluster& bot) {
+    return registry.add_collector([&bot](metric_writer& w) {
+        for (const auto& [id, shard] : bot.get_shards()) {
+            if (shard == nullptr) {
+                continue;
+            }
+            metric_labels labels{{"shard", shard_label(id)}};
+            w.sample("dpp_shard_connected", "Whether the shard's websocket is connected", metric_gauge_type, labels, shard->is_connected() ? 1 : 0);
+            w.sample("dpp_shard_ready", "Whether the shard has received READY", metric_gauge_type, labels, shard->ready ? 1 : 0);
+            w.sample("dpp_shard_uptime_seconds", "Time since the shard connected", metric_gauge_type, labels, static_cast<double>(shard->get_uptime().to_secs()));
+            w.sample("dpp_shard_websocket_ping_seconds", "Last heartbeat round trip", metric_gauge_type, labels, shard->websocket_ping);
+            w.sample("dpp_shard_send_queue_size", "Messages waiting to be sent on the websocket", metric_gauge_type, labels, static_cast<double>(shard->get_queue_size()));
+            w.sample("dpp_shard_received_bytes_total", "Bytes received on the websocket", metric_counter_type, labels, static_cast<double>(shard->get_bytes_in()));
+            w.sample("dpp_shard_sent_bytes_total", "Bytes sent on the websocket", metric_counter_type, labels, static_cast<double>(shard->get_bytes_out()));
+            w.sample("dpp_shard_decompressed_bytes_total", "Bytes received after decompression", metric_counter_type, labels, static_cast<double>(shard->get_decompressed_bytes_in()));
+            w.sample("dpp_shard_resumes_total", "Sessions resumed", metric_counter_type, labels, shard->resumes);
+            w.sample("dpp_shard_reconnects_total", "Reconnections", metric_counter_type, labels, shard->reconnects);
+            w.sample("dpp_shard_guilds", "Guilds on the shard", metric_gauge_type, labels, static_cast<double>(shard->get_guild_count()));
+            w.sample("dpp_shard_members", "Members of the shard's guilds", metric_gauge_type, labels, static_cast<double>(shard->get_member_count()));
+            w.sample("dpp_shard_channels", "Channels of the shard's guilds", metric_gauge_type, labels, static_cast<double>(shard->get_channel_count()));
+            size_t voice = 0;
+            {
+                std::shared_lock lock(shard->voice_mutex);
+                voice = shard->connecting_voice_channels.size();
+            }
+            w.sample("dpp_shard_voice_connections", "Voice connections on the shard, connected or connecting", metric_gauge_type, labels, static_cast<double>(voice));
+        }
+        const std::pair<const char*, uint64_t> caches[] = {
+            {"guild", dpp::get_guild_count()},
+            {"user", dpp::get_user_count()},
+            {"channel", dpp::get_channel_count()},
+            {"role", dpp::get_role_count()},
+            {"emoji", dpp::get_emoji_count()},
+        };
+        for (const auto& [cache, size] : caches) {
+            w.sample("dpp_cache_objects", "Objects in D++'s caches", metric_gauge_type, {{"cache", cache}}, static_cast<double>(size));
+        }
+    });
+}
+
+size_t add_fair_queue_metrics(metrics_registry& registry, const fair_queue& queue, const std::string& name) {
+    return registry.add_collector([&queue, name](metric_writer& w) {
+        fair_queue_stats s = queue.stats();
+        metric_labels labels{{"queue", name}};
+        w.sample("mybot_rest_queued_requests", "REST requests waiting in the fair queue", metric_gauge_type, labels, static_cast<double>(s.queued));
+        w.sample("mybot_rest_in_flight_requests", "REST requests sent and not yet completed", metric_gauge_type, labels, s.in_flight);
+        w.sample("mybot_rest_sent_requests_total", "REST requests released to D++", metric_counter_type, labels, static_cast<double>(s.sent));
+        w.sample("mybot_rest_delayed_requests_total", "REST requests held back by a rate limit", metric_counter_type, labels, static_cast<double>(s.delayed));
+        w.sample("mybot_rest_queued_guilds", "Guilds with REST requests waiting or in flight", metric_gauge_type, labels, static_cast<double>(s.guilds));
+        w.sample("mybot_rest_max_wait_seconds", "Longest time a REST request waited to be sent", metric_gauge_type, labels, s.max_wait_ms / 1000.0);
+    });
+}
+
+size_t add_retry_metrics(metrics_registry& registry, const retry_engine& engine, const std::string& name) {
+    return registry.add_collector([&engine, name](metric_writer& w) {
+        retry_stats s = engine.stats();
+        metric_labels labels{{"engine", name}};
+        w.sample("mybot_retry_requests_total", "Requests started", metric_counter_type, labels, static_cast<double>(s.requests));
+        w.sample("mybot_retry_attempts_total", "Attempts made, first attempts included", metric_counter_type, labels, static_cast<double>(s.attempts));
+        w.sample("mybot_retry_retries_total", "Retries made", metric_counter_type, labels, static_cast<double>(s.retries));
+        w.sample("mybot_retry_succeeded_total", "Requests whose last attempt succeeded", metric_counter_type, labels, static_cast<double>(s.succeeded));
+        w.sample("mybot_retry_exhausted_total", "Requests which gave up after a retryable failure", metric_counter_type, labels, static_cast<double>(s.exhausted));
+        w.sample("mybot_retry_budget_denied_total", "Retries not made because the budget was spent", metric_counter_type, labels, static_cast<double>(s.budget_denied));
+        w.sample("mybot_retry_short_circuited_total", "Attempts refused by an open breaker", metric_counter_type, labels, static_cast<double>(s.short_circuited));
+        w.sample("mybot_retry_waiting", "Retries waiting for their delay", metric_gauge_type, labels, s.waiting);
+        w.sample("mybot_retry_budget", "Retry budget left", metric_gauge_type, labels, s.budget);
+    });
+}
+
+size_t add_watchdog_metrics(metrics_registry& registry, const watchdog& dog) {
+    return registry.add_collector([&dog](metric_writer& w) {
+        for (const auto& l : dog.lags()) {
+            metric_labels labels{{"loop", l.loop}};
+            w.sample("mybot_loop_lag_seconds", "Most recent lag of the loop", metric_gauge_type, labels, l.lag_ms / 1000.0);
+            w.sample("mybot_loop_max_lag_seconds", "Largest lag of the loop", metric_gauge_type, labels, l.max_lag_ms / 1000.0);
+            w.sample("mybot_loop_stalls_total", "Stalls found by the watchdog", metric_counter_type, labels, static_cast<double>(l.stalls));
+        }
+    });
+}
+
+size_t add_rest_pool_metrics(metrics_registry& registry) {
+    return registry.add_collector([](metric_writer& w) {
+        pool_stats s = rest_request_pool().stats();
+        w.sample("mybot_rest_pool_created_total", "REST requests constructed because the pool was empty", metric_counter_type, {}, static_cast<double>(s.created));
+        w.sample("mybot_rest_pool_reused_total", "REST requests handed out again from the pool", metric_counter_type, {}, static_cast<double>(s.reused));
+        w.sample("mybot_rest_pool_discarded_total", "REST requests freed instead of returned to the pool", metric_counter_type, {}, static_cast<double>(s.discarded));
+        w.sample("mybot_rest_pool_idle", "REST requests waiting in the pool", metric_gauge_type, {}, static_cast<double>(s.idle));
+    });
+}
+
+}
@@ -0,0 +1,303 @@
+#pragma once
+#include "standin_server.h"
+#include <deque>
+
+namespace mybot {
+
+class fair_queue;
+class retry_engine;
+class watchdog;
+
+/**
+ * @brief Label names and values of one metric, e.g. {{"shard", "0"}}
+ */
+using metric_labels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief A value which only goes up. Updates are a single atomic add.
+ */
+class metric_counter {
+    std::atomic<uint64_t> value{0};
+
+public:
+    /**
+     * @brief Add to the counter
+     * @param n amount
+     */
+    void inc(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Current value
+     */
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief A value which goes up and down
+ */
+class metric_gauge {
+    std::atomic<double> value{0};
+
+public:
+    /**
+     * @brief Set the value
+     * @param v value
+     */
+    void set(double v) {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Add to the value; negative to subtract
+     * @param n amount
+     */
+    void add(double n);
+
+    /**
+     * @brief Current value
+     */
+    double get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Counts observations into fixed buckets, e.g. request durations.
+ * observe() is a search of the bounds and three atomic updates.
+ */
+class metric_histogram {
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> total{0};
+    std::atomic<double> sum{0};
+
+public:
+    /**
+     * @brief Create a histogram
+     * @param upper_bounds ascending bucket upper bounds; +Inf is implied
+     */
+    explicit metric_histogram(const std::vector<double>& upper_bounds);
+
+    /**
+     * @brief Record a value
+     * @param v value
+     */
+    void observe(double v);
+
+    /**
+     * @brief Bucket upper bounds, without +Inf
+     */
+    const std::vector<double>& upper_bounds() const;
+
+    /**
+     * @brief Observations in each bucket (not cumulative), the last being +Inf
+     */
+    std::vector<uint64_t> bucket_counts() const;
+
+    /**
+     * @brief Observations recorded
+     */
+    uint64_t count() const;
+
+    /**
+     * @brief Sum of the observations
+     */
+    double total_sum() const;
+};
+
+/**
+ * @brief Prometheus default buckets for durations in seconds
+ */
+const std::vector<double>& default_duration_buckets();
+
+/**
+ * @brief Prometheus metric type
+ */
+enum metric_type {
+    metric_counter_type,
+    metric_gauge_type,
+    metric_histogram_type,
+};
+
+/**
+ * @brief Receives samples from collectors at scrape time
+ */
+class metric_writer {
+public:
+    virtual ~metric_writer() = default;
+
+    /**
+     * @brief Write one sample
+     * @param name metric name
+     * @param help description, used once per name
+     * @param type counter or gauge
+     * @param labels labels
+     * @param value value
+     */
+    virtual void sample(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels, double value) = 0;
+
+    /**
+     * @brief Write a histogram kept outside the registry
+     * @param name metric name
+     * @param help description, used once per name
+     * @param labels labels
+     * @param h histogram
+     */
+    virtual void histogram(const std::string& name, const std::string& help, const metric_labels& labels, const metric_histogram& h) = 0;
+};
+
+/**
+ * @brief Called at each scrape to report values that are read rather than
+ * updated, such as D++'s own counters
+ */
+using metric_collector_t = std::function<void(metric_writer&)>;
+
+/**
+ * @brief A registry of metrics, rendered in Prometheus text format.
+ *
+ * Metrics are registered by name and labels, which takes a lock, and return
+ * a reference that stays valid for the registry's lifetime; keep it and
+ * update it from any thread without locking. Registering the same name and
+ * labels again returns the same metric. Values that already live elsewhere,
+ * like D++'s shard counters, are read by collectors when scraped instead of
+ * being copied in on every change.
+ */
+class metrics_registry {
+    struct child {
+        metric_labels labels;
+        std::unique_ptr<metric_counter> counter;
+        std::unique_ptr<metric_gauge> gauge;
+        std::unique_ptr<metric_histogram> histogram;
+    };
+
+    struct family {
+        std::string help;
+        metric_type type;
+        std::deque<child> children;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, family> families;
+    std::map<size_t, metric_collector_t> collectors;
+    size_t next_collector{1};
+
+    child& find_or_add(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels);
+
+public:
+    /**
+     * @brief Get or register a counter
+     * @param name metric name, e.g. "mybot_commands_total"
+     * @param help description
+     * @param labels labels
+     * @throw dpp::logic_exception if the name is registered as another type
+     */
+    metric_counter& counter(const std::string& name, const std::string& help, const metric_labels& labels = {});
+
+    /**
+     * @brief Get or register a gauge
+     * @param name metric name
+     * @param help description
+     * @param labels labels
+     * @throw dpp::logic_exception if the name is registered as another type
+     */
+    metric_gauge& gauge(const std::string& name, const std::string& help, const metric_labels& labels = {});
+
+    /**
+     * @brief Get or register a histogram
+     * @param name metric name, e.g. "mybot_command_duration_seconds"
+     * @param help description
+     * @param bounds bucket upper bounds, used when first registered
+     * @param labels labels
+     * @throw dpp::logic_exception if the name is registered as another type
+     */
+    metric_histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds = default_duration_buckets(), const metric_labels& labels = {});
+
+    /**
+     * @brief Add a collector
+     * @param fn called at each scrape, on the scraping thread
+     * @return id for remove_collector()
+     */
+    size_t add_collector(metric_collector_t fn);
+
+    /**
+     * @brief Remove a collector
+     * @param id id from add_collector()
+     */
+    void remove_collector(size_t id);
+
+    /**
+     * @brief Every metric in Prometheus text exposition format 0.0.4
+     */
+    std::string render() const;
+};
+
+/**
+ * @brief Serves a registry at /metrics on 127.0.0.1, from an io_loop. While
+ * tracing is on, /trace serves trace_dump() as well.
+ */
+class metrics_server {
+    standin_server server;
+
+public:
+    /**
+     * @brief Start serving
+     * @param io loop to serve on. It must outlive the server.
+     * @param registry metrics to serve. It must outlive the server.
+     * @param port port, or zero for any free port
+     * @throw dpp::connection_exception if the port can't be bound
+     */
+    metrics_server(io_loop& io, const metrics_registry& registry, uint16_t port);
+
+    /**
+     * @brief Port listened on
+     */
+    uint16_t port() const;
+};
+
+/**
+ * @brief Report each shard's connection, latency, send queue, traffic,
+ * resumes and voice connections, and D++'s cache sizes
+ * @param registry registry
+ * @param bot cluster, which must outlive the registry or the collector
+ * @return collector id
+ */
+size_t add_dpp_metrics(metrics_registry& registry, dpp::cluster& bot);
+
+/**
+ * @brief Report a fair_queue's backlog and throughput
+ * @param registry registry
+ * @param queue queue, which must outlive the registry or the collector
+ * @param name value of the "queue" label
+ * @return collector id
+ */
+size_t add_fair_queue_metrics(metrics_registry& registry, const fair_queue& queue, const std::string& name);
+
+/**
+ * @brief Report a retry_engine's attempts, retries and budget
+ * @param registry registry
+ * @param engine engine, which must outlive the registry or the collector
+ * @param name value of the "engine" label
+ * @return collector id
+ */
+size_t add_retry_metrics(metrics_registry& registry, const retry_engine& engine, const std::string& name);
+
+/**
+ * @brief Report the lag and stalls of each loop a watchdog watches
+ * @param registry registry
+ * @param dog watchdog, which must outlive the registry or the collector
+ * @return collector id
+ */
+size_t add_watchdog_metrics(metrics_registry& registry, const watchdog& dog);
+
+/**
+ * @brief Report the rest_request_pool() reuse counters
+ * @param registry registry
+ * @return collector id
+ */
+size_t add_rest_pool_metrics(metrics_registry& registry);
+
+}
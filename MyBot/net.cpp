@@ -0,0 +1,112 @@
+#include "net.h"
+#include <cstring>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace mybot {
+
+int ip_address::family() const {
+    return addr.ss_family;
+}
+
+void ip_address::set_port(uint16_t port) {
+    if (family() == AF_INET6) {
+        reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port = htons(port);
+    } else {
+        reinterpret_cast<sockaddr_in*>(&addr)->sin_port = htons(port);
+    }
+}
+
+uint16_t ip_address::get_port() const {
+    if (family() == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6*>(&addr)->sin6_port);
+    }
+    return ntohs(reinterpret_cast<const sockaddr_in*>(&addr)->sin_port);
+}
+
+std::string ip_address::str() const {
+    char buffer[INET6_ADDRSTRLEN] = {0};
+    if (family() == AF_INET6) {
+        inet_ntop(AF_INET6, const_cast<in6_addr*>(&reinterpret_cast<const sockaddr_in6*>(&addr)->sin6_addr), buffer, sizeof(buffer));
+    } else {
+        inet_ntop(AF_INET, const_cast<in_addr*>(&reinterpret_cast<const sockaddr_in*>(&addr)->sin_addr), buffer, sizeof(buffer));
+    }
+    return buffer;
+}
+
+bool ip_address::parse(const std::string& ip, uint16_t port, ip_address& out) {
+    out = ip_address();
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&out.addr);
+    if (inet_pton(AF_INET, ip.c_str(), &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        out.len = sizeof(sockaddr_in);
+        return true;
+    }
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&out.addr);
+    if (inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        out.len = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+void close_socket(dpp::socket fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+int net_poll(pollfd* fds, size_t count, int timeout_ms) {
+#ifdef _WIN32
+    return WSAPoll(fds, static_cast<ULONG>(count), timeout_ms);
+#else
+    return ::poll(fds, static_cast<nfds_t>(count), timeout_ms);
+#endif
+}
+
+bool set_nonblocking(dpp::socket fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+int last_socket_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool error_is_transient(int err) {
+#ifdef _WIN32
+    return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS || err == WSAEALREADY;
+#else
+    return err == EWOULDBLOCK || err == EAGAIN || err == EINPROGRESS || err == EALREADY || err == EINTR;
+#endif
+}
+
+void net_init() {
+#ifdef _WIN32
+    static bool done = [] {
+        WSADATA wsadata;
+        return WSAStartup(MAKEWORD(2, 2), &wsadata) == 0;
+    }();
+    (void)done;
+#endif
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <dpp/dpp.h>
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+#include <string>
+
+namespace mybot {
+
+#ifdef _WIN32
+using socklen = int;
+#else
+using socklen = socklen_t;
+#endif
+
+/**
+ * @brief Flags for ::send on a stream socket, so that a peer which resets
+ * the connection gives EPIPE rather than raising SIGPIPE in the process
+ */
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+/**
+ * @brief An IPv4 or IPv6 socket address
+ */
+struct ip_address {
+    /**
+     * @brief Address storage, large enough for either family
+     */
+    sockaddr_storage addr{};
+
+    /**
+     * @brief Length of the valid part of addr
+     */
+    socklen len{0};
+
+    /**
+     * @brief AF_INET or AF_INET6
+     */
+    int family() const;
+
+    /**
+     * @brief Set the port number
+     * @param port port in host byte order
+     */
+    void set_port(uint16_t port);
+
+    /**
+     * @brief Get the port number
+     * @return port in host byte order
+     */
+    uint16_t get_port() const;
+
+    /**
+     * @brief Printable address without the port
+     * @return e.g. "162.159.128.233" or "2606:4700::6810:84e5"
+     */
+    std::string str() const;
+
+    /**
+     * @brief Parse a numeric address
+     * @param ip numeric IPv4 or IPv6 address
+     * @param port port in host byte order
+     * @param out parsed address
+     * @return true if ip was a valid numeric address
+     */
+    static bool parse(const std::string& ip, uint16_t port, ip_address& out);
+};
+
+/**
+ * @brief Close a socket on any platform
+ * @param fd socket
+ */
+void close_socket(dpp::socket fd);
+
+/**
+ * @brief poll() on any platform; WSAPoll() on Windows
+ * @param fds sockets to wait on, with revents filled in on return
+ * @param count number of entries in fds
+ * @param timeout_ms milliseconds to wait, or -1 to wait forever
+ * @return number of sockets ready, 0 on timeout, or -1 on error
+ */
+int net_poll(pollfd* fds, size_t count, int timeout_ms);
+
+/**
+ * @brief Put a socket into non-blocking mode
+ * @param fd socket
+ * @return true on success
+ */
+bool set_nonblocking(dpp::socket fd);
+
+/**
+ * @brief Last socket error on this thread (errno or WSAGetLastError)
+ */
+int last_socket_error();
+
+/**
+ * @brief True if the error means a non-blocking operation would have blocked
+ * or is still in progress
+ * @param err error from last_socket_error()
+ */
+bool error_is_transient(int err);
+
+/**
+ * @brief Make sure the platform socket library is initialised. Safe to call
+ * more than once; D++ also does this when a cluster is created.
+ */
+void net_init();
+
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mybot {
+
+/**
+ * @brief How an object_pool resets an object and measures what it holds on to.
+ * The default calls `obj.reset()` and `obj.retained_bytes()`; specialise it for
+ * types which spell these differently.
+ */
+template<typename T> struct pool_traits {
+    /**
+     * @brief Return the object to its default state, keeping allocated capacity
+     */
+    static void reset(T& obj) {
+        obj.reset();
+    }
+
+    /**
+     * @brief Bytes of heap capacity the object is keeping
+     */
+    static size_t retained_bytes(const T& obj) {
+        return obj.retained_bytes();
+    }
+};
+
+/**
+ * @brief Statistics for an object_pool
+ */
+struct pool_stats {
+    /**
+     * @brief Objects constructed because the pool was empty
+     */
+    uint64_t created{0};
+
+    /**
+     * @brief Objects handed out again from the pool
+     */
+    uint64_t reused{0};
+
+    /**
+     * @brief Objects reset and put back in the pool
+     */
+    uint64_t returned{0};
+
+    /**
+     * @brief Objects freed on release, because the pool was full or the
+     * object had grown past the retained size bound
+     */
+    uint64_t discarded{0};
+
+    /**
+     * @brief Objects waiting in the pool now
+     */
+    size_t idle{0};
+};
+
+/**
+ * @brief A bounded pool of reusable objects.
+ *
+ * acquire() hands out an object in a unique_ptr whose deleter resets it and
+ * puts it back, so strings and vectors inside it keep their capacity for the
+ * next user instead of being freed and allocated again. Two bounds stop the
+ * pool holding on to too much: at most max_idle objects are kept, and an
+ * object keeping more than max_retained_bytes (say, one which carried a large
+ * file upload) is freed rather than returned.
+ *
+ * Objects may be released on any thread, and after the pool itself has been
+ * destroyed.
+ *
+ * @tparam T pooled type, default constructible, see pool_traits
+ */
+template<typename T> class object_pool {
+    struct shared_state {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<T>> idle;
+        size_t max_idle;
+        size_t max_retained_bytes;
+        std::atomic<uint64_t> created{0};
+        std::atomic<uint64_t> reused{0};
+        std::atomic<uint64_t> returned{0};
+        std::atomic<uint64_t> discarded{0};
+
+        shared_state(size_t idle_limit, size_t retained_limit) : max_idle(idle_limit), max_retained_bytes(retained_limit) {
+        }
+
+        void give_back(T* raw) {
+            std::unique_ptr<T> obj(raw);
+            if (pool_traits<T>::retained_bytes(*obj) > max_retained_bytes) {
+                discarded++;
+                return;
+            }
+            pool_traits<T>::reset(*obj);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (idle.size() >= max_idle) {
+                discarded++;
+                return;
+            }
+            idle.emplace_back(std::move(obj));
+            returned++;
+        }
+    };
+
+    std::shared_ptr<shared_state> state;
+
+public:
+    /**
+     * @brief Returns an object to its pool when the handle is destroyed
+     */
+    struct returner {
+        std::shared_ptr<shared_state> pool;
+
+        void operator()(T* obj) const {
+            if (pool) {
+                pool->give_back(obj);
+            } else {
+                delete obj;
+            }
+        }
+    };
+
+    /**
+     * @brief An object borrowed from the pool
+     */
+    using handle = std::unique_ptr<T, returner>;
+
+    /**
+     * @brief Create a pool
+     * @param max_idle most objects to keep for reuse
+     * @param max_retained_bytes objects keeping more than this are freed on release
+     */
+    explicit object_pool(size_t max_idle = 64, size_t max_retained_bytes = 64 * 1024)
+        : state(std::make_shared<shared_state>(max_idle, max_retained_bytes)) {
+    }
+
+    /**
+     * @brief Borrow an object, constructing one if the pool is empty.
+     * It is in its reset state.
+     */
+    handle acquire() {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->idle.empty()) {
+                T* obj = state->idle.back().release();
+                state->idle.pop_back();
+                state->reused++;
+                return handle(obj, returner{state});
+            }
+        }
+        state->created++;
+        return handle(new T(), returner{state});
+    }
+
+    /**
+     * @brief Free idle objects until at most keep remain
+     * @param keep idle objects to keep
+     */
+    void trim(size_t keep = 0) {
+        std::vector<std::unique_ptr<T>> freed;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        while (state->idle.size() > keep) {
+            freed.emplace_back(std::move(state->idle.back()));
+            state->idle.pop_back();
+        }
+    }
+
+    /**
+     * @brief Get the pool's statistics
+     */
+    pool_stats stats() const {
+        pool_stats s;
+        s.created = state->created;
+        s.reused = state->reused;
+        s.returned = state->returned;
+        s.discarded = state->discarded;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        s.idle = state->idle.size();
+        return s;
+    }
+};
+
+}
@@ -0,0 +1,70 @@
+#include "paginator.h"
+
+namespace mybot {
+
+dpp::snowflake page_cursor(const nlohmann::json& element) {
+    if (element.contains("id")) {
+        return json_snowflake(element, "id");
+    }
+    auto user = element.find("user");
+    if (user != element.end()) {
+        return json_snowflake(*user, "id");
+    }
+    return {};
+}
+
+template<typename V> static std::shared_ptr<paginator<V>> start_scan(dpp::cluster& bot, const page_query& query, std::function<bool(const V&)> visitor, scan_complete_t complete) {
+    auto p = std::make_shared<paginator<V>>(bot, query, std::move(visitor), std::move(complete));
+    p->start();
+    return p;
+}
+
+std::shared_ptr<paginator<dpp::message>> scan_messages(dpp::cluster& bot, dpp::snowflake channel_id, std::function<bool(const dpp::message&)> visitor, scan_complete_t complete, dpp::snowflake before) {
+    page_query q;
+    q.endpoint = API_PATH "/channels";
+    q.major = channel_id;
+    q.path = "messages";
+    q.limit = 100;
+    q.backwards = true;
+    q.start = before;
+    return start_scan<dpp::message>(bot, q, std::move(visitor), std::move(complete));
+}
+
+std::shared_ptr<paginator<dpp::guild_member>> scan_members(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::guild_member&)> visitor, scan_complete_t complete, dpp::snowflake after) {
+    page_query q;
+    q.endpoint = API_PATH "/guilds";
+    q.major = guild_id;
+    q.path = "members";
+    q.limit = 1000;
+    q.backwards = false;
+    q.start = after;
+    q.guild_id = guild_id;
+    return start_scan<dpp::guild_member>(bot, q, std::move(visitor), std::move(complete));
+}
+
+std::shared_ptr<paginator<dpp::ban>> scan_bans(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::ban&)> visitor, scan_complete_t complete, dpp::snowflake after) {
+    page_query q;
+    q.endpoint = API_PATH "/guilds";
+    q.major = guild_id;
+    q.path = "bans";
+    q.limit = 1000;
+    q.backwards = false;
+    q.start = after;
+    q.guild_id = guild_id;
+    return start_scan<dpp::ban>(bot, q, std::move(visitor), std::move(complete));
+}
+
+std::shared_ptr<paginator<dpp::audit_entry>> scan_audit_log(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::audit_entry&)> visitor, scan_complete_t complete, dpp::snowflake before) {
+    page_query q;
+    q.endpoint = API_PATH "/guilds";
+    q.major = guild_id;
+    q.path = "audit-logs";
+    q.limit = 100;
+    q.backwards = true;
+    q.array_key = "audit_log_entries";
+    q.start = before;
+    q.guild_id = guild_id;
+    return start_scan<dpp::audit_entry>(bot, q, std::move(visitor), std::move(complete));
+}
+
+}
@@ -0,0 +1,252 @@
+#pragma once
+#include "lazy_result.h"
+#include <atomic>
+#include <memory>
+
+namespace mybot {
+
+/**
+ * @brief Describes one paginated Discord list endpoint
+ */
+struct page_query {
+    /**
+     * @brief API endpoint, e.g. `API_PATH "/channels"`
+     */
+    std::string endpoint;
+
+    /**
+     * @brief Major parameter (channel or guild id)
+     */
+    dpp::snowflake major;
+
+    /**
+     * @brief Path below the major parameter, e.g. "messages"
+     */
+    std::string path;
+
+    /**
+     * @brief Page size, the maximum the endpoint allows
+     */
+    uint32_t limit{100};
+
+    /**
+     * @brief True if the endpoint pages backwards with `before`,
+     * false if it pages forwards with `after`
+     */
+    bool backwards{true};
+
+    /**
+     * @brief Key of the array inside the response object, or nullptr
+     * if the response is the array itself
+     */
+    const char* array_key{nullptr};
+
+    /**
+     * @brief Cursor to start from, zero to start at the newest (backwards)
+     * or oldest (forwards) item
+     */
+    dpp::snowflake start;
+
+    /**
+     * @brief Guild id, for decoding guild members
+     */
+    dpp::snowflake guild_id;
+};
+
+/**
+ * @brief Summary passed to the completion callback of a scan
+ */
+struct scan_summary {
+    /**
+     * @brief Items passed to the visitor
+     */
+    size_t items{0};
+
+    /**
+     * @brief Pages requested from Discord
+     */
+    size_t pages{0};
+
+    /**
+     * @brief True if the scan was stopped by the visitor or by stop()
+     * before reaching the end of the list
+     */
+    bool stopped{false};
+
+    /**
+     * @brief True if a request failed, see error
+     */
+    bool failed{false};
+
+    /**
+     * @brief Error details if failed is true
+     */
+    dpp::error_info error;
+};
+
+/**
+ * @brief Called once when a scan ends, for whatever reason
+ */
+using scan_complete_t = std::function<void(const scan_summary&)>;
+
+/**
+ * @brief Get the cursor snowflake of one element of a list result.
+ * Messages and audit log entries have an `id`, members and bans only
+ * have the id of their user.
+ * @param element JSON element
+ * @return snowflake cursor value
+ */
+dpp::snowflake page_cursor(const nlohmann::json& element);
+
+/**
+ * @brief Walks every item of a paginated endpoint without holding more than
+ * two pages in memory.
+ *
+ * As soon as a full page arrives the request for the next one is sent, then
+ * the current page is passed item by item to the visitor while the next is
+ * in flight. The requests go through the normal D++ REST queue so bucket
+ * rate limits are respected. A short page ends the scan without a further
+ * request; returning false from the visitor (or calling stop()) ends it
+ * after at most the one prefetched page, which is then discarded.
+ *
+ * Results from the D++ REST queue are delivered in order on a single
+ * thread, so the visitor is never called concurrently with itself.
+ *
+ * @tparam V item type, e.g. dpp::message
+ */
+template<typename V> class paginator : public std::enable_shared_from_this<paginator<V>> {
+    dpp::cluster& bot;
+    page_query query;
+    std::function<bool(const V&)> visitor;
+    scan_complete_t on_complete;
+    std::atomic<bool> stopping{false};
+    scan_summary summary;
+
+    void request(dpp::snowflake cursor) {
+        std::string parameters = query.path + "?limit=" + std::to_string(query.limit);
+        if (!cursor.empty()) {
+            parameters += (query.backwards ? "&before=" : "&after=") + snowflake_str(cursor);
+        }
+        summary.pages++;
+        auto self = this->shared_from_this();
+        lazy_rest(bot, query.endpoint, snowflake_str(query.major), parameters, dpp::m_get, "", [self](const lazy_result& page) {
+            self->page_arrived(page);
+        }, query.guild_id);
+    }
+
+    void page_arrived(const lazy_result& page) {
+        if (page.is_error()) {
+            summary.failed = true;
+            summary.error = page.get_error();
+            finish();
+            return;
+        }
+        const nlohmann::json& body = page.get_json();
+        const nlohmann::json* array = &body;
+        if (query.array_key != nullptr) {
+            auto it = body.find(query.array_key);
+            array = it != body.end() ? &*it : nullptr;
+        }
+        size_t count = array != nullptr && array->is_array() ? array->size() : 0;
+        bool more = count >= query.limit && !stopping;
+
+        /* Prefetch: the next page is on its way while this one is visited */
+        if (more) {
+            request(page_cursor(array->back()));
+        }
+
+        page.for_each<V>([this](const V& item) {
+            if (stopping) {
+                return false;
+            }
+            summary.items++;
+            if (!visitor(item)) {
+                stopping = true;
+            }
+            return !stopping.load();
+        }, query.array_key);
+
+        if (!more || stopping) {
+            finish();
+        }
+    }
+
+    void finish() {
+        scan_complete_t done;
+        std::swap(done, on_complete);
+        if (done) {
+            summary.stopped = stopping;
+            done(summary);
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a paginator. Use the scan_* functions rather than calling this directly.
+     */
+    paginator(dpp::cluster& cluster, const page_query& q, std::function<bool(const V&)> item_visitor, scan_complete_t complete)
+        : bot(cluster), query(q), visitor(std::move(item_visitor)), on_complete(std::move(complete)) {
+    }
+
+    /**
+     * @brief Send the first request
+     */
+    void start() {
+        request(query.start);
+    }
+
+    /**
+     * @brief Stop the scan. The visitor will not be called again and no further
+     * pages are requested; the completion callback still fires once.
+     */
+    void stop() {
+        stopping = true;
+    }
+};
+
+/**
+ * @brief Walk a channel's message history from newest to oldest
+ * @param bot cluster
+ * @param channel_id channel to scan
+ * @param visitor called for each message, return false to stop
+ * @param complete called once when the scan ends
+ * @param before only return messages older than this id
+ * @return handle which can be used to stop the scan
+ */
+std::shared_ptr<paginator<dpp::message>> scan_messages(dpp::cluster& bot, dpp::snowflake channel_id, std::function<bool(const dpp::message&)> visitor, scan_complete_t complete = {}, dpp::snowflake before = {});
+
+/**
+ * @brief Walk every member of a guild in user id order
+ * @note Requires the GUILD_MEMBERS privileged intent to be enabled for the application
+ * @param bot cluster
+ * @param guild_id guild to scan
+ * @param visitor called for each member, return false to stop
+ * @param complete called once when the scan ends
+ * @param after only return members with a user id greater than this
+ * @return handle which can be used to stop the scan
+ */
+std::shared_ptr<paginator<dpp::guild_member>> scan_members(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::guild_member&)> visitor, scan_complete_t complete = {}, dpp::snowflake after = {});
+
+/**
+ * @brief Walk a guild's ban list in user id order
+ * @param bot cluster
+ * @param guild_id guild to scan
+ * @param visitor called for each ban, return false to stop
+ * @param complete called once when the scan ends
+ * @param after only return bans with a user id greater than this
+ * @return handle which can be used to stop the scan
+ */
+std::shared_ptr<paginator<dpp::ban>> scan_bans(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::ban&)> visitor, scan_complete_t complete = {}, dpp::snowflake after = {});
+
+/**
+ * @brief Walk a guild's audit log from newest to oldest
+ * @param bot cluster
+ * @param guild_id guild to scan
+ * @param visitor called for each entry, return false to stop
+ * @param complete called once when the scan ends
+ * @param before only return entries older than this id
+ * @return handle which can be used to stop the scan
+ */
+std::shared_ptr<paginator<dpp::audit_entry>> scan_audit_log(dpp::cluster& bot, dpp::snowflake guild_id, std::function<bool(const dpp::audit_entry&)> visitor, scan_complete_t complete = {}, dpp::snowflake before = {});
+
+}
@@ -0,0 +1,303 @@
+#include "ratelimit_store.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mybot {
+
+namespace {
+
+constexpr uint32_t store_version = 1;
+
+enum segment_state : uint32_t {
+    segment_empty = 0,
+    segment_initialising = 1,
+    segment_ready = 2,
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+    "ratelimit_store needs address-free atomics to share them between processes");
+
+uint64_t fnv1a(std::string_view s) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : s) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    return h == 0 ? 1 : h;
+}
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string store_name(const std::string& token) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(fnv1a(token)));
+#ifdef _WIN32
+    return std::string("Local\\mybot-ratelimit-") + hex;
+#else
+    return std::string("/mybot-ratelimit-") + hex;
+#endif
+}
+
+}
+
+struct ratelimit_store::slot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> limit;
+    std::atomic<uint32_t> remaining;
+    std::atomic<uint32_t> reserved;
+    std::atomic<int64_t> reset_at_ms;
+};
+
+struct ratelimit_store::segment {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> version;
+    std::atomic<uint32_t> slots;
+    std::atomic<uint32_t> used;
+    std::atomic<int64_t> global_until_ms;
+
+    slot* table() {
+        return reinterpret_cast<slot*>(this + 1);
+    }
+};
+
+ratelimit_store::ratelimit_store(const std::string& token, const ratelimit_store_config& config) {
+    if (config.slots == 0) {
+        throw dpp::file_exception("ratelimit_store: slots must be greater than zero");
+    }
+    mapped_size = sizeof(segment) + sizeof(slot) * config.slots;
+    void* view = nullptr;
+#ifdef _WIN32
+    if (!config.file.empty()) {
+        file_handle = CreateFileA(config.file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            file_handle = nullptr;
+            throw dpp::file_exception("ratelimit_store: can't open " + config.file);
+        }
+    }
+    /* Grows a smaller file to the requested size, zero filled */
+    mapping_handle = CreateFileMappingA(file_handle ? file_handle : INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(mapped_size), file_handle ? nullptr : store_name(token).c_str());
+    if (mapping_handle != nullptr) {
+        view = MapViewOfFile(mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, mapped_size);
+    }
+    if (view == nullptr) {
+        if (mapping_handle) {
+            CloseHandle(mapping_handle);
+        }
+        if (file_handle) {
+            CloseHandle(file_handle);
+        }
+        throw dpp::file_exception("ratelimit_store: can't map shared memory (error " + std::to_string(GetLastError()) + ")");
+    }
+#else
+    if (!config.file.empty()) {
+        fd = ::open(config.file.c_str(), O_RDWR | O_CREAT, 0600);
+    } else {
+        fd = shm_open(store_name(token).c_str(), O_RDWR | O_CREAT, 0600);
+    }
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < mapped_size && ftruncate(fd, static_cast<off_t>(mapped_size)) != 0)) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw dpp::file_exception("ratelimit_store: can't open shared memory: " + std::string(strerror(errno)));
+    }
+    view = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        throw dpp::file_exception("ratelimit_store: can't map shared memory: " + std::string(strerror(errno)));
+    }
+#endif
+    shared = static_cast<segment*>(view);
+
+    /* Whoever moves the state from empty sets the segment up; everyone else
+     * waits for it. A creator which died half way is taken over after a second.
+     */
+    uint32_t expected = segment_empty;
+    if (!shared->state.compare_exchange_strong(expected, segment_initialising)) {
+        for (int i = 0; i < 1000 && shared->state.load() != segment_ready; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        expected = segment_initialising;
+    }
+    if (expected == segment_empty || (expected == segment_initialising && shared->state.load() != segment_ready)) {
+        shared->version = store_version;
+        shared->slots = config.slots;
+        shared->state.store(segment_ready, std::memory_order_release);
+    }
+    if (shared->version != store_version || shared->slots != config.slots) {
+        std::string existing = std::to_string(shared->slots.load());
+        unmap();
+        throw dpp::file_exception("ratelimit_store: existing store has " + existing + " slots, not " + std::to_string(config.slots));
+    }
+}
+
+ratelimit_store::~ratelimit_store() {
+    unmap();
+}
+
+void ratelimit_store::unmap() {
+#ifdef _WIN32
+    if (shared) {
+        UnmapViewOfFile(shared);
+    }
+    if (mapping_handle) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle) {
+        CloseHandle(file_handle);
+    }
+    mapping_handle = file_handle = nullptr;
+#else
+    if (shared) {
+        munmap(shared, mapped_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+#endif
+    shared = nullptr;
+}
+
+ratelimit_store::slot* ratelimit_store::find(std::string_view key, bool create) const {
+    uint64_t h = fnv1a(key);
+    uint32_t slots = shared->slots;
+    slot* table = shared->table();
+    for (uint32_t probe = 0; probe < slots; ++probe) {
+        slot& s = table[(h + probe) % slots];
+        uint64_t k = s.key.load(std::memory_order_acquire);
+        if (k == h) {
+            return &s;
+        }
+        if (k == 0) {
+            if (!create) {
+                return nullptr;
+            }
+            if (s.key.compare_exchange_strong(k, h)) {
+                shared->used++;
+                return &s;
+            }
+            if (k == h) {
+                return &s;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool ratelimit_store::update(std::string_view key, uint32_t limit, uint32_t remaining, double reset_after) {
+    slot* s = find(key, true);
+    if (s == nullptr) {
+        return false;
+    }
+    /* Take the slot's sequence lock: odd while a write is in progress. A writer
+     * which died mid-write would leave it odd forever, so after a while the
+     * next writer takes it over instead of waiting.
+     */
+    uint32_t seq = s->sequence.load();
+    for (int spins = 0;; ++spins) {
+        if ((seq & 1) == 0 && s->sequence.compare_exchange_weak(seq, seq + 1)) {
+            break;
+        }
+        if ((seq & 1) == 1 && spins > 10000 && s->sequence.compare_exchange_weak(seq, seq + 2)) {
+            seq += 1;
+            break;
+        }
+        std::this_thread::yield();
+        seq = s->sequence.load();
+    }
+    s->limit.store(limit, std::memory_order_relaxed);
+    s->remaining.store(remaining, std::memory_order_relaxed);
+    s->reset_at_ms.store(now_ms() + static_cast<int64_t>(reset_after * 1000), std::memory_order_relaxed);
+    s->sequence.store(seq + 2, std::memory_order_release);
+    return true;
+}
+
+void ratelimit_store::record(std::string_view key, uint16_t status, const flat_headers& headers) {
+    if (status == 429) {
+        double retry_after = headers.get_seconds(hdr_retry_after, headers.get_seconds(hdr_ratelimit_reset_after, 1));
+        if (headers.get(hdr_ratelimit_global) == "true" || headers.get(hdr_ratelimit_scope) == "global") {
+            set_global(retry_after);
+            return;
+        }
+        update(key, static_cast<uint32_t>(headers.get_uint(hdr_ratelimit_limit)), 0, retry_after);
+        return;
+    }
+    if (headers.has(hdr_ratelimit_remaining) && headers.has(hdr_ratelimit_reset_after)) {
+        update(key, static_cast<uint32_t>(headers.get_uint(hdr_ratelimit_limit)), static_cast<uint32_t>(headers.get_uint(hdr_ratelimit_remaining)), headers.get_seconds(hdr_ratelimit_reset_after));
+    }
+}
+
+bool ratelimit_store::get(std::string_view key, bucket_state& out) const {
+    slot* s = find(key, false);
+    if (s == nullptr) {
+        return false;
+    }
+    for (int spins = 0;; ++spins) {
+        uint32_t before = s->sequence.load(std::memory_order_acquire);
+        out.limit = s->limit.load(std::memory_order_relaxed);
+        out.remaining = s->remaining.load(std::memory_order_relaxed);
+        out.reset_at_ms = s->reset_at_ms.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (((before & 1) == 0 && s->sequence.load(std::memory_order_relaxed) == before) || spins > 10000) {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+}
+
+std::chrono::milliseconds ratelimit_store::acquire(std::string_view key) {
+    int64_t now = now_ms();
+    int64_t global = shared->global_until_ms.load();
+    if (global > now) {
+        return std::chrono::milliseconds(global - now);
+    }
+    slot* s = find(key, false);
+    if (s == nullptr) {
+        return std::chrono::milliseconds(0);
+    }
+    int64_t reset_at = s->reset_at_ms.load();
+    if (now >= reset_at) {
+        return std::chrono::milliseconds(0);
+    }
+    uint32_t remaining = s->remaining.load();
+    while (remaining > 0) {
+        if (s->remaining.compare_exchange_weak(remaining, remaining - 1)) {
+            return std::chrono::milliseconds(0);
+        }
+    }
+    return std::chrono::milliseconds(reset_at - now);
+}
+
+void ratelimit_store::set_global(double retry_after) {
+    int64_t until = now_ms() + static_cast<int64_t>(retry_after * 1000);
+    int64_t current = shared->global_until_ms.load();
+    while (current < until && !shared->global_until_ms.compare_exchange_weak(current, until)) {
+    }
+}
+
+std::chrono::milliseconds ratelimit_store::global_wait() const {
+    int64_t wait = shared->global_until_ms.load() - now_ms();
+    return std::chrono::milliseconds(wait > 0 ? wait : 0);
+}
+
+size_t ratelimit_store::used() const {
+    return shared->used;
+}
+
+size_t ratelimit_store::capacity() const {
+    return shared->slots;
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "http_headers.h"
+#include <atomic>
+#include <chrono>
+
+namespace mybot {
+
+/**
+ * @brief Settings for a ratelimit_store
+ */
+struct ratelimit_store_config {
+    /**
+     * @brief If set, the store is this file mapped into memory, so that it
+     * survives restarts as well as being shared. If empty, a named shared
+     * memory segment is used, which lasts until the machine restarts (POSIX)
+     * or the last process using it exits (Windows).
+     */
+    std::string file;
+
+    /**
+     * @brief Number of bucket slots. Every process sharing a store must use
+     * the same value.
+     */
+    uint32_t slots{4096};
+};
+
+/**
+ * @brief A snapshot of one bucket
+ */
+struct bucket_state {
+    /**
+     * @brief Requests allowed per window
+     */
+    uint32_t limit{0};
+
+    /**
+     * @brief Requests left in the current window
+     */
+    uint32_t remaining{0};
+
+    /**
+     * @brief When the window resets, in milliseconds since the Unix epoch
+     */
+    int64_t reset_at_ms{0};
+};
+
+/**
+ * @brief Rate limit state shared between every process using the same bot
+ * token on this machine.
+ *
+ * The store is a fixed-size hash table in shared memory (optionally backed by
+ * a file). Each slot is a set of atomics guarded by a sequence counter, so a
+ * reader never blocks a writer and nobody takes a lock; insertion claims an
+ * empty slot with a compare-and-swap. Times are wall-clock milliseconds so
+ * that they mean the same thing to every process and after a restart.
+ *
+ * The segment name is derived from a hash of the token, so different bots on
+ * one machine get different stores and the token itself is never written
+ * anywhere. Keys are hashed to 64 bits; a collision would make two routes
+ * share a bucket, which only costs some unnecessary waiting.
+ */
+class ratelimit_store {
+    struct slot;
+    struct segment;
+
+    segment* shared{nullptr};
+    size_t mapped_size{0};
+#ifdef _WIN32
+    void* file_handle{nullptr};
+    void* mapping_handle{nullptr};
+#else
+    int fd{-1};
+#endif
+
+    slot* find(std::string_view key, bool create) const;
+    void unmap();
+
+public:
+    /**
+     * @brief Open or create the store for a token
+     * @param token bot token, used only to name the store
+     * @param config settings
+     * @throw dpp::file_exception if the store can't be mapped, or exists
+     * with a different number of slots
+     */
+    explicit ratelimit_store(const std::string& token, const ratelimit_store_config& config = {});
+
+    /**
+     * @brief Unmap the store. Its contents stay for other processes.
+     */
+    ~ratelimit_store();
+
+    ratelimit_store(const ratelimit_store&) = delete;
+    ratelimit_store& operator=(const ratelimit_store&) = delete;
+
+    /**
+     * @brief Record the state of a bucket
+     * @param key route or bucket key, e.g. endpoint + "/" + major parameter
+     * @param limit requests per window
+     * @param remaining requests left
+     * @param reset_after seconds until the window resets
+     * @return false if the table is full
+     */
+    bool update(std::string_view key, uint32_t limit, uint32_t remaining, double reset_after);
+
+    /**
+     * @brief Record the rate limit headers of a response, including a
+     * global limit if the response was a global 429
+     * @param key route or bucket key
+     * @param status HTTP status
+     * @param headers response headers
+     */
+    void record(std::string_view key, uint16_t status, const flat_headers& headers);
+
+    /**
+     * @brief Read a bucket
+     * @param key route or bucket key
+     * @param out state
+     * @return false if nothing is known about the bucket
+     */
+    bool get(std::string_view key, bucket_state& out) const;
+
+    /**
+     * @brief Claim one request from a bucket, for any process. If the
+     * window has passed or the bucket is unknown this always succeeds.
+     * @param key route or bucket key
+     * @return zero if a request may be sent now, otherwise how long to
+     * wait before asking again
+     */
+    std::chrono::milliseconds acquire(std::string_view key);
+
+    /**
+     * @brief Stop all requests for every process until retry_after has passed
+     * @param retry_after seconds
+     */
+    void set_global(double retry_after);
+
+    /**
+     * @brief How long until the global limit ends, zero if none is in force
+     */
+    std::chrono::milliseconds global_wait() const;
+
+    /**
+     * @brief Slots in use
+     */
+    size_t used() const;
+
+    /**
+     * @brief Total slots
+     */
+    size_t capacity() const;
+};
+
+}
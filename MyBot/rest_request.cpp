@@ -0,0 +1,142 @@
+#include "rest_request.h"
+#include "trace.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+namespace mybot {
+
+namespace {
+
+/* Runs stubbed completions off the caller's stack, so a queue which sends
+ * its next request from a callback does not recurse once per request.
+ */
+class stub_worker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+
+public:
+    /* One detached worker for the life of the process, so completions run
+     * one at a time and in the order they were posted
+     */
+    stub_worker() {
+        std::thread([this] {
+            for (;;) {
+                std::function<void()> next;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [this] { return !jobs.empty(); });
+                    next = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                next();
+            }
+        }).detach();
+    }
+
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+};
+
+std::mutex stub_mutex;
+rest_stub_t current_stub;
+
+/* Records the request as an async span from when it was sent, and runs its
+ * callback as a span continuing the request's cause, at the end of a flow
+ * arrow from where the request was made
+ */
+template<typename F> void traced_completion(const rest_request& r, int64_t started, uint32_t status, F&& callback) {
+    if (started < 0 || !tracing_enabled()) {
+        callback();
+        return;
+    }
+    static const char* const methods[] = {"GET ", "POST ", "PUT ", "PATCH ", "DELETE "};
+    std::string route = (r.method < 5 ? methods[r.method] : "") + r.endpoint.substr(r.endpoint.rfind('/') + 1) + "/" + r.major_parameters;
+    trace_async("rest", "rest", started, trace_now_us(), route, r.trace_cause, status);
+    trace_cause span("rest_callback", "rest", route, r.trace_cause);
+    span.set_flow_in(r.trace_flow);
+    callback();
+}
+
+stub_worker& stubs() {
+    /* Never destroyed, as the detached worker may still be waiting on it at exit */
+    static stub_worker* worker = new stub_worker();
+    return *worker;
+}
+
+}
+
+void rest_request::reset() {
+    endpoint.clear();
+    major_parameters.clear();
+    parameters.clear();
+    method = dpp::m_get;
+    postdata.clear();
+    guild_id = 0;
+    callback = nullptr;
+    queued = {};
+    trace_cause = 0;
+    trace_flow = 0;
+    trace_taken = false;
+}
+
+size_t rest_request::retained_bytes() const {
+    return endpoint.capacity() + major_parameters.capacity() + parameters.capacity() + postdata.capacity();
+}
+
+object_pool<rest_request>& rest_request_pool() {
+    static object_pool<rest_request> pool(1024, 64 * 1024);
+    return pool;
+}
+
+void set_rest_stub(rest_stub_t stub) {
+    std::lock_guard<std::mutex> lock(stub_mutex);
+    current_stub = std::move(stub);
+}
+
+void lazy_rest(dpp::cluster& bot, rest_request_ptr request) {
+    decode_context ctx{&bot, request->guild_id};
+    if (tracing_enabled() && !request->trace_taken) {
+        request->trace_cause = trace_current_cause();
+        request->trace_flow = trace_flow_begin();
+        request->trace_taken = true;
+    }
+    int64_t started = tracing_enabled() ? trace_now_us() : -1;
+    rest_stub_t stub;
+    {
+        std::lock_guard<std::mutex> lock(stub_mutex);
+        stub = current_stub;
+    }
+    if (stub) {
+        stubs().post([ctx, stub, started, request = std::shared_ptr<rest_request>(std::move(request))] {
+            dpp::http_request_completion_t http = stub(*request);
+            nlohmann::json j = nlohmann::json::parse(http.body, nullptr, false);
+            if (j.is_discarded()) {
+                j = nullptr;
+            }
+            traced_completion(*request, started, http.status, [&] {
+                if (request->callback) {
+                    request->callback(lazy_result(ctx, j, http));
+                }
+            });
+        });
+        return;
+    }
+    /* D++ copies the strings into its own http_request before post_rest returns */
+    const rest_request& r = *request;
+    bot.post_rest(r.endpoint, r.major_parameters, r.parameters, r.method, r.postdata, [ctx, started, request = std::shared_ptr<rest_request>(std::move(request))](nlohmann::json& j, const dpp::http_request_completion_t& http) {
+        traced_completion(*request, started, http.status, [&] {
+            if (request->callback) {
+                request->callback(lazy_result(ctx, j, http));
+            }
+        });
+    });
+}
+
+}
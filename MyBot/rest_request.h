@@ -0,0 +1,115 @@
+#pragma once
+#include "lazy_result.h"
+#include "object_pool.h"
+
+namespace mybot {
+
+/**
+ * @brief One REST call waiting to be sent, as carried by the bot's own
+ * request queues. Instances come from rest_request_pool() and go back to it
+ * once the request completes, keeping their string capacity.
+ */
+struct rest_request {
+    /**
+     * @brief API endpoint, e.g. `API_PATH "/channels"`
+     */
+    std::string endpoint;
+
+    /**
+     * @brief Major parameter (the rate limit bucket id)
+     */
+    std::string major_parameters;
+
+    /**
+     * @brief Remainder of the path and any query string
+     */
+    std::string parameters;
+
+    /**
+     * @brief HTTP method
+     */
+    dpp::http_method method{dpp::m_get};
+
+    /**
+     * @brief Request body
+     */
+    std::string postdata;
+
+    /**
+     * @brief Guild the request is for; used for decoding and for fair queuing
+     */
+    dpp::snowflake guild_id;
+
+    /**
+     * @brief Called with the result
+     */
+    lazy_completion_t callback;
+
+    /**
+     * @brief When the request was queued
+     */
+    std::chrono::steady_clock::time_point queued{};
+
+    /**
+     * @brief Trace cause the request was made for, see trace_cause
+     */
+    uint64_t trace_cause{0};
+
+    /**
+     * @brief Trace flow from where the request was made to its callback
+     */
+    uint64_t trace_flow{0};
+
+    /**
+     * @brief True once trace_cause and trace_flow were taken on the thread
+     * that made the request, even if both came out as zero. A queue which
+     * sends the request later, from another request's callback, must not
+     * take them again there.
+     */
+    bool trace_taken{false};
+
+    /**
+     * @brief Clear for reuse, keeping string capacity
+     */
+    void reset();
+
+    /**
+     * @brief Heap capacity held by the strings
+     */
+    size_t retained_bytes() const;
+};
+
+/**
+ * @brief A rest_request borrowed from the pool
+ */
+using rest_request_ptr = object_pool<rest_request>::handle;
+
+/**
+ * @brief The process wide pool of rest_request objects. Keeps up to 1024
+ * idle requests; one holding more than 64 KiB of strings is freed instead.
+ */
+object_pool<rest_request>& rest_request_pool();
+
+/**
+ * @brief Answers a request in place of Discord, see set_rest_stub()
+ */
+using rest_stub_t = std::function<dpp::http_request_completion_t(const rest_request&)>;
+
+/**
+ * @brief Answer every request sent through lazy_rest() with a stub instead
+ * of sending it, e.g. while replaying recorded gateway traffic. Callbacks run
+ * on a worker thread, as they would for a real response. Requests D++ makes
+ * by itself (event.reply() and the like) are not affected.
+ * @param stub stub, or nullptr to send requests to Discord again
+ */
+void set_rest_stub(rest_stub_t stub);
+
+/**
+ * @brief Send a pooled request through lazy_rest(). The request goes back
+ * to the pool when its callback has run.
+ * @param bot cluster
+ * @param request request, moved from
+ */
+void lazy_rest(dpp::cluster& bot, rest_request_ptr request);
+
+}
@@ -0,0 +1,324 @@
+#include "retry_engine.h"
+#include <algorithm>
+#include <optional>
+
+namespace mybot {
+
+namespace {
+
+bool is_failure(const attempt_outcome& o) {
+    return o.error != dpp::h_success || o.status == 0 || o.status >= 500;
+}
+
+/* The request never reached the server, so even a POST is safe to repeat.
+ * A failed TLS handshake comes before any of the request is written.
+ */
+bool never_sent(const attempt_outcome& o) {
+    return o.status == 429 || o.error == dpp::h_connection || o.error == dpp::h_ssl_connection;
+}
+
+std::string url_origin(const std::string& url) {
+    size_t scheme = url.find("://");
+    size_t path = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    return path == std::string::npos ? url : url.substr(0, path);
+}
+
+}
+
+struct retry_engine::request_state {
+    std::string key;
+    dpp::http_method method{dpp::m_get};
+    attempt_t attempt;
+    retry_done_t done;
+    uint32_t attempts{0};
+    std::chrono::milliseconds previous_delay{0};
+    std::chrono::steady_clock::time_point started;
+    attempt_outcome last;
+};
+
+retry_engine::retry_engine(io_loop& io, const retry_config& cfg) : loop(io), config(cfg), random(cfg.seed ? cfg.seed : std::random_device{}()), budget(cfg.retry.budget_reserve) {
+    config.retry.max_attempts = std::max<uint32_t>(config.retry.max_attempts, 1);
+    config.retry.base_delay = std::max(config.retry.base_delay, std::chrono::milliseconds(1));
+    config.retry.max_delay = std::max(config.retry.max_delay, config.retry.base_delay);
+    config.breaker.failure_threshold = std::max<uint32_t>(config.breaker.failure_threshold, 1);
+    config.breaker.half_open_probes = std::max<uint32_t>(config.breaker.half_open_probes, 1);
+}
+
+bool retry_engine::idempotent(dpp::http_method method) {
+    return method == dpp::m_get || method == dpp::m_put || method == dpp::m_delete;
+}
+
+bool retry_engine::retryable(const attempt_outcome& o) {
+    switch (o.error) {
+        case dpp::h_success:
+            break;
+        case dpp::h_unknown:
+        case dpp::h_connection:
+        case dpp::h_ssl_connection:
+        case dpp::h_read:
+        case dpp::h_write:
+            return true;
+        default:
+            return false;
+    }
+    return o.status == 0 || o.status == 429 || o.status == 500 || o.status == 502 || o.status == 503 || o.status == 504;
+}
+
+bool retry_engine::admit(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    breaker& b = breakers[key];
+    if (b.state == breaker_open && std::chrono::steady_clock::now() >= b.open_until) {
+        b.state = breaker_half_open;
+        b.probes = 0;
+    }
+    if (b.state == breaker_closed || (b.state == breaker_half_open && b.probes < config.breaker.half_open_probes)) {
+        if (b.state == breaker_half_open) {
+            b.probes++;
+        }
+        return true;
+    }
+    b.rejected++;
+    counters.short_circuited++;
+    return false;
+}
+
+void retry_engine::record(const std::string& key, const attempt_outcome& outcome) {
+    std::lock_guard<std::mutex> lock(mutex);
+    breaker& b = breakers[key];
+    if (!is_failure(outcome)) {
+        b.consecutive_failures = 0;
+        if (b.state == breaker_half_open) {
+            b.state = breaker_closed;
+            b.reopened = 0;
+        }
+        return;
+    }
+    b.consecutive_failures++;
+    bool trip = b.state == breaker_half_open || (b.state == breaker_closed && b.consecutive_failures >= config.breaker.failure_threshold);
+    if (!trip) {
+        return;
+    }
+    /* A failed probe doubles the open period; a fresh trip starts from open_for */
+    b.reopened = b.state == breaker_half_open ? std::min<uint32_t>(b.reopened + 1, 16) : 0;
+    auto open_for = std::min(std::chrono::milliseconds(config.breaker.open_for.count() << b.reopened), config.breaker.max_open_for);
+    b.state = breaker_open;
+    b.open_until = std::chrono::steady_clock::now() + open_for;
+    b.opened++;
+}
+
+void retry_engine::run(const std::string& key, dpp::http_method method, attempt_t attempt, retry_done_t done) {
+    auto r = std::make_shared<request_state>();
+    r->key = key;
+    r->method = method;
+    r->attempt = std::move(attempt);
+    r->done = std::move(done);
+    r->previous_delay = config.retry.base_delay;
+    r->started = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.requests++;
+        budget = std::min(budget + config.retry.budget_ratio, config.retry.budget_reserve);
+    }
+    start_attempt(r);
+}
+
+void retry_engine::start_attempt(const std::shared_ptr<request_state>& r) {
+    if (!admit(r->key)) {
+        if (r->attempts == 0) {
+            r->last = attempt_outcome{0, dpp::h_canceled, 0};
+        }
+        finish(r, stop_breaker_open);
+        return;
+    }
+    r->attempts++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.attempts++;
+    }
+    /* The attempt may report before returning, and finish() clears r->attempt */
+    attempt_t attempt = r->attempt;
+    attempt(r->attempts, [this, r](const attempt_outcome& outcome) {
+        on_outcome(r, outcome);
+    });
+}
+
+void retry_engine::on_outcome(const std::shared_ptr<request_state>& r, const attempt_outcome& outcome) {
+    record(r->key, outcome);
+    r->last = outcome;
+    if (!retryable(outcome)) {
+        finish(r, outcome.error == dpp::h_success && outcome.status < 400 ? stop_success : stop_permanent);
+        return;
+    }
+    if (r->attempts >= config.retry.max_attempts) {
+        finish(r, stop_attempts);
+        return;
+    }
+    if (!idempotent(r->method) && !config.retry.retry_non_idempotent && !never_sent(outcome)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.not_idempotent++;
+        }
+        finish(r, stop_not_idempotent);
+        return;
+    }
+    auto retry_after = std::chrono::milliseconds(static_cast<int64_t>(outcome.retry_after * 1000));
+    if (retry_after > config.retry.max_delay) {
+        finish(r, stop_retry_after);
+        return;
+    }
+    std::chrono::milliseconds delay;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (budget < 1) {
+            counters.budget_denied++;
+            delay = std::chrono::milliseconds(-1);
+        } else {
+            budget -= 1;
+            counters.retries++;
+            counters.waiting++;
+            /* Decorrelated jitter: uniform between base and three times the last wait */
+            int64_t low = config.retry.base_delay.count();
+            int64_t high = std::max(low, r->previous_delay.count() * 3);
+            delay = std::min(std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(low, high)(random)), config.retry.max_delay);
+        }
+    }
+    if (delay.count() < 0) {
+        finish(r, stop_budget);
+        return;
+    }
+    r->previous_delay = delay;
+    loop.after(std::max(delay, retry_after), [this, r] {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.waiting--;
+        }
+        start_attempt(r);
+    });
+}
+
+void retry_engine::finish(const std::shared_ptr<request_state>& r, retry_stop reason) {
+    retry_result result;
+    result.last = r->last;
+    result.attempts = r->attempts;
+    result.reason = reason;
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r->started).count();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (reason == stop_success) {
+            counters.succeeded++;
+        } else if (reason != stop_permanent) {
+            counters.exhausted++;
+        }
+    }
+    if (r->done) {
+        r->done(result);
+    }
+    /* Break the cycle through the attempt closure, which may hold the caller's state */
+    r->attempt = nullptr;
+    r->done = nullptr;
+}
+
+void retry_engine::rest(dpp::cluster& bot, rest_request_ptr request) {
+    auto original = std::shared_ptr<rest_request>(std::move(request));
+    auto last = std::make_shared<std::optional<lazy_result>>();
+    std::string key = original->endpoint;
+    dpp::http_method method = original->method;
+    run(key, method, [this, &bot, original, last](uint32_t, attempt_report_t report) {
+        rest_request_ptr r = rest_request_pool().acquire();
+        r->endpoint = original->endpoint;
+        r->major_parameters = original->major_parameters;
+        r->parameters = original->parameters;
+        r->method = original->method;
+        r->postdata = original->postdata;
+        r->guild_id = original->guild_id;
+        r->callback = [last, report = std::move(report)](lazy_result&& result) {
+            attempt_outcome outcome{result.http_info.status, result.http_info.error, result.headers.get_seconds(hdr_retry_after)};
+            *last = std::move(result);
+            report(outcome);
+        };
+        if (config.queue != nullptr) {
+            config.queue->post(std::move(r));
+        } else {
+            lazy_rest(bot, std::move(r));
+        }
+    }, [&bot, original, last](const retry_result&) {
+        if (!original->callback) {
+            return;
+        }
+        if (last->has_value()) {
+            original->callback(std::move(**last));
+            return;
+        }
+        nlohmann::json j;
+        dpp::http_request_completion_t http;
+        http.error = dpp::h_canceled;
+        original->callback(lazy_result(decode_context{&bot, original->guild_id}, j, http));
+    });
+}
+
+void retry_engine::request(dpp::cluster& bot, const std::string& url, dpp::http_method method, dpp::http_completion_event callback, const std::string& postdata, const std::string& mimetype, const std::multimap<std::string, std::string>& headers) {
+    auto last = std::make_shared<std::optional<dpp::http_request_completion_t>>();
+    run(url_origin(url), method, [&bot, url, method, postdata, mimetype, headers, last](uint32_t, attempt_report_t report) {
+        bot.request(url, method, [last, report = std::move(report)](const dpp::http_request_completion_t& http) {
+            attempt_outcome outcome{http.status, http.error, flat_headers(http.headers).get_seconds(hdr_retry_after)};
+            *last = http;
+            report(outcome);
+        }, postdata, mimetype, headers);
+    }, [last, callback = std::move(callback)](const retry_result&) {
+        if (!callback) {
+            return;
+        }
+        if (last->has_value()) {
+            callback(**last);
+            return;
+        }
+        dpp::http_request_completion_t http;
+        http.error = dpp::h_canceled;
+        callback(http);
+    });
+}
+
+breaker_state retry_engine::state(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = breakers.find(key);
+    if (it == breakers.end()) {
+        return breaker_closed;
+    }
+    /* An open breaker whose time is up will admit a probe, so report it as half open */
+    if (it->second.state == breaker_open && std::chrono::steady_clock::now() >= it->second.open_until) {
+        return breaker_half_open;
+    }
+    return it->second.state;
+}
+
+std::vector<breaker_info> retry_engine::breaker_states() const {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<breaker_info> out;
+    std::lock_guard<std::mutex> lock(mutex);
+    out.reserve(breakers.size());
+    for (const auto& [key, b] : breakers) {
+        breaker_info info;
+        info.key = key;
+        info.state = b.state;
+        info.consecutive_failures = b.consecutive_failures;
+        info.opened = b.opened;
+        info.rejected = b.rejected;
+        if (b.state == breaker_open) {
+            info.retry_in_ms = std::max(0.0, std::chrono::duration<double, std::milli>(b.open_until - now).count());
+            if (info.retry_in_ms == 0) {
+                info.state = breaker_half_open;
+            }
+        }
+        out.push_back(info);
+    }
+    return out;
+}
+
+retry_stats retry_engine::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    retry_stats s = counters;
+    s.budget = budget;
+    return s;
+}
+
+}
@@ -0,0 +1,434 @@
+#pragma once
+#include "fair_queue.h"
+#include <random>
+
+namespace mybot {
+
+/**
+ * @brief When to retry and how long to wait
+ */
+struct retry_policy {
+    /**
+     * @brief Attempts per request, including the first
+     */
+    uint32_t max_attempts{4};
+
+    /**
+     * @brief Shortest wait before a retry
+     */
+    std::chrono::milliseconds base_delay{100};
+
+    /**
+     * @brief Longest wait before a retry. A Retry-After longer than this
+     * ends the request instead of being waited out.
+     */
+    std::chrono::milliseconds max_delay{10000};
+
+    /**
+     * @brief Retries allowed per request sent, averaged over time. Each
+     * request adds this much to the retry budget and each retry spends 1, so
+     * 0.2 means at most one retry for every five requests once the budget's
+     * reserve is gone. This stops retries multiplying the load on a server
+     * which is already failing.
+     */
+    double budget_ratio{0.2};
+
+    /**
+     * @brief Retries the budget holds in reserve, and starts with
+     */
+    double budget_reserve{10};
+
+    /**
+     * @brief Retry POST and PATCH requests after errors which may have
+     * happened after the server acted on them. Off by default, since
+     * repeating them can send a message twice. They are always retried after
+     * a 429, and after a failure to connect, because the server cannot have
+     * seen the request.
+     */
+    bool retry_non_idempotent{false};
+};
+
+/**
+ * @brief When a circuit breaker opens and closes
+ */
+struct breaker_policy {
+    /**
+     * @brief Consecutive failures that open the breaker
+     */
+    uint32_t failure_threshold{5};
+
+    /**
+     * @brief How long the breaker stays open the first time
+     */
+    std::chrono::milliseconds open_for{5000};
+
+    /**
+     * @brief Longest the breaker stays open. Each time a probe fails the
+     * open period doubles, up to this.
+     */
+    std::chrono::milliseconds max_open_for{60000};
+
+    /**
+     * @brief Requests let through at once while half open
+     */
+    uint32_t half_open_probes{1};
+};
+
+/**
+ * @brief Settings for a retry_engine
+ */
+struct retry_config {
+    /**
+     * @brief Retry policy
+     */
+    retry_policy retry;
+
+    /**
+     * @brief Circuit breaker policy, applied to each key separately
+     */
+    breaker_policy breaker;
+
+    /**
+     * @brief If set, attempts made by rest() are posted through this queue
+     * instead of straight to lazy_rest()
+     */
+    fair_queue* queue{nullptr};
+
+    /**
+     * @brief Seed for the jitter, zero for a random seed
+     */
+    uint32_t seed{0};
+};
+
+/**
+ * @brief What one attempt came back with
+ */
+struct attempt_outcome {
+    /**
+     * @brief HTTP status, zero if there was no response
+     */
+    uint16_t status{0};
+
+    /**
+     * @brief Transport error, h_success if a response arrived
+     */
+    dpp::http_error error{dpp::h_success};
+
+    /**
+     * @brief Retry-After from the response, in seconds, zero if none
+     */
+    double retry_after{0};
+};
+
+/**
+ * @brief Why a request stopped being retried
+ */
+enum retry_stop : uint8_t {
+    /**
+     * @brief The last attempt succeeded
+     */
+    stop_success,
+
+    /**
+     * @brief The last attempt failed in a way retrying can't fix, e.g. a 404
+     */
+    stop_permanent,
+
+    /**
+     * @brief max_attempts were made
+     */
+    stop_attempts,
+
+    /**
+     * @brief The retry budget was spent
+     */
+    stop_budget,
+
+    /**
+     * @brief The request is not idempotent and may have been acted on
+     */
+    stop_not_idempotent,
+
+    /**
+     * @brief The Retry-After was longer than max_delay
+     */
+    stop_retry_after,
+
+    /**
+     * @brief The circuit breaker was open, so the attempt was not made
+     */
+    stop_breaker_open,
+};
+
+/**
+ * @brief How a request finished
+ */
+struct retry_result {
+    /**
+     * @brief Outcome of the last attempt. If the breaker refused the first
+     * attempt, the status is zero and the error h_canceled.
+     */
+    attempt_outcome last;
+
+    /**
+     * @brief Attempts made
+     */
+    uint32_t attempts{0};
+
+    /**
+     * @brief Why retrying stopped
+     */
+    retry_stop reason{stop_success};
+
+    /**
+     * @brief Time from the first attempt to the end, including waits
+     */
+    double ms{0};
+};
+
+/**
+ * @brief State of a circuit breaker
+ */
+enum breaker_state : uint8_t {
+    /**
+     * @brief Requests flow normally
+     */
+    breaker_closed,
+
+    /**
+     * @brief Requests fail at once without being sent
+     */
+    breaker_open,
+
+    /**
+     * @brief A few probe requests are let through to see if the target recovered
+     */
+    breaker_half_open,
+};
+
+/**
+ * @brief A snapshot of one circuit breaker
+ */
+struct breaker_info {
+    /**
+     * @brief Host or route the breaker guards
+     */
+    std::string key;
+
+    /**
+     * @brief Current state
+     */
+    breaker_state state{breaker_closed};
+
+    /**
+     * @brief Failures since the last success
+     */
+    uint32_t consecutive_failures{0};
+
+    /**
+     * @brief Times the breaker has opened
+     */
+    uint64_t opened{0};
+
+    /**
+     * @brief Requests refused while open
+     */
+    uint64_t rejected{0};
+
+    /**
+     * @brief Time until an open breaker lets a probe through
+     */
+    double retry_in_ms{0};
+};
+
+/**
+ * @brief Totals for a retry_engine
+ */
+struct retry_stats {
+    /**
+     * @brief Requests started
+     */
+    uint64_t requests{0};
+
+    /**
+     * @brief Attempts made, first attempts included
+     */
+    uint64_t attempts{0};
+
+    /**
+     * @brief Retries made
+     */
+    uint64_t retries{0};
+
+    /**
+     * @brief Requests whose last attempt succeeded
+     */
+    uint64_t succeeded{0};
+
+    /**
+     * @brief Requests which gave up after a retryable failure
+     */
+    uint64_t exhausted{0};
+
+    /**
+     * @brief Retries not made because the budget was spent
+     */
+    uint64_t budget_denied{0};
+
+    /**
+     * @brief Retries not made because the request was not idempotent
+     */
+    uint64_t not_idempotent{0};
+
+    /**
+     * @brief Attempts refused by an open breaker
+     */
+    uint64_t short_circuited{0};
+
+    /**
+     * @brief Retries currently waiting for their delay
+     */
+    uint32_t waiting{0};
+
+    /**
+     * @brief Retry budget left
+     */
+    double budget{0};
+};
+
+/**
+ * @brief Reports the outcome of an attempt; call exactly once
+ */
+using attempt_report_t = std::function<void(const attempt_outcome&)>;
+
+/**
+ * @brief Makes one attempt, numbered from 1, and reports its outcome
+ */
+using attempt_t = std::function<void(uint32_t attempt, attempt_report_t report)>;
+
+/**
+ * @brief Called once when a request has finished
+ */
+using retry_done_t = std::function<void(const retry_result&)>;
+
+/**
+ * @brief Retries failed HTTP requests, with a circuit breaker per host or route.
+ *
+ * D++ 10.0 makes each REST request once: a 502 from Cloudflare or a reset
+ * connection goes straight to the callback. Requests sent through this engine
+ * are retried when that is both useful and safe:
+ *
+ * - Connection and TLS handshake failures, 429 and 500/502/503/504 are
+ *   retried; other statuses are final. GET, PUT and DELETE are idempotent
+ *   and retried for any of these. POST and PATCH are only retried when the
+ *   server cannot have acted on them (a 429, a failed connect or a failed
+ *   TLS handshake), unless retry_non_idempotent is set.
+ * - The wait is "decorrelated jitter": a random time between base_delay and
+ *   three times the previous wait, capped at max_delay, or the Retry-After if
+ *   that is longer. Clients which failed together do not retry together.
+ * - A retry budget bounds retries to a fraction of traffic, so an outage
+ *   does not turn every request into max_attempts requests.
+ * - Each key (a route for rest(), a host for request()) has a circuit breaker.
+ *   After failure_threshold consecutive failures it opens and requests for that
+ *   key fail at once; after open_for it lets a probe through and closes again
+ *   if the probe succeeds. 429s and 4xx responses don't count as failures.
+ *
+ * Waits run on an io_loop. The engine must outlive the requests sent through it.
+ */
+class retry_engine {
+    struct breaker {
+        breaker_state state{breaker_closed};
+        uint32_t consecutive_failures{0};
+        uint32_t probes{0};
+        uint32_t reopened{0};
+        uint64_t opened{0};
+        uint64_t rejected{0};
+        std::chrono::steady_clock::time_point open_until{};
+    };
+
+    struct request_state;
+
+    io_loop& loop;
+    retry_config config;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, breaker> breakers;
+    std::mt19937_64 random;
+    double budget;
+    retry_stats counters;
+
+    bool admit(const std::string& key);
+    void record(const std::string& key, const attempt_outcome& outcome);
+    void start_attempt(const std::shared_ptr<request_state>& r);
+    void on_outcome(const std::shared_ptr<request_state>& r, const attempt_outcome& outcome);
+    void finish(const std::shared_ptr<request_state>& r, retry_stop reason);
+
+public:
+    /**
+     * @brief Create an engine
+     * @param io loop to wait on. It must outlive the engine.
+     * @param cfg settings
+     */
+    retry_engine(io_loop& io, const retry_config& cfg = {});
+
+    /**
+     * @brief Run a request with retries. This is the general form; rest() and
+     * request() are built on it.
+     * @param key host or route whose breaker guards the request
+     * @param method HTTP method, to decide whether retrying is safe
+     * @param attempt makes one attempt and reports its outcome
+     * @param done called once with the result
+     */
+    void run(const std::string& key, dpp::http_method method, attempt_t attempt, retry_done_t done);
+
+    /**
+     * @brief Send a Discord API request with retries, like lazy_rest(). The
+     * callback gets the result of the last attempt. The breaker key is the
+     * endpoint, e.g. API_PATH "/channels".
+     * @param bot cluster
+     * @param request request from rest_request_pool()
+     */
+    void rest(dpp::cluster& bot, rest_request_ptr request);
+
+    /**
+     * @brief Make an HTTP request with retries, like dpp::cluster::request().
+     * The breaker key is the scheme, host and port of the URL.
+     * @param bot cluster
+     * @param url URL, http or https
+     * @param method method
+     * @param callback called with the response to the last attempt
+     * @param postdata body
+     * @param mimetype body content type
+     * @param headers request headers
+     */
+    void request(dpp::cluster& bot, const std::string& url, dpp::http_method method, dpp::http_completion_event callback, const std::string& postdata = "", const std::string& mimetype = "text/plain", const std::multimap<std::string, std::string>& headers = {});
+
+    /**
+     * @brief Returns true if a method may be repeated without changing the result
+     * @param method method
+     */
+    static bool idempotent(dpp::http_method method);
+
+    /**
+     * @brief Returns true if an outcome is worth retrying at all
+     * @param outcome outcome
+     */
+    static bool retryable(const attempt_outcome& outcome);
+
+    /**
+     * @brief State of the breaker for a key; closed if the key is unknown
+     * @param key host or route
+     */
+    breaker_state state(const std::string& key) const;
+
+    /**
+     * @brief Every breaker the engine has created
+     */
+    std::vector<breaker_info> breaker_states() const;
+
+    /**
+     * @brief Totals
+     */
+    retry_stats stats() const;
+};
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace mybot {
+
+/**
+ * @brief A vector which stores up to N elements inline, only going to the heap
+ * when it grows past that.
+ *
+ * Lists like a member's roles or a message's role mentions are nearly always
+ * a handful of entries, and an std::vector costs a heap allocation for each of
+ * them. The interface is the subset of std::vector the bot uses, so it can be
+ * swapped in without touching the code which reads it.
+ *
+ * @tparam T element type
+ * @tparam N inline capacity
+ */
+template<typename T, size_t N> class small_vector {
+    static_assert(N > 0, "small_vector needs an inline capacity of at least one");
+
+    uint32_t count{0};
+    uint32_t cap{N};
+    union {
+        T* heap;
+        alignas(T) unsigned char buffer[N * sizeof(T)];
+    } storage;
+
+    /* The heap pointer shares space with the inline buffer, so the
+     * capacity is what tells us which one is live.
+     */
+    bool is_inline() const noexcept {
+        return cap <= N;
+    }
+
+    T* ptr() noexcept {
+        return is_inline() ? std::launder(reinterpret_cast<T*>(storage.buffer)) : storage.heap;
+    }
+
+    const T* ptr() const noexcept {
+        return is_inline() ? std::launder(reinterpret_cast<const T*>(storage.buffer)) : storage.heap;
+    }
+
+    void grow(size_t min_capacity) {
+        size_t new_cap = std::max<size_t>(min_capacity, cap * 2);
+        T* fresh = static_cast<T*>(::operator new(new_cap * sizeof(T)));
+        T* old = ptr();
+        for (size_t i = 0; i < count; ++i) {
+            new (fresh + i) T(std::move_if_noexcept(old[i]));
+            old[i].~T();
+        }
+        if (!is_inline()) {
+            ::operator delete(old);
+        }
+        storage.heap = fresh;
+        cap = static_cast<uint32_t>(new_cap);
+    }
+
+    void release() noexcept {
+        clear();
+        if (!is_inline()) {
+            ::operator delete(storage.heap);
+        }
+        cap = N;
+    }
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    small_vector() noexcept {
+    }
+
+    small_vector(std::initializer_list<T> init) : small_vector() {
+        assign(init.begin(), init.end());
+    }
+
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category> small_vector(It first, It last) : small_vector() {
+        assign(first, last);
+    }
+
+    small_vector(const small_vector& other) : small_vector() {
+        assign(other.begin(), other.end());
+    }
+
+    small_vector(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) : small_vector() {
+        *this = std::move(other);
+    }
+
+    ~small_vector() {
+        release();
+    }
+
+    small_vector& operator=(const small_vector& other) {
+        if (this != &other) {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    small_vector& operator=(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this == &other) {
+            return *this;
+        }
+        release();
+        if (!other.is_inline()) {
+            /* Steal the heap block */
+            storage.heap = other.storage.heap;
+            count = other.count;
+            cap = other.cap;
+            other.count = 0;
+            other.cap = N;
+        } else {
+            T* dest = ptr();
+            T* src = other.ptr();
+            for (size_t i = 0; i < other.count; ++i) {
+                new (dest + i) T(std::move(src[i]));
+            }
+            count = other.count;
+            other.clear();
+        }
+        return *this;
+    }
+
+    template<typename It> void assign(It first, It last) {
+        clear();
+        size_t n = static_cast<size_t>(std::distance(first, last));
+        reserve(n);
+        for (; first != last; ++first) {
+            new (ptr() + count) T(*first);
+            ++count;
+        }
+    }
+
+    void reserve(size_t n) {
+        if (n > cap) {
+            grow(n);
+        }
+    }
+
+    template<typename... Args> T& emplace_back(Args&&... args) {
+        if (count == cap) {
+            grow(count + 1);
+        }
+        T* slot = new (ptr() + count) T(std::forward<Args>(args)...);
+        ++count;
+        return *slot;
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    void pop_back() {
+        ptr()[--count].~T();
+    }
+
+    iterator erase(const_iterator pos) {
+        T* at = ptr() + (pos - ptr());
+        std::move(at + 1, ptr() + count, at);
+        pop_back();
+        return at;
+    }
+
+    void clear() noexcept {
+        T* p = ptr();
+        for (size_t i = 0; i < count; ++i) {
+            p[i].~T();
+        }
+        count = 0;
+    }
+
+    T& operator[](size_t i) noexcept {
+        return ptr()[i];
+    }
+
+    const T& operator[](size_t i) const noexcept {
+        return ptr()[i];
+    }
+
+    T& at(size_t i) {
+        if (i >= count) {
+            throw std::out_of_range("small_vector::at");
+        }
+        return ptr()[i];
+    }
+
+    const T& at(size_t i) const {
+        if (i >= count) {
+            throw std::out_of_range("small_vector::at");
+        }
+        return ptr()[i];
+    }
+
+    T& front() noexcept { return ptr()[0]; }
+    const T& front() const noexcept { return ptr()[0]; }
+    T& back() noexcept { return ptr()[count - 1]; }
+    const T& back() const noexcept { return ptr()[count - 1]; }
+    T* data() noexcept { return ptr(); }
+    const T* data() const noexcept { return ptr(); }
+    iterator begin() noexcept { return ptr(); }
+    iterator end() noexcept { return ptr() + count; }
+    const_iterator begin() const noexcept { return ptr(); }
+    const_iterator end() const noexcept { return ptr() + count; }
+    size_t size() const noexcept { return count; }
+    size_t capacity() const noexcept { return cap; }
+    bool empty() const noexcept { return count == 0; }
+
+    /**
+     * @brief True if the elements are held in the inline buffer, i.e. no heap
+     * allocation has been made
+     */
+    bool is_small() const noexcept { return is_inline(); }
+
+    bool operator==(const small_vector& other) const {
+        return count == other.count && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const small_vector& other) const {
+        return !(*this == other);
+    }
+};
+
+}
@@ -0,0 +1,320 @@
+#include "standin_server.h"
+#include <future>
+
+namespace mybot {
+
+namespace {
+
+/* Requests larger than this are dropped rather than buffered */
+constexpr size_t max_request = 1024 * 1024;
+
+const char* reason_phrase(uint16_t status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Unknown";
+    }
+}
+
+}
+
+struct standin_server::connection {
+    dpp::socket fd{INVALID_SOCKET};
+    std::string in;
+    std::string out;
+    size_t sent{0};
+    bool answered{false};
+};
+
+standin_server::standin_server(io_loop& io, standin_handler_t h, uint16_t port) : loop(io), handler(std::move(h)), alive(std::make_shared<bool>(true)) {
+    net_init();
+    ip_address address;
+    ip_address::parse("127.0.0.1", port, address);
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int one = 1;
+    if (listen_fd == INVALID_SOCKET
+        || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one)) != 0
+        || ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address.addr), address.len) != 0
+        || ::listen(listen_fd, 128) != 0
+        || !set_nonblocking(listen_fd)) {
+        int err = last_socket_error();
+        if (listen_fd != INVALID_SOCKET) {
+            close_socket(listen_fd);
+        }
+        throw dpp::connection_exception("standin_server: can't listen on port " + std::to_string(port) + " (error " + std::to_string(err) + ")");
+    }
+    ip_address bound;
+    bound.len = sizeof(bound.addr);
+    getsockname(listen_fd, reinterpret_cast<sockaddr*>(&bound.addr), &bound.len);
+    bound_port = bound.get_port();
+
+    io_events e;
+    e.fd = listen_fd;
+    e.flags = WANT_READ;
+    e.on_read = [this](dpp::socket) {
+        accept_all();
+    };
+    loop.add(e);
+}
+
+standin_server::~standin_server() {
+    auto cleanup = [this] {
+        loop.remove(listen_fd);
+        close_socket(listen_fd);
+        for (auto& [fd, c] : connections) {
+            loop.remove(fd);
+            close_socket(fd);
+        }
+        connections.clear();
+        alive.reset();
+    };
+    if (loop.in_loop_thread()) {
+        cleanup();
+    } else {
+        /* Delayed responses check alive on the loop thread, so tear down there */
+        std::promise<void> done;
+        loop.post([&] {
+            cleanup();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+uint16_t standin_server::port() const {
+    return bound_port;
+}
+
+std::string standin_server::url() const {
+    return "http://127.0.0.1:" + std::to_string(bound_port);
+}
+
+void standin_server::set_faults(const standin_faults& f) {
+    std::lock_guard<std::mutex> lock(mutex);
+    faults = f;
+    faults_from = counters.requests;
+    random.seed(f.seed);
+}
+
+standin_stats standin_server::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void standin_server::accept_all() {
+    for (;;) {
+        dpp::socket fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd == INVALID_SOCKET) {
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close_socket(fd);
+            continue;
+        }
+        auto c = std::make_shared<connection>();
+        c->fd = fd;
+        connections[fd] = c;
+        io_events e;
+        e.fd = fd;
+        e.flags = WANT_READ;
+        e.on_read = [this, c](dpp::socket) {
+            on_readable(c);
+        };
+        e.on_write = [this, c](dpp::socket) {
+            flush(c);
+        };
+        e.on_error = [this, c](dpp::socket, int) {
+            drop(c, false);
+        };
+        loop.add(e);
+    }
+}
+
+void standin_server::on_readable(const std::shared_ptr<connection>& c) {
+    char buffer[16384];
+    for (;;) {
+        auto r = ::recv(c->fd, buffer, sizeof(buffer), 0);
+        if (r > 0) {
+            c->in.append(buffer, static_cast<size_t>(r));
+            continue;
+        }
+        if (r < 0 && error_is_transient(last_socket_error())) {
+            break;
+        }
+        /* Closed by the client, or a hard error */
+        drop(c, false);
+        return;
+    }
+    if (c->answered) {
+        return;
+    }
+    size_t end = c->in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c->in.size() > max_request) {
+            drop(c, true);
+        }
+        return;
+    }
+    std::string_view head(c->in.data(), end);
+    size_t eol = head.find("\r\n");
+    std::string_view request_line = head.substr(0, eol);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = request_line.find(' ', sp1 == std::string_view::npos ? sp1 : sp1 + 1);
+    if (sp1 == std::string_view::npos || sp2 == std::string_view::npos) {
+        drop(c, true);
+        return;
+    }
+    standin_request request;
+    request.method = std::string(request_line.substr(0, sp1));
+    request.path = std::string(request_line.substr(sp1 + 1, sp2 - sp1 - 1));
+    request.headers = flat_headers::parse(eol == std::string_view::npos ? std::string_view() : head.substr(eol + 2));
+    uint64_t length = request.headers.get_uint(hdr_content_length);
+    if (length > max_request) {
+        drop(c, true);
+        return;
+    }
+    if (c->in.size() < end + 4 + length) {
+        return;
+    }
+    request.body = c->in.substr(end + 4, length);
+    c->answered = true;
+    dispatch(c, std::move(request));
+}
+
+void standin_server::dispatch(const std::shared_ptr<connection>& c, standin_request&& request) {
+    enum { handle, reset, rate_limit, error } action = handle;
+    std::chrono::milliseconds delay{0};
+    standin_faults f;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        f = faults;
+        std::uniform_real_distribution<double> chance(0, 1);
+        uint64_t nth = counters.requests++ - faults_from;
+        double draw = chance(random);
+        if (nth < f.fail_first) {
+            action = error;
+        } else if (draw < f.reset_rate) {
+            action = reset;
+        } else if (draw < f.reset_rate + f.rate_limit_rate) {
+            action = rate_limit;
+        } else if (draw < f.reset_rate + f.rate_limit_rate + f.error_rate) {
+            action = error;
+        }
+        if (chance(random) < f.delay_rate) {
+            delay = f.delay;
+            counters.delayed++;
+        }
+        switch (action) {
+            case handle: counters.handled++; break;
+            case reset: counters.resets++; break;
+            case rate_limit: counters.rate_limited++; break;
+            case error: counters.errors++; break;
+        }
+    }
+
+    auto finish = [this, c, action, f, request = std::move(request)] {
+        if (action == reset) {
+            drop(c, true);
+            return;
+        }
+        standin_response response;
+        if (action == rate_limit) {
+            std::string seconds = std::to_string(f.retry_after);
+            response.status = 429;
+            response.body = "{\"message\":\"You are being rate limited.\",\"retry_after\":" + seconds + ",\"global\":false}";
+            response.headers.emplace_back("Retry-After", seconds);
+            response.headers.emplace_back("X-RateLimit-Remaining", "0");
+            response.headers.emplace_back("X-RateLimit-Reset-After", seconds);
+        } else if (action == error) {
+            response.status = f.error_status;
+            response.body = "{\"message\":\"injected fault\",\"code\":0}";
+        } else if (handler) {
+            response = handler(request);
+        }
+        respond(c, response);
+    };
+    if (delay.count() > 0) {
+        std::weak_ptr<bool> live = alive;
+        loop.after(delay, [live, finish = std::move(finish)] {
+            if (live.lock()) {
+                finish();
+            }
+        });
+    } else {
+        finish();
+    }
+}
+
+void standin_server::respond(const std::shared_ptr<connection>& c, const standin_response& response) {
+    if (c->fd == INVALID_SOCKET) {
+        return;
+    }
+    std::string& out = c->out;
+    out.reserve(160 + response.body.size());
+    out += "HTTP/1.1 ";
+    out += std::to_string(response.status);
+    out += ' ';
+    out += reason_phrase(response.status);
+    out += "\r\nContent-Type: ";
+    out += response.content_type;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(response.body.size());
+    out += "\r\nConnection: close\r\n";
+    for (const auto& [name, value] : response.headers) {
+        out += name;
+        out += ": ";
+        out += value;
+        out += "\r\n";
+    }
+    out += "\r\n";
+    out += response.body;
+    flush(c);
+}
+
+void standin_server::flush(const std::shared_ptr<connection>& c) {
+    while (c->sent < c->out.size()) {
+        auto w = ::send(c->fd, c->out.data() + c->sent, static_cast<int>(c->out.size() - c->sent), send_flags);
+        if (w > 0) {
+            c->sent += static_cast<size_t>(w);
+            continue;
+        }
+        if (w < 0 && error_is_transient(last_socket_error())) {
+            loop.set_flags(c->fd, WANT_READ | WANT_WRITE);
+            return;
+        }
+        drop(c, false);
+        return;
+    }
+    if (!c->out.empty()) {
+        drop(c, false);
+    }
+}
+
+void standin_server::drop(const std::shared_ptr<connection>& c, bool reset) {
+    if (c->fd == INVALID_SOCKET) {
+        return;
+    }
+    if (reset) {
+        /* A zero linger time makes close() send RST instead of FIN */
+        linger l{};
+        l.l_onoff = 1;
+        l.l_linger = 0;
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&l), sizeof(l));
+    }
+    loop.remove(c->fd);
+    close_socket(c->fd);
+    connections.erase(c->fd);
+    c->fd = INVALID_SOCKET;
+}
+
+}
@@ -0,0 +1,222 @@
+#pragma once
+#include "http_headers.h"
+#include "io_loop.h"
+#include <random>
+
+namespace mybot {
+
+/**
+ * @brief A request received by a standin_server
+ */
+struct standin_request {
+    /**
+     * @brief Method, e.g. "GET"
+     */
+    std::string method;
+
+    /**
+     * @brief Path and query string
+     */
+    std::string path;
+
+    /**
+     * @brief Request headers
+     */
+    flat_headers headers;
+
+    /**
+     * @brief Request body
+     */
+    std::string body;
+};
+
+/**
+ * @brief A response from a standin_server handler
+ */
+struct standin_response {
+    /**
+     * @brief HTTP status
+     */
+    uint16_t status{200};
+
+    /**
+     * @brief Content type of the body
+     */
+    std::string content_type{"application/json"};
+
+    /**
+     * @brief Response body
+     */
+    std::string body{"{}"};
+
+    /**
+     * @brief Extra headers, e.g. rate limit headers
+     */
+    std::vector<std::pair<std::string, std::string>> headers;
+};
+
+/**
+ * @brief Builds the response to a request. Runs on the loop thread.
+ */
+using standin_handler_t = std::function<standin_response(const standin_request&)>;
+
+/**
+ * @brief Faults a standin_server injects. Each request draws once: it is
+ * reset, rate limited, answered with error_status, or handled normally, in
+ * that order of precedence, and independently may be delayed first.
+ */
+struct standin_faults {
+    /**
+     * @brief The first this many requests get error_status, whatever the rates
+     */
+    uint32_t fail_first{0};
+
+    /**
+     * @brief Chance of closing the connection without a response (0 to 1)
+     */
+    double reset_rate{0};
+
+    /**
+     * @brief Chance of a 429 with Retry-After (0 to 1)
+     */
+    double rate_limit_rate{0};
+
+    /**
+     * @brief Retry-After sent with injected 429s, in seconds
+     */
+    double retry_after{0.1};
+
+    /**
+     * @brief Chance of answering with error_status (0 to 1)
+     */
+    double error_rate{0};
+
+    /**
+     * @brief Status sent for injected errors
+     */
+    uint16_t error_status{503};
+
+    /**
+     * @brief Chance of holding the response back by delay (0 to 1)
+     */
+    double delay_rate{0};
+
+    /**
+     * @brief How long delayed responses are held back
+     */
+    std::chrono::milliseconds delay{0};
+
+    /**
+     * @brief Seed for the fault draws, so a run can be repeated
+     */
+    uint32_t seed{1};
+};
+
+/**
+ * @brief What a standin_server has done
+ */
+struct standin_stats {
+    /**
+     * @brief Requests received
+     */
+    uint64_t requests{0};
+
+    /**
+     * @brief Requests answered by the handler
+     */
+    uint64_t handled{0};
+
+    /**
+     * @brief Injected error responses
+     */
+    uint64_t errors{0};
+
+    /**
+     * @brief Injected connection resets
+     */
+    uint64_t resets{0};
+
+    /**
+     * @brief Injected 429 responses
+     */
+    uint64_t rate_limited{0};
+
+    /**
+     * @brief Delayed responses
+     */
+    uint64_t delayed{0};
+};
+
+/**
+ * @brief A minimal plain HTTP/1.1 server on an io_loop, standing in for a
+ * remote API so that clients can be run against injected faults.
+ *
+ * It listens on a loopback port, reads one request per connection (bodies
+ * need a Content-Length), answers with `Connection: close` and closes. That
+ * is all the HTTP D++'s own client and the bot's tooling need; it is not a
+ * general purpose web server and must never listen on a public address.
+ */
+class standin_server {
+    struct connection;
+
+    io_loop& loop;
+    dpp::socket listen_fd{INVALID_SOCKET};
+    uint16_t bound_port{0};
+    mutable std::mutex mutex;
+    standin_handler_t handler;
+    standin_faults faults;
+    standin_stats counters;
+    uint64_t faults_from{0};
+    std::mt19937 random;
+    /* Only touched on the loop thread */
+    std::unordered_map<dpp::socket, std::shared_ptr<connection>> connections;
+    std::shared_ptr<bool> alive;
+
+    void accept_all();
+    void on_readable(const std::shared_ptr<connection>& c);
+    void dispatch(const std::shared_ptr<connection>& c, standin_request&& request);
+    void respond(const std::shared_ptr<connection>& c, const standin_response& response);
+    void flush(const std::shared_ptr<connection>& c);
+    void drop(const std::shared_ptr<connection>& c, bool reset);
+
+public:
+    /**
+     * @brief Start listening
+     * @param io loop to serve on. It must outlive the server.
+     * @param handler builds responses; without one every request gets 200 and "{}"
+     * @param port loopback port, or zero to pick a free one (see port())
+     * @throw dpp::connection_exception if the port can't be bound
+     */
+    standin_server(io_loop& io, standin_handler_t handler = {}, uint16_t port = 0);
+
+    /**
+     * @brief Stop listening and close every connection
+     */
+    ~standin_server();
+
+    standin_server(const standin_server&) = delete;
+    standin_server& operator=(const standin_server&) = delete;
+
+    /**
+     * @brief Port the server is listening on
+     */
+    uint16_t port() const;
+
+    /**
+     * @brief Base URL, e.g. "http://127.0.0.1:40123"
+     */
+    std::string url() const;
+
+    /**
+     * @brief Replace the faults to inject. Counting for fail_first starts again.
+     * @param f faults
+     */
+    void set_faults(const standin_faults& f);
+
+    /**
+     * @brief Counters
+     */
+    standin_stats stats() const;
+};
+
+}
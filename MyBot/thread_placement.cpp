@@ -0,0 +1,224 @@
+#include "thread_placement.h"
+#include "trace.h"
+#include "watchdog.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mybot {
+
+namespace {
+
+uint32_t parse_cpu(std::string_view s, std::string_view spec) {
+    if (s.empty() || s.size() > 5 || !std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        throw dpp::parse_exception("Invalid CPU list: " + std::string(spec));
+    }
+    uint32_t n = 0;
+    for (char c : s) {
+        n = n * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return n;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+#ifdef _WIN32
+/* Windows numbers CPUs within each processor group; count across them */
+bool to_group(uint32_t cpu, WORD& group, uint32_t& bit) {
+    WORD groups = GetActiveProcessorGroupCount();
+    uint32_t base = 0;
+    for (WORD g = 0; g < groups; ++g) {
+        uint32_t count = GetActiveProcessorCount(g);
+        if (cpu < base + count) {
+            group = g;
+            bit = cpu - base;
+            return true;
+        }
+        base += count;
+    }
+    return false;
+}
+#endif
+
+}
+
+cpu_list parse_cpu_list(std::string_view spec) {
+    cpu_list cpus;
+    std::string_view rest = spec;
+    while (!trim(rest).empty()) {
+        size_t comma = rest.find(',');
+        std::string_view item = trim(rest.substr(0, comma));
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+        size_t dash = item.find('-');
+        uint32_t first = parse_cpu(trim(item.substr(0, dash)), spec);
+        uint32_t last = dash == std::string_view::npos ? first : parse_cpu(trim(item.substr(dash + 1)), spec);
+        if (last < first) {
+            throw dpp::parse_exception("Invalid CPU list: " + std::string(spec));
+        }
+        for (uint32_t cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+thread_placement parse_placement(std::string_view spec) {
+    thread_placement placement;
+    std::string_view rest = spec;
+    while (!trim(rest).empty()) {
+        size_t semicolon = rest.find(';');
+        std::string_view item = trim(rest.substr(0, semicolon));
+        rest = semicolon == std::string_view::npos ? std::string_view() : rest.substr(semicolon + 1);
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            throw dpp::parse_exception("Invalid thread placement: " + std::string(spec));
+        }
+        std::string_view group = trim(item.substr(0, equals));
+        std::string_view cpus = trim(item.substr(equals + 1));
+        if (group == "io") {
+            placement.io = parse_cpu_list(cpus);
+        } else if (group == "shards") {
+            if (cpus.size() >= 2 && cpus.substr(cpus.size() - 2) == "/1") {
+                placement.shard_per_cpu = true;
+                cpus.remove_suffix(2);
+            }
+            placement.shards = parse_cpu_list(cpus);
+        } else if (group == "voice") {
+            placement.voice = parse_cpu_list(cpus);
+        } else if (group == "pool") {
+            placement.pool = parse_cpu_list(cpus);
+        } else {
+            throw dpp::parse_exception("Unknown thread group in placement: " + std::string(group));
+        }
+    }
+    return placement;
+}
+
+bool pin_thread(std::thread::native_handle_type thread, const cpu_list& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+#ifdef _WIN32
+    GROUP_AFFINITY affinity{};
+    bool found = false;
+    for (uint32_t cpu : cpus) {
+        WORD group;
+        uint32_t bit;
+        if (!to_group(cpu, group, bit)) {
+            continue;
+        }
+        if (!found) {
+            affinity.Group = group;
+            found = true;
+        }
+        if (group == affinity.Group) {
+            affinity.Mask |= static_cast<KAFFINITY>(1) << bit;
+        }
+    }
+    return found && SetThreadGroupAffinity(static_cast<HANDLE>(thread), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool pin_this_thread(const cpu_list& cpus) {
+#ifdef _WIN32
+    return pin_thread(GetCurrentThread(), cpus);
+#else
+    return pin_thread(pthread_self(), cpus);
+#endif
+}
+
+bool name_thread(std::thread::native_handle_type thread, const std::string& name) {
+#ifdef _WIN32
+    /* Looked up at run time, as older Windows lacks it */
+    using set_description_t = HRESULT(WINAPI*)(HANDLE, PCWSTR);
+    static const auto set_description = reinterpret_cast<set_description_t>(
+        reinterpret_cast<void*>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription")));
+    if (set_description == nullptr) {
+        return false;
+    }
+    std::wstring wide(name.begin(), name.end());
+    return SUCCEEDED(set_description(static_cast<HANDLE>(thread), wide.c_str()));
+#elif defined(__linux__)
+    return pthread_setname_np(thread, name.substr(0, 15).c_str()) == 0;
+#else
+    return false;
+#endif
+}
+
+void name_this_thread(const std::string& name) {
+#ifdef _WIN32
+    name_thread(GetCurrentThread(), name);
+#else
+    name_thread(pthread_self(), name);
+#endif
+    trace_thread_name(name);
+    watchdog_thread_name(name);
+}
+
+void place(io_loop& io, const cpu_list& cpus, const std::string& name) {
+    io.post([cpus, name] {
+        pin_this_thread(cpus);
+        name_this_thread(name);
+    });
+}
+
+void place(dpp::cluster& bot, const thread_placement& placement) {
+    /* Ready is dispatched on the shard's own thread, and again after each
+     * full reconnect, which is harmless
+     */
+    bot.on_ready([&bot, placement](const dpp::ready_t& event) {
+        if (event.from == nullptr) {
+            return;
+        }
+        uint32_t shard = event.from->shard_id;
+        if (!placement.shards.empty()) {
+            cpu_list cpus = placement.shards;
+            if (placement.shard_per_cpu) {
+                cpus = {placement.shards[shard % placement.shards.size()]};
+            }
+            if (!pin_this_thread(cpus)) {
+                bot.log(dpp::ll_warning, "Can't pin shard " + std::to_string(shard) + " to its CPUs");
+            }
+        }
+        name_this_thread("shard " + std::to_string(shard));
+    });
+    bot.on_voice_ready([&bot, placement](const dpp::voice_ready_t& event) {
+        if (event.voice_client == nullptr) {
+            return;
+        }
+        if (!placement.voice.empty() && !pin_thread(event.voice_client->thread_id, placement.voice)) {
+            bot.log(dpp::ll_warning, "Can't pin a voice client to its CPUs");
+        }
+        name_thread(event.voice_client->thread_id, "voice " + event.voice_client->server_id.str());
+    });
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "io_loop.h"
+#include <string_view>
+
+namespace mybot {
+
+/**
+ * @brief Logical CPU numbers, counted across every processor group on Windows
+ * and as the kernel numbers them on Linux
+ */
+using cpu_list = std::vector<uint32_t>;
+
+/**
+ * @brief Parse a CPU list in the form Linux uses, e.g. "0-7,32-39"
+ * @param spec list; empty for none
+ * @return CPUs, sorted without duplicates
+ * @throw dpp::parse_exception if spec is malformed
+ */
+cpu_list parse_cpu_list(std::string_view spec);
+
+/**
+ * @brief Where the bot's threads run. An empty list leaves those threads to
+ * the scheduler.
+ */
+struct thread_placement {
+    /**
+     * @brief CPUs for io_loop threads
+     */
+    cpu_list io;
+
+    /**
+     * @brief CPUs for shard threads, which in D++ 10.0 are each their own
+     * socket reactor and also run the event handlers
+     */
+    cpu_list shards;
+
+    /**
+     * @brief If true, shard N runs on shards[N % shards.size()] alone rather
+     * than anywhere in the list
+     */
+    bool shard_per_cpu{false};
+
+    /**
+     * @brief CPUs for voice client threads
+     */
+    cpu_list voice;
+
+    /**
+     * @brief CPUs for work_pool workers; copy into work_pool_config::cpus
+     */
+    cpu_list pool;
+};
+
+/**
+ * @brief Parse a placement such as "io=0;shards=2-15;voice=1;pool=16-31".
+ * Appending "/1" to shards, as in "shards=2-15/1", sets shard_per_cpu.
+ * @param spec placement; empty for none
+ * @return placement
+ * @throw dpp::parse_exception if spec is malformed or names an unknown group
+ */
+thread_placement parse_placement(std::string_view spec);
+
+/**
+ * @brief Restrict a thread to some CPUs.
+ *
+ * On Windows a thread's affinity lies within one processor group of at most
+ * 64 CPUs, so only the CPUs in the same group as the first listed are used.
+ * @param thread native handle, e.g. std::thread::native_handle()
+ * @param cpus CPUs
+ * @return false if cpus is empty or unsupported, or the system refused
+ */
+bool pin_thread(std::thread::native_handle_type thread, const cpu_list& cpus);
+
+/**
+ * @brief Restrict the calling thread to some CPUs. Memory the thread first
+ * touches afterwards, such as its stack and thread local arenas, is then
+ * allocated on the CPUs' NUMA node by both Windows and Linux.
+ * @param cpus CPUs
+ * @return false if cpus is empty or unsupported, or the system refused
+ */
+bool pin_this_thread(const cpu_list& cpus);
+
+/**
+ * @brief Name a thread for debuggers and profilers. Linux keeps the first 15
+ * characters; Windows needs 10 1607 or later.
+ * @param thread native handle
+ * @param name name
+ * @return false if the name could not be set
+ */
+bool name_thread(std::thread::native_handle_type thread, const std::string& name);
+
+/**
+ * @brief Name the calling thread for debuggers and profilers, and in traces
+ * and stall reports
+ * @param name name
+ */
+void name_this_thread(const std::string& name);
+
+/**
+ * @brief Pin and name an io_loop's thread, from the loop itself
+ * @param io loop
+ * @param cpus CPUs, or empty to only name it
+ * @param name name
+ */
+void place(io_loop& io, const cpu_list& cpus, const std::string& name);
+
+/**
+ * @brief Pin and name each shard thread when its shard becomes ready, and
+ * each voice client thread when it connects. Call before starting the cluster.
+ *
+ * D++ 10.0 starts its REST, thread pool and voice courier threads privately,
+ * so they can't be placed; a process wide affinity still bounds them.
+ * placement.pool is not used here; copy it into the work_pool_config::cpus
+ * of any work_pool that should honour it.
+ * @param bot cluster
+ * @param placement placement, copied
+ */
+void place(dpp::cluster& bot, const thread_placement& placement);
+
+}
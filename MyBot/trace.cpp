@@ -0,0 +1,308 @@
+#include "trace.h"
+#include <dpp/dpp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mybot {
+
+std::atomic<bool> tracing_on{false};
+
+namespace {
+
+/* One record in a thread's ring. 'X' is a span on the thread, 's' the start
+ * of a flow arrow, 'A' an async span expanded to a begin and end when dumped.
+ */
+struct trace_record {
+    char phase{'X'};
+    const char* name{""};
+    const char* category{""};
+    int64_t ts{0};
+    int64_t dur{0};
+    uint64_t id{0};
+    uint64_t cause{0};
+    uint32_t status{0};
+    char detail[48]{};
+};
+
+/* Written only by its own thread; the lock is uncontended except while a
+ * dump copies it out
+ */
+struct trace_buffer {
+    std::mutex mutex;
+    std::vector<trace_record> ring;
+    uint64_t written{0};
+    uint64_t generation{0};
+    uint32_t tid{0};
+    std::string thread_name;
+};
+
+std::mutex buffers_mutex;
+std::vector<std::shared_ptr<trace_buffer>> buffers;
+size_t capacity{16384};
+uint32_t next_tid{1};
+std::atomic<uint64_t> generation{0};
+std::atomic<uint64_t> next_id{1};
+
+thread_local std::shared_ptr<trace_buffer> local;
+thread_local uint64_t current_cause{0};
+
+const auto epoch = std::chrono::steady_clock::now();
+
+void copy_detail(char (&out)[48], std::string_view detail) {
+    size_t length = std::min(detail.size(), sizeof(out) - 1);
+    if (length > 0) {
+        memcpy(out, detail.data(), length);
+    }
+    out[length] = 0;
+}
+
+trace_buffer& local_buffer() {
+    if (!local) {
+        local = std::make_shared<trace_buffer>();
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        local->tid = next_tid++;
+        buffers.push_back(local);
+    }
+    return *local;
+}
+
+void record(const trace_record& r) {
+    trace_buffer& b = local_buffer();
+    uint64_t current = generation.load(std::memory_order_acquire);
+    std::lock_guard<std::mutex> lock(b.mutex);
+    if (b.generation != current) {
+        size_t size;
+        {
+            std::lock_guard<std::mutex> global(buffers_mutex);
+            size = capacity;
+        }
+        b.ring.assign(size, trace_record{});
+        b.written = 0;
+        b.generation = current;
+    }
+    b.ring[b.written % b.ring.size()] = r;
+    b.written++;
+}
+
+nlohmann::json event_json(const trace_record& r, const char* phase, uint32_t tid) {
+    nlohmann::json e;
+    e["ph"] = phase;
+    e["name"] = r.name;
+    e["cat"] = r.category;
+    e["ts"] = r.ts;
+    e["pid"] = 1;
+    e["tid"] = tid;
+    nlohmann::json args = nlohmann::json::object();
+    if (r.detail[0] != 0) {
+        args["detail"] = r.detail;
+    }
+    if (r.cause != 0) {
+        args["cause"] = r.cause;
+    }
+    if (r.status != 0) {
+        args["status"] = r.status;
+    }
+    if (!args.empty()) {
+        e["args"] = args;
+    }
+    return e;
+}
+
+nlohmann::json flow_json(const char* phase, uint64_t id, int64_t ts, uint32_t tid) {
+    nlohmann::json e;
+    e["ph"] = phase;
+    e["name"] = "cause";
+    e["cat"] = "flow";
+    e["id"] = id;
+    e["ts"] = ts;
+    e["pid"] = 1;
+    e["tid"] = tid;
+    if (phase[0] == 'f') {
+        e["bp"] = "e";
+    }
+    return e;
+}
+
+}
+
+void tracing_start(size_t records_per_thread) {
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        capacity = std::max<size_t>(records_per_thread, 16);
+        /* Buffers only this list still holds belong to threads which have exited */
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const std::shared_ptr<trace_buffer>& b) {
+            return b.use_count() == 1;
+        }), buffers.end());
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    tracing_on.store(true, std::memory_order_relaxed);
+}
+
+void tracing_stop() {
+    tracing_on.store(false, std::memory_order_relaxed);
+}
+
+void trace_thread_name(const std::string& name) {
+    trace_buffer& b = local_buffer();
+    std::lock_guard<std::mutex> lock(b.mutex);
+    b.thread_name = name;
+}
+
+int64_t trace_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+uint64_t trace_current_cause() {
+    return current_cause;
+}
+
+std::string trace_dump() {
+    std::vector<std::shared_ptr<trace_buffer>> all;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        all = buffers;
+    }
+    uint64_t current = generation.load(std::memory_order_acquire);
+    nlohmann::json events = nlohmann::json::array();
+    for (const auto& b : all) {
+        std::vector<trace_record> records;
+        std::string thread_name;
+        uint32_t tid;
+        {
+            std::lock_guard<std::mutex> lock(b->mutex);
+            if (b->generation != current || b->written == 0) {
+                continue;
+            }
+            size_t size = b->ring.size();
+            uint64_t first = b->written > size ? b->written - size : 0;
+            records.reserve(static_cast<size_t>(b->written - first));
+            for (uint64_t i = first; i < b->written; ++i) {
+                records.push_back(b->ring[i % size]);
+            }
+            thread_name = b->thread_name;
+            tid = b->tid;
+        }
+        nlohmann::json meta;
+        meta["ph"] = "M";
+        meta["name"] = "thread_name";
+        meta["pid"] = 1;
+        meta["tid"] = tid;
+        meta["args"]["name"] = thread_name.empty() ? "thread " + std::to_string(tid) : thread_name;
+        events.push_back(meta);
+        for (const auto& r : records) {
+            if (r.phase == 'X') {
+                nlohmann::json e = event_json(r, "X", tid);
+                e["dur"] = r.dur;
+                events.push_back(e);
+                if (r.id != 0) {
+                    events.push_back(flow_json("f", r.id, r.ts, tid));
+                }
+            } else if (r.phase == 's') {
+                events.push_back(flow_json("s", r.id, r.ts, tid));
+            } else {
+                nlohmann::json e = event_json(r, "b", tid);
+                e["id"] = r.id;
+                events.push_back(e);
+                nlohmann::json end;
+                end["ph"] = "e";
+                end["name"] = r.name;
+                end["cat"] = r.category;
+                end["id"] = r.id;
+                end["ts"] = r.ts + r.dur;
+                end["pid"] = 1;
+                end["tid"] = tid;
+                events.push_back(end);
+            }
+        }
+    }
+    nlohmann::json doc;
+    doc["traceEvents"] = std::move(events);
+    doc["displayTimeUnit"] = "ms";
+    return doc.dump();
+}
+
+trace_span::trace_span(const char* span_name, const char* span_category, std::string_view span_detail) : name(span_name), category(span_category) {
+    if (tracing_enabled()) {
+        start_us = trace_now_us();
+        cause = current_cause;
+        copy_detail(detail, span_detail);
+    }
+}
+
+trace_span::~trace_span() {
+    if (start_us < 0) {
+        return;
+    }
+    trace_record r;
+    r.phase = 'X';
+    r.name = name;
+    r.category = category;
+    r.ts = start_us;
+    r.dur = trace_now_us() - start_us;
+    r.id = flow_in;
+    r.cause = cause;
+    memcpy(r.detail, detail, sizeof(detail));
+    record(r);
+}
+
+void trace_span::set_flow_in(uint64_t flow) {
+    flow_in = flow;
+}
+
+void trace_span::set_cause(uint64_t id) {
+    cause = id;
+}
+
+trace_cause::trace_cause(const char* span_name, const char* span_category, std::string_view span_detail, uint64_t id) : trace_span(span_name, span_category, span_detail) {
+    if (start_us >= 0) {
+        previous = current_cause;
+        cause = id != 0 ? id : next_id.fetch_add(1, std::memory_order_relaxed);
+        current_cause = cause;
+    }
+}
+
+trace_cause::~trace_cause() {
+    if (start_us >= 0) {
+        current_cause = previous;
+    }
+}
+
+uint64_t trace_cause::id() const {
+    return start_us >= 0 ? cause : 0;
+}
+
+uint64_t trace_flow_begin() {
+    if (!tracing_enabled() || current_cause == 0) {
+        return 0;
+    }
+    trace_record r;
+    r.phase = 's';
+    r.ts = trace_now_us();
+    r.id = next_id.fetch_add(1, std::memory_order_relaxed);
+    r.cause = current_cause;
+    record(r);
+    return r.id;
+}
+
+void trace_async(const char* name, const char* category, int64_t start_us, int64_t end_us, std::string_view detail, uint64_t cause, uint32_t status) {
+    if (!tracing_enabled()) {
+        return;
+    }
+    trace_record r;
+    r.phase = 'A';
+    r.name = name;
+    r.category = category;
+    r.ts = start_us;
+    r.dur = std::max<int64_t>(end_us - start_us, 0);
+    r.id = next_id.fetch_add(1, std::memory_order_relaxed);
+    r.cause = cause;
+    r.status = status;
+    copy_detail(r.detail, detail);
+    record(r);
+}
+
+}
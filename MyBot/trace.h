@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace mybot {
+
+/**
+ * @brief Set while tracing is on; read through tracing_enabled()
+ */
+extern std::atomic<bool> tracing_on;
+
+/**
+ * @brief Whether spans are being recorded. A relaxed load, so instrumented
+ * code costs one branch when tracing is off.
+ */
+inline bool tracing_enabled() {
+    return tracing_on.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Start recording spans, discarding any recorded before. Each thread
+ * records into its own ring buffer of this many records, allocated the first
+ * time it records; when it is full the oldest records are overwritten.
+ * @param records_per_thread ring buffer size
+ */
+void tracing_start(size_t records_per_thread = 16384);
+
+/**
+ * @brief Stop recording. What was recorded stays available to trace_dump().
+ */
+void tracing_stop();
+
+/**
+ * @brief Everything recorded, as Chrome trace event JSON, which
+ * chrome://tracing and ui.perfetto.dev open directly
+ */
+std::string trace_dump();
+
+/**
+ * @brief Name the calling thread in dumped traces
+ * @param name name, e.g. "shard 0"
+ */
+void trace_thread_name(const std::string& name);
+
+/**
+ * @brief Microseconds on the trace clock
+ */
+int64_t trace_now_us();
+
+/**
+ * @brief The cause of work on the calling thread: the id of the innermost
+ * trace_cause being run, or zero
+ */
+uint64_t trace_current_cause();
+
+/**
+ * @brief A timed span on the calling thread, recorded when it ends.
+ * Name, category and detail are copied only when tracing is on; name and
+ * category must be string literals.
+ */
+class trace_span {
+protected:
+    const char* name;
+    const char* category;
+    int64_t start_us{-1};
+    uint64_t flow_in{0};
+    uint64_t cause{0};
+    char detail[48]{};
+
+public:
+    /**
+     * @brief Start a span
+     * @param span_name name, a string literal
+     * @param span_category category, a string literal
+     * @param span_detail shown as the span's "detail" argument, truncated to 47 bytes
+     */
+    trace_span(const char* span_name, const char* span_category, std::string_view span_detail = {});
+
+    /**
+     * @brief Record the span
+     */
+    ~trace_span();
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+    /**
+     * @brief End a flow arrow at this span
+     * @param flow id from trace_flow_begin()
+     */
+    void set_flow_in(uint64_t flow);
+
+    /**
+     * @brief Tag the span with the cause it was for
+     * @param id cause id
+     */
+    void set_cause(uint64_t id);
+};
+
+/**
+ * @brief A span which starts a chain of cause and effect, e.g. handling one
+ * gateway event. While it runs, trace_current_cause() on this thread is its
+ * id, and REST requests made here are linked back to it in the dump.
+ */
+class trace_cause : public trace_span {
+    uint64_t previous{0};
+
+public:
+    /**
+     * @brief Start a span with a new cause id, or continue an existing one
+     * @param span_name name, a string literal
+     * @param span_category category, a string literal
+     * @param span_detail detail, see trace_span
+     * @param id cause to continue, or zero for a new one
+     */
+    trace_cause(const char* span_name, const char* span_category, std::string_view span_detail = {}, uint64_t id = 0);
+
+    /**
+     * @brief Record the span and restore the previous cause
+     */
+    ~trace_cause();
+
+    /**
+     * @brief This span's cause id, zero when tracing is off
+     */
+    uint64_t id() const;
+};
+
+/**
+ * @brief Start a flow arrow from the span running on this thread, if it
+ * belongs to a cause. Finish it with trace_span::set_flow_in() wherever the
+ * work continues.
+ * @return flow id, or zero if tracing is off or nothing here has a cause
+ */
+uint64_t trace_flow_begin();
+
+/**
+ * @brief Record a span which started on one thread and ended on another, e.g.
+ * a REST request, on a track of its own
+ * @param name name, a string literal
+ * @param category category, a string literal
+ * @param start_us start, from trace_now_us()
+ * @param end_us end
+ * @param detail detail, see trace_span
+ * @param cause cause id, or zero
+ * @param status shown as a "status" argument if not zero, e.g. an HTTP status
+ */
+void trace_async(const char* name, const char* category, int64_t start_us, int64_t end_us, std::string_view detail, uint64_t cause, uint32_t status = 0);
+
+/**
+ * @brief Wrap an event handler so that each call is a trace_cause
+ * @param name span name, a string literal, e.g. "interaction_create"
+ * @param handler handler
+ */
+template<typename F> auto traced(const char* name, F handler) {
+    return [name, handler = std::move(handler)](const auto& event) {
+        trace_cause span(name, "event");
+        handler(event);
+    };
+}
+
+}
@@ -0,0 +1,154 @@
+#include "warmup.h"
+#include <dpp/httpsclient.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace mybot {
+
+startup_phases::startup_phases() : origin(std::chrono::steady_clock::now()) {
+}
+
+double startup_phases::elapsed_ms() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void startup_phases::mark(const std::string& name) {
+    double ms = elapsed_ms();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& p : phases) {
+        if (p.name == name) {
+            return;
+        }
+    }
+    phases.push_back({name, ms});
+}
+
+double startup_phases::at(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& p : phases) {
+        if (p.name == name) {
+            return p.ms;
+        }
+    }
+    return -1;
+}
+
+std::string startup_phases::report() const {
+    std::vector<phase> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = phases;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const phase& a, const phase& b) { return a.ms < b.ms; });
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    double previous = 0;
+    for (const auto& p : sorted) {
+        out << std::left << std::setw(28) << p.name << std::right
+            << " +" << std::setw(9) << p.ms - previous << "ms"
+            << "  @" << std::setw(9) << p.ms << "ms\n";
+        previous = p.ms;
+    }
+    return out.str();
+}
+
+void startup_phases::log(dpp::cluster& bot) const {
+    bot.log(dpp::ll_info, "Startup timing:\n" + report());
+}
+
+connection_warmup::connection_warmup(dpp::cluster& cluster, dns_resolver& dns, startup_phases& timing, warmup_config cfg)
+    : bot(cluster), resolver(dns), phases(timing), config(std::move(cfg)) {
+}
+
+connection_warmup::~connection_warmup() {
+    for (auto& t : workers) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void connection_warmup::start() {
+    if (config.hosts.empty()) {
+        start_tls();
+        return;
+    }
+    outstanding = config.hosts.size();
+    for (const auto& host : config.hosts) {
+        resolver.resolve(host, 443, [this](const dns_result& r) {
+            resolved(r);
+        });
+    }
+}
+
+void connection_warmup::resolved(const dns_result& r) {
+    if (r.failed()) {
+        bot.log(dpp::ll_warning, "Warmup: can't resolve " + r.hostname + ": " + r.error);
+    } else {
+        std::string list;
+        for (const auto& a : r.addresses) {
+            list += (list.empty() ? "" : ", ") + a.str();
+        }
+        bot.log(dpp::ll_debug, "Warmup: " + r.hostname + " -> " + list + " (ttl " + std::to_string(r.ttl) + "s)");
+    }
+    if (--outstanding == 0) {
+        phases.mark("warmup dns");
+        start_tls();
+    }
+}
+
+void connection_warmup::start_tls() {
+    if (config.hosts.empty() || config.connections == 0) {
+        complete();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    outstanding = config.connections;
+    for (uint32_t i = 0; i < config.connections; ++i) {
+        workers.emplace_back([this] {
+            try {
+                dpp::https_client probe(config.hosts.front(), 443, config.probe_path, "GET", "", {{"User-Agent", "DiscordBot (https://github.com/brainboxdotcc/DPP, " + std::string(DPP_VERSION_TEXT) + ")"}}, false, config.timeout);
+                if (probe.get_status() == 0) {
+                    bot.log(dpp::ll_warning, "Warmup: no response from " + config.hosts.front());
+                }
+            }
+            catch (const std::exception& e) {
+                bot.log(dpp::ll_warning, "Warmup: request to " + config.hosts.front() + " failed: " + e.what());
+            }
+            if (--outstanding == 0) {
+                phases.mark("warmup tls");
+                complete();
+            }
+        });
+    }
+}
+
+void connection_warmup::complete() {
+    std::vector<std::function<void()>> run;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        run.swap(waiting);
+    }
+    for (auto& fn : run) {
+        fn();
+    }
+}
+
+void connection_warmup::when_ready(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!finished) {
+            waiting.emplace_back(std::move(fn));
+            return;
+        }
+    }
+    fn();
+}
+
+bool connection_warmup::done() const {
+    return finished;
+}
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include "dns_resolver.h"
+
+namespace mybot {
+
+/**
+ * @brief Records how long each part of startup took, relative to when
+ * this object was created. Safe to mark from any thread.
+ */
+class startup_phases {
+    struct phase {
+        std::string name;
+        double ms;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<phase> phases;
+
+public:
+    /**
+     * @brief Start the clock
+     */
+    startup_phases();
+
+    /**
+     * @brief Record that a phase has finished. Only the first mark
+     * of each phase name is kept.
+     * @param name phase name, e.g. "first shard ready"
+     */
+    void mark(const std::string& name);
+
+    /**
+     * @brief Milliseconds since the clock started
+     */
+    double elapsed_ms() const;
+
+    /**
+     * @brief Milliseconds at which a phase was marked, or a negative value
+     * if it has not been
+     * @param name phase name
+     */
+    double at(const std::string& name) const;
+
+    /**
+     * @brief One line per phase in the order they finished, with the time
+     * since the previous phase and since the start
+     */
+    std::string report() const;
+
+    /**
+     * @brief Write report() to the cluster log at ll_info
+     * @param bot cluster
+     */
+    void log(dpp::cluster& bot) const;
+};
+
+/**
+ * @brief Warmup settings
+ */
+struct warmup_config {
+    /**
+     * @brief Hosts to resolve. The REST host must be first.
+     */
+    std::vector<std::string> hosts{"discord.com", "gateway.discord.gg"};
+
+    /**
+     * @brief HTTPS requests to make to the REST host in parallel
+     */
+    uint32_t connections{2};
+
+    /**
+     * @brief Path to request. It must not need authorisation.
+     */
+    std::string probe_path{API_PATH "/gateway"};
+
+    /**
+     * @brief Per-request timeout in seconds
+     */
+    uint16_t timeout{5};
+};
+
+/**
+ * @brief Does the one-off work of a cold start in parallel, while the
+ * cluster is still connecting, rather than in series on the first REST
+ * call and the first shard connect.
+ *
+ * Phase "warmup dns" resolves every host in warmup_config::hosts at once
+ * through the dns_resolver. That resolver sends its own queries straight to
+ * the nameservers, so this only fills the dns_resolver's cache, for
+ * connections made through it; getaddrinfo() and D++ never see it. Phase
+ * "warmup tls" then makes `connections` unauthenticated HTTPS requests to
+ * the REST host on their own threads with dpp::https_client. These resolve
+ * the REST host through getaddrinfo(), which puts it into D++'s
+ * process-wide DNS cache (and any operating system cache), and initialise
+ * the TLS context and the system certificate store, so the first real
+ * request only pays for its own handshake. The gateway host is left for
+ * the shards to resolve themselves.
+ *
+ * D++ 10.0 opens a new connection for each REST request and each shard,
+ * and gives a bot no way to pass it a socket; nothing opened here is
+ * handed over, only the process-wide state they build.
+ */
+class connection_warmup {
+    dpp::cluster& bot;
+    dns_resolver& resolver;
+    startup_phases& phases;
+    warmup_config config;
+    std::mutex mutex;
+    std::vector<std::thread> workers;
+    std::vector<std::function<void()>> waiting;
+    std::atomic<size_t> outstanding{0};
+    std::atomic<bool> finished{false};
+
+    void resolved(const dns_result& r);
+    void start_tls();
+    void complete();
+
+public:
+    /**
+     * @brief Create a warmup. Nothing happens until start().
+     * @param cluster cluster, for logging
+     * @param dns resolver to use
+     * @param timing phases are recorded here
+     * @param cfg settings
+     */
+    connection_warmup(dpp::cluster& cluster, dns_resolver& dns, startup_phases& timing, warmup_config cfg = {});
+
+    /**
+     * @brief Waits for the HTTPS requests to finish
+     */
+    ~connection_warmup();
+
+    connection_warmup(const connection_warmup&) = delete;
+    connection_warmup& operator=(const connection_warmup&) = delete;
+
+    /**
+     * @brief Begin warming up. Returns immediately; call before cluster::start().
+     */
+    void start();
+
+    /**
+     * @brief Run a function once warmup has finished, or straight away on
+     * this thread if it already has. Use it for the first REST calls
+     * (e.g. command registration in on_ready).
+     * @param fn function to run. It may be called on a warmup thread.
+     */
+    void when_ready(std::function<void()> fn);
+
+    /**
+     * @brief True once every warmup phase has finished
+     */
+    bool done() const;
+};
+
+}
@@ -0,0 +1,355 @@
+#include "watchdog.h"
+#include "thread_placement.h"
+#include <algorithm>
+
+namespace mybot {
+
+namespace {
+
+/* What one thread is busy with. The task's name and detail are written under
+ * the lock before since_us is set, and read under it by the watchdog.
+ */
+struct task_slot {
+    std::mutex mutex;
+    std::atomic<int64_t> since_us{0};
+    const char* name{nullptr};
+    std::string detail;
+    std::string thread_name;
+    int depth{0};
+    int64_t reported_since{0};
+};
+
+std::mutex slots_mutex;
+std::vector<std::shared_ptr<task_slot>> slots;
+thread_local std::shared_ptr<task_slot> local_slot;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+int64_t now_us() {
+    /* Never zero, which marks an idle slot or no probe outstanding */
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+task_slot& this_thread_slot() {
+    if (!local_slot) {
+        local_slot = std::make_shared<task_slot>();
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        slots.push_back(local_slot);
+    }
+    return *local_slot;
+}
+
+std::string describe(task_slot& s) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.since_us.load(std::memory_order_acquire) == 0 || s.name == nullptr) {
+        return {};
+    }
+    return s.detail.empty() ? std::string(s.name) : std::string(s.name) + " (" + s.detail + ")";
+}
+
+/* The task running for a shard, found by the detail watched() gives it */
+std::string busy_task(const std::string& shard) {
+    std::vector<std::shared_ptr<task_slot>> current;
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        current = slots;
+    }
+    for (auto& s : current) {
+        bool match;
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            match = s->detail == shard;
+        }
+        if (match) {
+            std::string task = describe(*s);
+            if (!task.empty()) {
+                return task;
+            }
+        }
+    }
+    return {};
+}
+
+}
+
+watchdog_task::watchdog_task(const char* name, std::string_view detail) {
+    task_slot& s = this_thread_slot();
+    if (s.depth++ == 0) {
+        outermost = true;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.name = name;
+            s.detail.assign(detail.data(), detail.size());
+        }
+        s.since_us.store(now_us(), std::memory_order_release);
+    }
+}
+
+watchdog_task::~watchdog_task() {
+    task_slot& s = this_thread_slot();
+    s.depth--;
+    if (outermost) {
+        s.since_us.store(0, std::memory_order_release);
+    }
+}
+
+void watchdog_thread_name(const std::string& name) {
+    task_slot& s = this_thread_slot();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.thread_name = name;
+}
+
+enum loop_kind {
+    loop_io,
+    loop_timers,
+    loop_shard,
+};
+
+struct watchdog::loop_state {
+    loop_kind kind{loop_io};
+    std::string name;
+    io_loop* io{nullptr};
+    dpp::cluster* bot{nullptr};
+    uint32_t shard{0};
+
+    /* Written by the watched loop; thread_slot with atomic_store() */
+    std::atomic<int64_t> probe_sent_us{0};
+    std::atomic<int64_t> measured_us{0};
+    std::atomic<int64_t> last_tick_us{0};
+    std::shared_ptr<task_slot> thread_slot;
+
+    /* Written by the watchdog thread, read under the watchdog's lock */
+    double lag_ms{0};
+    double max_lag_ms{0};
+    uint64_t stalls{0};
+    bool stalled{false};
+    double stalled_ms{0};
+};
+
+watchdog::watchdog(const watchdog_config& cfg) : config(cfg) {
+    config.interval = std::max(config.interval, std::chrono::milliseconds(10));
+    thread = std::thread([this] { run(); });
+}
+
+watchdog::~watchdog() {
+    std::vector<std::pair<dpp::cluster*, dpp::timer>> stop;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        terminating = true;
+        stop.swap(timers);
+    }
+    cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    for (auto& [bot, t] : stop) {
+        bot->stop_timer(t);
+    }
+}
+
+void watchdog::watch(io_loop& io, const std::string& name) {
+    auto l = std::make_shared<loop_state>();
+    l->kind = loop_io;
+    l->name = name;
+    l->io = &io;
+    std::lock_guard<std::mutex> lock(mutex);
+    loops.push_back(l);
+}
+
+void watchdog::watch(dpp::cluster& bot) {
+    auto l = std::make_shared<loop_state>();
+    l->kind = loop_timers;
+    l->name = "timers";
+    l->bot = &bot;
+    l->last_tick_us = now_us();
+    dpp::timer t = bot.start_timer([l](dpp::timer) {
+        int64_t now = now_us();
+        int64_t last = l->last_tick_us.exchange(now);
+        l->measured_us = std::max<int64_t>(now - last - 1000000, 0);
+        this_thread_slot();
+        std::atomic_store(&l->thread_slot, local_slot);
+    }, 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    loops.push_back(l);
+    clusters.push_back(&bot);
+    timers.emplace_back(&bot, t);
+}
+
+std::vector<watchdog_lag> watchdog::lags() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<watchdog_lag> out;
+    out.reserve(loops.size());
+    for (const auto& l : loops) {
+        out.push_back({l->name, l->lag_ms, l->max_lag_ms, l->stalls});
+    }
+    return out;
+}
+
+void watchdog::run() {
+    name_this_thread("watchdog");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!terminating) {
+        cv.wait_for(lock, config.interval, [this] { return terminating; });
+        if (terminating) {
+            break;
+        }
+        lock.unlock();
+        check_shards();
+        std::vector<std::shared_ptr<loop_state>> current;
+        {
+            std::lock_guard<std::mutex> copy(mutex);
+            current = loops;
+        }
+        int64_t now = now_us();
+        for (auto& l : current) {
+            int64_t behind = 0;
+            if (l->kind == loop_io) {
+                int64_t sent = l->probe_sent_us.load();
+                if (sent == 0) {
+                    l->probe_sent_us = now;
+                    l->io->post([l, now] {
+                        l->measured_us = now_us() - now;
+                        if (!local_slot) {
+                            watchdog_thread_name(l->name);
+                        }
+                        std::atomic_store(&l->thread_slot, local_slot);
+                        l->probe_sent_us = 0;
+                    });
+                } else {
+                    behind = now - sent;
+                }
+            } else if (l->kind == loop_timers) {
+                behind = std::max<int64_t>(now - l->last_tick_us.load() - 1000000, 0);
+            }
+            if (l->kind == loop_shard) {
+                /* Set by check_shards() */
+                behind = l->measured_us.load();
+            } else {
+                behind = std::max(behind, l->measured_us.exchange(0));
+            }
+            std::string task;
+            if (std::shared_ptr<task_slot> s = std::atomic_load(&l->thread_slot)) {
+                task = describe(*s);
+            } else if (l->kind == loop_shard) {
+                task = busy_task(l->name);
+            }
+            check(*l, behind / 1000.0, task);
+        }
+        check_tasks();
+        lock.lock();
+    }
+}
+
+void watchdog::check(loop_state& l, double lag_ms, const std::string& task) {
+    bool over = lag_ms >= static_cast<double>(config.threshold.count());
+    watchdog_stall stall;
+    bool report = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        l.lag_ms = lag_ms;
+        l.max_lag_ms = std::max(l.max_lag_ms, lag_ms);
+        if (over && !l.stalled) {
+            l.stalled = true;
+            l.stalls++;
+            l.stalled_ms = lag_ms;
+            stall = {l.name, task, lag_ms, false};
+            report = true;
+        } else if (over) {
+            l.stalled_ms = std::max(l.stalled_ms, lag_ms);
+        } else if (l.stalled) {
+            l.stalled = false;
+            stall = {l.name, {}, std::max(l.stalled_ms, lag_ms), true};
+            report = true;
+        }
+    }
+    if (report && config.on_stall) {
+        config.on_stall(stall);
+    }
+}
+
+void watchdog::check_tasks() {
+    std::vector<std::shared_ptr<task_slot>> current;
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        /* Slots only this list still holds belong to threads which have exited */
+        slots.erase(std::remove_if(slots.begin(), slots.end(), [](const std::shared_ptr<task_slot>& s) {
+            return s.use_count() == 1 && s->reported_since == 0;
+        }), slots.end());
+        current = slots;
+    }
+    int64_t now = now_us();
+    int64_t threshold = static_cast<int64_t>(config.threshold.count()) * 1000;
+    for (auto& s : current) {
+        int64_t since = s->since_us.load(std::memory_order_acquire);
+        std::vector<watchdog_stall> found;
+        if (s->reported_since != 0 && since != s->reported_since) {
+            /* Ended some time in the last interval */
+            std::string thread_name;
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                thread_name = s->thread_name;
+            }
+            found.push_back({thread_name.empty() ? "thread" : thread_name, {}, (now - s->reported_since) / 1000.0, true});
+            s->reported_since = 0;
+        }
+        if (since != 0 && since != s->reported_since && now - since >= threshold) {
+            std::string thread_name;
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                thread_name = s->thread_name;
+            }
+            found.push_back({thread_name.empty() ? "thread" : thread_name, describe(*s), (now - since) / 1000.0, false});
+            s->reported_since = since;
+        }
+        for (const auto& stall : found) {
+            if (config.on_stall) {
+                config.on_stall(stall);
+            }
+        }
+    }
+}
+
+void watchdog::check_shards() {
+    std::vector<dpp::cluster*> bots;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bots = clusters;
+    }
+    time_t now = time(nullptr);
+    for (dpp::cluster* bot : bots) {
+        for (const auto& [id, shard] : bot->get_shards()) {
+            std::shared_ptr<loop_state> l;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& existing : loops) {
+                    if (existing->kind == loop_shard && existing->bot == bot && existing->shard == id) {
+                        l = existing;
+                    }
+                }
+                if (!l) {
+                    l = std::make_shared<loop_state>();
+                    l->kind = loop_shard;
+                    l->name = "shard " + std::to_string(id);
+                    l->bot = bot;
+                    l->shard = id;
+                    loops.push_back(l);
+                }
+            }
+            /* D++ sends a heartbeat from the shard's one second timer once
+             * 0.75 * heartbeat_interval has passed since the last one. How far
+             * past that the last send is, less a tick of slack for time_t
+             * resolution, shows how far behind the shard's thread is, well
+             * before the ACK is late enough for Discord to drop the shard.
+             */
+            int64_t behind = 0;
+            if (shard != nullptr && shard->ready && shard->heartbeat_interval > 0 && shard->last_heartbeat > 0) {
+                int64_t age_ms = static_cast<int64_t>(now - shard->last_heartbeat) * 1000;
+                int64_t due_ms = static_cast<int64_t>(shard->heartbeat_interval) * 3 / 4 + 1000;
+                behind = std::max<int64_t>(age_ms - due_ms, 0) * 1000;
+            }
+            l->measured_us = behind;
+        }
+    }
+}
+
+}
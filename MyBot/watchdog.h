@@ -0,0 +1,217 @@
+#pragma once
+#include "io_loop.h"
+#include <condition_variable>
+#include <string_view>
+
+namespace mybot {
+
+/**
+ * @brief A stall found by a watchdog
+ */
+struct watchdog_stall {
+    /**
+     * @brief What stalled: an io_loop's name, "timers", "shard 3", or the name
+     * of the thread a watchdog_task was running on
+     */
+    std::string loop;
+
+    /**
+     * @brief The task running when the stall was found, e.g.
+     * "message_create (shard 3)", or empty if unknown
+     */
+    std::string task;
+
+    /**
+     * @brief How long it has been stalled, or for an ended stall how long it
+     * lasted, in milliseconds
+     */
+    double stalled_ms{0};
+
+    /**
+     * @brief False when the stall is first found, true once it has ended
+     */
+    bool ended{false};
+};
+
+/**
+ * @brief Called on the watchdog thread when a stall starts and when it ends
+ */
+using watchdog_stall_t = std::function<void(const watchdog_stall&)>;
+
+/**
+ * @brief Settings for a watchdog
+ */
+struct watchdog_config {
+    /**
+     * @brief How often loops are probed and tasks checked
+     */
+    std::chrono::milliseconds interval{100};
+
+    /**
+     * @brief A loop or task this far behind is stalled. Discord's heartbeat
+     * interval is about 41 seconds, so a few seconds leaves plenty of warning.
+     */
+    std::chrono::milliseconds threshold{2000};
+
+    /**
+     * @brief Called for each stall
+     */
+    watchdog_stall_t on_stall;
+};
+
+/**
+ * @brief Lag measured for one loop
+ */
+struct watchdog_lag {
+    /**
+     * @brief Loop name
+     */
+    std::string loop;
+
+    /**
+     * @brief Most recent lag in milliseconds
+     */
+    double lag_ms{0};
+
+    /**
+     * @brief Largest lag seen
+     */
+    double max_lag_ms{0};
+
+    /**
+     * @brief Stalls found
+     */
+    uint64_t stalls{0};
+};
+
+/**
+ * @brief Marks the calling thread as busy with a task, so that a watchdog can
+ * name it if the thread stalls. Nested tasks report the outermost.
+ */
+class watchdog_task {
+    bool outermost{false};
+
+public:
+    /**
+     * @brief Start a task
+     * @param name name, a string literal, e.g. "message_create"
+     * @param detail more detail, e.g. "shard 3", copied
+     */
+    watchdog_task(const char* name, std::string_view detail = {});
+
+    /**
+     * @brief End the task
+     */
+    ~watchdog_task();
+
+    watchdog_task(const watchdog_task&) = delete;
+    watchdog_task& operator=(const watchdog_task&) = delete;
+};
+
+/**
+ * @brief Name the calling thread in stall reports
+ * @param name name, e.g. "io_loop"
+ */
+void watchdog_thread_name(const std::string& name);
+
+/**
+ * @brief Watches the bot's loops from a thread of its own and reports stalls.
+ *
+ * - An io_loop is probed by posting a function to it each interval; the time
+ *   until it runs is the loop's lag.
+ * - D++'s timers are probed by a one second cluster timer. D++ 10.0 ticks its
+ *   timers from the shards' one second timer, at one second resolution, so
+ *   this lag is only accurate to a second.
+ * - Each shard's last heartbeat send is checked against D++'s schedule of
+ *   one every 0.75 * heartbeat_interval. D++ sends heartbeats from the
+ *   shard's own thread, which also runs the event handlers, so a handler
+ *   which blocks delays them; this reports it a few seconds after the send
+ *   was due, long before Discord drops the connection.
+ * - Any thread inside a watchdog_task for longer than the threshold is
+ *   reported with the task's name, which is how a blocking handler is found.
+ *
+ * Stacks of other threads are not captured; wrap handlers with watched() so
+ * that stalls name the handler instead.
+ */
+class watchdog {
+    struct loop_state;
+
+    watchdog_config config;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<loop_state>> loops;
+    std::vector<dpp::cluster*> clusters;
+    std::vector<std::pair<dpp::cluster*, dpp::timer>> timers;
+    bool terminating{false};
+    std::thread thread;
+
+    void run();
+    void check(loop_state& l, double lag_ms, const std::string& task);
+    void check_tasks();
+    void check_shards();
+
+public:
+    /**
+     * @brief Start the watchdog thread
+     * @param cfg settings
+     */
+    explicit watchdog(const watchdog_config& cfg = {});
+
+    /**
+     * @brief Stop watching and join the thread
+     */
+    ~watchdog();
+
+    watchdog(const watchdog&) = delete;
+    watchdog& operator=(const watchdog&) = delete;
+
+    /**
+     * @brief Watch an io_loop. It must outlive the watchdog.
+     * @param io loop
+     * @param name name in reports
+     */
+    void watch(io_loop& io, const std::string& name);
+
+    /**
+     * @brief Watch a cluster's timers and shards. It must outlive the watchdog.
+     * @param bot cluster
+     */
+    void watch(dpp::cluster& bot);
+
+    /**
+     * @brief Lag of each loop watched
+     */
+    std::vector<watchdog_lag> lags() const;
+};
+
+/**
+ * @brief Wrap an event handler so that a watchdog can name it when it stalls
+ * its shard.
+ *
+ * With an io_loop or work_pool to offload to, the event is copied and the
+ * handler runs there instead, so the shard thread goes straight back to
+ * reading the gateway and sending heartbeats. A handler which then blocks
+ * stalls that loop or pool rather than the shard. Handlers which must answer
+ * within the event, such as those cancelling it, should not be offloaded.
+ * @param name name in reports, a string literal, e.g. "message_create"
+ * @param handler handler
+ * @param offload io_loop or work_pool to run the handler on, or nullptr to
+ * run it in place
+ */
+template<typename F, typename Executor = io_loop> auto watched(const char* name, F handler, Executor* offload = nullptr) {
+    return [name, offload, handler = std::make_shared<F>(std::move(handler))](const auto& event) {
+        std::string shard = event.from != nullptr ? "shard " + std::to_string(event.from->shard_id) : std::string();
+        if (offload == nullptr) {
+            watchdog_task task(name, shard);
+            (*handler)(event);
+            return;
+        }
+        using event_t = std::decay_t<decltype(event)>;
+        offload->post([name, handler, shard, copy = std::make_shared<event_t>(event)] {
+            watchdog_task task(name, shard);
+            (*handler)(*copy);
+        });
+    };
+}
+
+}
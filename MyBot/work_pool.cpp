@@ -0,0 +1,190 @@
+#include "work_pool.h"
+#include <algorithm>
+
+namespace mybot {
+
+work_pool::work_pool(const work_pool_config& cfg) : config(cfg) {
+    if (config.threads == 0) {
+        config.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    config.high_watermark = std::max<size_t>(config.high_watermark, 1);
+    if (config.low_watermark == 0 || config.low_watermark >= config.high_watermark) {
+        config.low_watermark = config.high_watermark / 2;
+    }
+    threads.reserve(config.threads);
+    for (uint32_t i = 0; i < config.threads; ++i) {
+        threads.emplace_back([this, i] { run(i); });
+    }
+}
+
+work_pool::~work_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        terminating = true;
+    }
+    work_ready.notify_all();
+    space_ready.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+bool work_pool::own_thread() const {
+    auto self = std::this_thread::get_id();
+    return std::any_of(threads.begin(), threads.end(), [self](const std::thread& t) {
+        return t.get_id() == self;
+    });
+}
+
+bool work_pool::enqueue(std::function<void()> fn, int priority) {
+    size_t high_at = 0;
+    std::function<void()> dropped;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (terminating) {
+            counters.rejected++;
+            return false;
+        }
+        if (queued >= config.high_watermark) {
+            switch (config.policy) {
+                case admit_reject:
+                    counters.rejected++;
+                    return false;
+                case admit_drop_oldest: {
+                    /* The least urgent class with anything waiting, unless the
+                     * new task is less urgent still
+                     */
+                    auto victim = std::find_if(queues.rbegin(), queues.rend(), [](const auto& q) {
+                        return !q.second.tasks.empty();
+                    });
+                    counters.dropped++;
+                    if (victim == queues.rend() || victim->first < priority) {
+                        return false;
+                    }
+                    /* Destroyed outside the lock, as it may own anything */
+                    dropped = std::move(victim->second.tasks.front().fn);
+                    victim->second.tasks.pop_front();
+                    queued--;
+                    break;
+                }
+                case admit_block: {
+                    if (own_thread()) {
+                        break;
+                    }
+                    counters.blocked++;
+                    auto waited_from = std::chrono::steady_clock::now();
+                    space_ready.wait(lock, [this] {
+                        return terminating || queued < config.high_watermark;
+                    });
+                    counters.blocked_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waited_from).count();
+                    if (terminating) {
+                        counters.rejected++;
+                        return false;
+                    }
+                    break;
+                }
+            }
+        }
+        priority_queue& q = queues[priority];
+        if (!q.depth) {
+            q.depth = std::make_shared<metric_histogram>(config.depth_buckets);
+            q.wait = std::make_shared<metric_histogram>(config.wait_buckets);
+        }
+        q.tasks.push_back({std::move(fn), std::chrono::steady_clock::now()});
+        q.depth->observe(static_cast<double>(q.tasks.size()));
+        queued++;
+        if (!high && queued >= config.high_watermark) {
+            high = true;
+            counters.high_watermarks++;
+            high_at = queued;
+        }
+    }
+    work_ready.notify_one();
+    if (high_at > 0 && config.on_high) {
+        config.on_high(high_at);
+    }
+    return true;
+}
+
+void work_pool::post(std::function<void()> fn) {
+    enqueue(std::move(fn), 0);
+}
+
+void work_pool::run(uint32_t index) {
+    if (!config.cpus.empty()) {
+        pin_this_thread(config.cpus);
+    }
+    name_this_thread(config.name + " " + std::to_string(index));
+    for (;;) {
+        task next;
+        size_t low_at = 0;
+        bool went_low = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this] {
+                return terminating || queued > 0;
+            });
+            if (queued == 0) {
+                return;
+            }
+            auto q = std::find_if(queues.begin(), queues.end(), [](const auto& entry) {
+                return !entry.second.tasks.empty();
+            });
+            next = std::move(q->second.tasks.front());
+            q->second.tasks.pop_front();
+            q->second.wait->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - next.queued).count());
+            queued--;
+            if (high && queued <= config.low_watermark) {
+                high = false;
+                went_low = true;
+                low_at = queued;
+            }
+            if (queued < config.high_watermark) {
+                space_ready.notify_one();
+            }
+        }
+        if (went_low && config.on_low) {
+            config.on_low(low_at);
+        }
+        next.fn();
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.completed++;
+    }
+}
+
+size_t work_pool::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued;
+}
+
+work_pool_stats work_pool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    work_pool_stats s = counters;
+    s.queued = queued;
+    s.priorities.clear();
+    for (const auto& [priority, q] : queues) {
+        s.priorities.push_back({priority, q.tasks.size(), q.depth, q.wait});
+    }
+    return s;
+}
+
+size_t add_work_pool_metrics(metrics_registry& registry, const work_pool& pool, const std::string& name) {
+    return registry.add_collector([&pool, name](metric_writer& w) {
+        work_pool_stats s = pool.stats();
+        metric_labels labels{{"pool", name}};
+        w.sample("mybot_pool_queued_tasks", "Tasks waiting", metric_gauge_type, labels, static_cast<double>(s.queued));
+        w.sample("mybot_pool_completed_tasks_total", "Tasks run", metric_counter_type, labels, static_cast<double>(s.completed));
+        w.sample("mybot_pool_rejected_tasks_total", "Tasks refused at the high watermark", metric_counter_type, labels, static_cast<double>(s.rejected));
+        w.sample("mybot_pool_dropped_tasks_total", "Tasks dropped at the high watermark", metric_counter_type, labels, static_cast<double>(s.dropped));
+        w.sample("mybot_pool_blocked_enqueues_total", "Enqueues which waited at the high watermark", metric_counter_type, labels, static_cast<double>(s.blocked));
+        w.sample("mybot_pool_blocked_seconds_total", "Time enqueues spent waiting at the high watermark", metric_counter_type, labels, s.blocked_seconds);
+        w.sample("mybot_pool_high_watermarks_total", "Times the queue reached the high watermark", metric_counter_type, labels, static_cast<double>(s.high_watermarks));
+        for (const auto& p : s.priorities) {
+            metric_labels priority{{"pool", name}, {"priority", std::to_string(p.priority)}};
+            w.histogram("mybot_pool_queue_depth", "Depth of the priority's queue at each enqueue", priority, *p.depth);
+            w.histogram("mybot_pool_queue_wait_seconds", "Time from enqueue to starting", priority, *p.wait);
+        }
+    });
+}
+
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include "metrics.h"
+#include "thread_placement.h"
+#include <condition_variable>
+
+namespace mybot {
+
+/**
+ * @brief What a work_pool does with a task enqueued at its high watermark
+ */
+enum admission_policy {
+    /**
+     * @brief Refuse the task; enqueue() returns false
+     */
+    admit_reject,
+
+    /**
+     * @brief Accept the task and drop the oldest task of the least urgent
+     * priority waiting, which may be the new task itself
+     */
+    admit_drop_oldest,
+
+    /**
+     * @brief Wait until the queue is below the high watermark. A caller on
+     * one of the pool's own threads is admitted at once instead, as waiting
+     * there could never end.
+     */
+    admit_block,
+};
+
+/**
+ * @brief Called with the number of tasks queued when a watermark is crossed
+ */
+using watermark_t = std::function<void(size_t queued)>;
+
+/**
+ * @brief Settings for a work_pool
+ */
+struct work_pool_config {
+    /**
+     * @brief Worker threads; zero for one per hardware thread
+     */
+    uint32_t threads{0};
+
+    /**
+     * @brief CPUs the workers run on, or empty for any. Each worker pins
+     * itself before allocating anything, so its stack and thread local arenas
+     * are on those CPUs' NUMA node.
+     */
+    cpu_list cpus;
+
+    /**
+     * @brief Workers are named this and their index, e.g. "pool 3", for
+     * profilers, traces and stall reports
+     */
+    std::string name{"pool"};
+
+    /**
+     * @brief Queued tasks, across all priorities, at which admission control
+     * starts and on_high is called
+     */
+    size_t high_watermark{10000};
+
+    /**
+     * @brief Queued tasks at which on_low is called after on_high; zero for
+     * half the high watermark
+     */
+    size_t low_watermark{0};
+
+    /**
+     * @brief What to do at the high watermark
+     */
+    admission_policy policy{admit_block};
+
+    /**
+     * @brief Called when the queue reaches the high watermark, on the
+     * enqueueing thread
+     */
+    watermark_t on_high;
+
+    /**
+     * @brief Called when the queue drains to the low watermark, on a worker
+     */
+    watermark_t on_low;
+
+    /**
+     * @brief Upper bounds of the queue depth histograms
+     */
+    std::vector<double> depth_buckets{1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+    /**
+     * @brief Upper bounds of the queue wait histograms, in seconds
+     */
+    std::vector<double> wait_buckets{0.0001, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+};
+
+/**
+ * @brief Counters for one priority of a work_pool
+ */
+struct work_priority_stats {
+    /**
+     * @brief Priority
+     */
+    int priority{0};
+
+    /**
+     * @brief Tasks waiting now
+     */
+    size_t queued{0};
+
+    /**
+     * @brief Depth of this priority's queue as seen by each enqueue,
+     * the new task included
+     */
+    std::shared_ptr<const metric_histogram> depth;
+
+    /**
+     * @brief Time from enqueue to starting, in seconds
+     */
+    std::shared_ptr<const metric_histogram> wait;
+};
+
+/**
+ * @brief Totals for a work_pool
+ */
+struct work_pool_stats {
+    /**
+     * @brief Tasks waiting, across every priority
+     */
+    size_t queued{0};
+
+    /**
+     * @brief Tasks run to completion
+     */
+    uint64_t completed{0};
+
+    /**
+     * @brief Tasks refused by admit_reject
+     */
+    uint64_t rejected{0};
+
+    /**
+     * @brief Tasks dropped by admit_drop_oldest
+     */
+    uint64_t dropped{0};
+
+    /**
+     * @brief Enqueues which had to wait under admit_block
+     */
+    uint64_t blocked{0};
+
+    /**
+     * @brief Total time enqueues spent waiting under admit_block, in seconds
+     */
+    double blocked_seconds{0};
+
+    /**
+     * @brief Times the high watermark was reached
+     */
+    uint64_t high_watermarks{0};
+
+    /**
+     * @brief Per priority figures, most urgent first
+     */
+    std::vector<work_priority_stats> priorities;
+};
+
+/**
+ * @brief A bounded thread pool with priorities, for work taken off the shard
+ * threads.
+ *
+ * D++ 10.0 does not export its thread_pool, and its queue is unbounded: in a
+ * burst it grows until memory runs out while latency climbs unseen. Tasks
+ * here wait in a queue per priority, lower numbers first, as in D++, and
+ * first in first out within one. Once high_watermark tasks are waiting, new
+ * ones are rejected, displace the oldest least urgent task, or wait, as
+ * configured.
+ *
+ * With admit_block, a shard thread whose handlers are offloaded here with
+ * watched() stops in enqueue() while the pool is full. It stops reading the
+ * gateway for that long, so TCP pushes back on Discord instead of the backlog
+ * growing in memory. on_high and on_low report the same transitions to code
+ * which throttles some other way.
+ */
+class work_pool {
+    struct task {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct priority_queue {
+        std::deque<task> tasks;
+        std::shared_ptr<metric_histogram> depth;
+        std::shared_ptr<metric_histogram> wait;
+    };
+
+    work_pool_config config;
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable space_ready;
+    std::map<int, priority_queue> queues;
+    size_t queued{0};
+    bool high{false};
+    bool terminating{false};
+    work_pool_stats counters;
+    std::vector<std::thread> threads;
+
+    void run(uint32_t index);
+    bool own_thread() const;
+
+public:
+    /**
+     * @brief Start the workers
+     * @param cfg settings
+     */
+    explicit work_pool(const work_pool_config& cfg = {});
+
+    /**
+     * @brief Run the tasks already queued, then join the workers. Tasks
+     * enqueued meanwhile are rejected.
+     */
+    ~work_pool();
+
+    work_pool(const work_pool&) = delete;
+    work_pool& operator=(const work_pool&) = delete;
+
+    /**
+     * @brief Queue a task
+     * @param fn task
+     * @param priority priority, lower first
+     * @return false if the task was rejected, or dropped on arrival
+     */
+    bool enqueue(std::function<void()> fn, int priority = 0);
+
+    /**
+     * @brief Queue a task at priority zero, for watched()
+     * @param fn task
+     */
+    void post(std::function<void()> fn);
+
+    /**
+     * @brief Tasks waiting
+     */
+    size_t size() const;
+
+    /**
+     * @brief Counters so far
+     */
+    work_pool_stats stats() const;
+};
+
+/**
+ * @brief Report a work_pool's queue depth and wait histograms per priority,
+ * and its admission counters
+ * @param registry registry
+ * @param pool pool, which must outlive the registry or the collector
+ * @param name value of the "pool" label
+ * @return collector id
+ */
+size_t add_work_pool_metrics(metrics_registry& registry, const work_pool& pool, const std::string& name);
+
+}
@@ -0,0 +1,237 @@
+#include "ws_codec.h"
+#include <cstring>
+#include <random>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MYBOT_WS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MYBOT_WS_SSE2
+#endif
+
+namespace mybot {
+
+void ws_mask(char* data, size_t len, const uint8_t key[4], size_t offset) {
+    /* Rotate the key so that data[0] lines up with key[0]; every wide step
+     * below is a multiple of four bytes, so it stays lined up.
+     */
+    uint8_t rotated[4];
+    for (size_t i = 0; i < 4; ++i) {
+        rotated[i] = key[(offset + i) & 3];
+    }
+    uint32_t k32;
+    memcpy(&k32, rotated, 4);
+    size_t i = 0;
+
+#if defined(MYBOT_WS_AVX2)
+    const __m256i k256 = _mm256_set1_epi32(static_cast<int>(k32));
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(v, k256));
+    }
+#elif defined(MYBOT_WS_SSE2)
+    const __m128i k128 = _mm_set1_epi32(static_cast<int>(k32));
+    for (; i + 32 <= len; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(a, k128));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i + 16), _mm_xor_si128(b, k128));
+    }
+#endif
+
+    const uint64_t k64 = (static_cast<uint64_t>(k32) << 32) | k32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= k64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i) {
+        data[i] = static_cast<char>(data[i] ^ rotated[i & 3]);
+    }
+}
+
+size_t ws_frame_header(char* out, ws_opcode opcode, uint64_t payload_len, bool fin, const uint8_t* key) {
+    auto* p = reinterpret_cast<uint8_t*>(out);
+    size_t pos = 0;
+    p[pos++] = static_cast<uint8_t>((fin ? 0x80 : 0x00) | (opcode & 0x0f));
+    uint8_t mask_bit = key ? 0x80 : 0x00;
+    if (payload_len < 126) {
+        p[pos++] = static_cast<uint8_t>(mask_bit | payload_len);
+    } else if (payload_len <= 0xffff) {
+        p[pos++] = mask_bit | 126;
+        p[pos++] = static_cast<uint8_t>(payload_len >> 8);
+        p[pos++] = static_cast<uint8_t>(payload_len);
+    } else {
+        p[pos++] = mask_bit | 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            p[pos++] = static_cast<uint8_t>(payload_len >> shift);
+        }
+    }
+    if (key) {
+        memcpy(p + pos, key, 4);
+        pos += 4;
+    }
+    return pos;
+}
+
+void ws_encode(std::string& out, ws_opcode opcode, std::string_view payload, bool mask) {
+    uint8_t key[4];
+    if (mask) {
+        thread_local std::mt19937 rng{std::random_device{}()};
+        uint32_t k = rng();
+        memcpy(key, &k, 4);
+    }
+    char header[ws_max_header];
+    size_t header_len = ws_frame_header(header, opcode, payload.size(), true, mask ? key : nullptr);
+    size_t at = out.size();
+    out.resize(at + header_len + payload.size());
+    memcpy(&out[at], header, header_len);
+    if (!payload.empty()) {
+        memcpy(&out[at + header_len], payload.data(), payload.size());
+        if (mask) {
+            ws_mask(&out[at + header_len], payload.size(), key);
+        }
+    }
+}
+
+ws_reader::ws_reader(bool server_side, size_t max_message_size, size_t initial_capacity)
+    : buffer(initial_capacity), server(server_side), max_message(max_message_size) {
+}
+
+char* ws_reader::prepare(size_t min_space, size_t& space) {
+    if (buffer.size() - end < min_space && start > 0) {
+        /* Slide the unconsumed bytes down to the front */
+        memmove(buffer.data(), buffer.data() + start, end - start);
+        end -= start;
+        parse -= start;
+        if (in_message) {
+            message_begin -= start;
+        }
+        start = 0;
+    }
+    if (buffer.size() - end < min_space) {
+        buffer.resize(std::max(buffer.size() * 2, end + min_space));
+    }
+    space = buffer.size() - end;
+    return buffer.data() + end;
+}
+
+void ws_reader::commit(size_t n) {
+    end += n;
+}
+
+void ws_reader::feed(std::string_view data) {
+    size_t space;
+    char* into = prepare(data.size(), space);
+    memcpy(into, data.data(), data.size());
+    commit(data.size());
+}
+
+ws_status ws_reader::next(ws_message& out) {
+    for (;;) {
+        if (!in_message) {
+            start = parse;
+        }
+        size_t available = end - parse;
+        if (available < 2) {
+            return ws_need_more;
+        }
+        const auto* h = reinterpret_cast<const uint8_t*>(buffer.data() + parse);
+        bool fin = (h[0] & 0x80) != 0;
+        auto opcode = static_cast<ws_opcode>(h[0] & 0x0f);
+        bool masked = (h[1] & 0x80) != 0;
+        uint64_t len = h[1] & 0x7f;
+        size_t header_len = 2;
+        if (h[0] & 0x70) {
+            /* No extensions are negotiated, so RSV bits must be clear */
+            return ws_error;
+        }
+        if (len == 126) {
+            if (available < 4) {
+                return ws_need_more;
+            }
+            len = (uint64_t(h[2]) << 8) | h[3];
+            header_len = 4;
+        } else if (len == 127) {
+            if (available < 10) {
+                return ws_need_more;
+            }
+            len = 0;
+            for (int i = 0; i < 8; ++i) {
+                len = (len << 8) | h[2 + i];
+            }
+            header_len = 10;
+        }
+        if (masked != server) {
+            return ws_error;
+        }
+        const uint8_t* key = masked ? h + header_len : nullptr;
+        if (masked) {
+            header_len += 4;
+        }
+        bool control = (opcode & 0x08) != 0;
+        /* 0xB-0xF are reserved control opcodes; RFC 6455 5.2 fails the connection */
+        if (control && (!fin || len > 125 || opcode > ws_pong)) {
+            return ws_error;
+        }
+        if (len > max_message || (opcode == ws_continuation && message_len + len > max_message)) {
+            return ws_too_big;
+        }
+        if (available < header_len || available - header_len < len) {
+            return ws_need_more;
+        }
+
+        size_t payload_at = parse + header_len;
+        char* payload = buffer.data() + payload_at;
+        if (masked) {
+            uint8_t k[4];
+            memcpy(k, key, 4);
+            ws_mask(payload, static_cast<size_t>(len), k);
+        }
+        parse = payload_at + static_cast<size_t>(len);
+
+        if (control) {
+            out.opcode = opcode;
+            out.payload = std::string_view(payload, static_cast<size_t>(len));
+            return ws_ok;
+        }
+        if (opcode == ws_continuation) {
+            if (!in_message) {
+                return ws_error;
+            }
+            memmove(buffer.data() + message_begin + message_len, payload, static_cast<size_t>(len));
+            message_len += static_cast<size_t>(len);
+            if (!fin) {
+                continue;
+            }
+            in_message = false;
+            out.opcode = message_opcode;
+            out.payload = std::string_view(buffer.data() + message_begin, message_len);
+            return ws_ok;
+        }
+        if ((opcode != ws_text && opcode != ws_binary) || in_message) {
+            return ws_error;
+        }
+        if (fin) {
+            out.opcode = opcode;
+            out.payload = std::string_view(payload, static_cast<size_t>(len));
+            return ws_ok;
+        }
+        in_message = true;
+        message_opcode = opcode;
+        message_begin = payload_at;
+        message_len = static_cast<size_t>(len);
+        start = message_begin;
+    }
+}
+
+size_t ws_reader::buffered() const {
+    return end - start;
+}
+
+size_t ws_reader::capacity() const {
+    return buffer.size();
+}
+
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mybot {
+
+/**
+ * @brief WebSocket frame opcodes (RFC 6455 section 5.2)
+ */
+enum ws_opcode : uint8_t {
+    ws_continuation = 0x0,
+    ws_text = 0x1,
+    ws_binary = 0x2,
+    ws_close = 0x8,
+    ws_ping = 0x9,
+    ws_pong = 0xA,
+};
+
+/**
+ * @brief Result of ws_reader::next()
+ */
+enum ws_status {
+    /**
+     * @brief A message was returned
+     */
+    ws_ok,
+
+    /**
+     * @brief Not enough data for a whole frame; read more from the socket
+     */
+    ws_need_more,
+
+    /**
+     * @brief Protocol violation; close the connection with status 1002
+     */
+    ws_error,
+
+    /**
+     * @brief Message larger than the reader accepts; close the connection
+     * with status 1009
+     */
+    ws_too_big,
+};
+
+/**
+ * @brief Largest header ws_frame_header() can write
+ */
+constexpr size_t ws_max_header = 14;
+
+/**
+ * @brief XOR a buffer with a WebSocket masking key, in place. Masking and
+ * unmasking are the same operation.
+ *
+ * Works 32 bytes at a time with AVX2 if the build enables it, otherwise with
+ * two SSE2 registers (always present on x64), otherwise eight bytes at a time
+ * in a uint64_t; the last few bytes are done one at a time.
+ *
+ * @param data buffer
+ * @param len length of buffer
+ * @param key the four key bytes, in the order they appear on the wire
+ * @param offset position of data[0] within the whole payload, so that a
+ * payload can be masked in pieces
+ */
+void ws_mask(char* data, size_t len, const uint8_t key[4], size_t offset = 0);
+
+/**
+ * @brief Write a frame header
+ * @param out buffer of at least ws_max_header bytes
+ * @param opcode opcode
+ * @param payload_len payload length
+ * @param fin true if this is the last frame of the message
+ * @param key masking key, or nullptr for an unmasked (server to client) frame
+ * @return header length
+ */
+size_t ws_frame_header(char* out, ws_opcode opcode, uint64_t payload_len, bool fin = true, const uint8_t* key = nullptr);
+
+/**
+ * @brief Append one complete frame to a string. Client frames are masked
+ * with a random key, as RFC 6455 requires.
+ * @param out string to append to
+ * @param opcode opcode
+ * @param payload payload
+ * @param mask true to mask (client to server)
+ */
+void ws_encode(std::string& out, ws_opcode opcode, std::string_view payload, bool mask);
+
+/**
+ * @brief A message returned by ws_reader. The payload points into the
+ * reader's buffer.
+ */
+struct ws_message {
+    /**
+     * @brief Opcode of the message; never ws_continuation
+     */
+    ws_opcode opcode{ws_text};
+
+    /**
+     * @brief Unmasked payload of the whole message
+     */
+    std::string_view payload;
+};
+
+/**
+ * @brief Parses WebSocket frames out of a receive buffer without copying them.
+ *
+ * Read from the socket straight into prepare() and commit() what arrived, then
+ * call next() until it stops returning ws_ok. Each message is unmasked in place
+ * and returned as a string_view into the buffer.
+ *
+ * A fragmented message is joined up in the buffer as its frames arrive: each
+ * continuation payload is moved down once to sit after the previous one,
+ * over the header that separated them, so the whole message is one view with
+ * no separate accumulation string and no reallocation. Control frames in the
+ * middle of a fragmented message are returned as they arrive.
+ *
+ * A returned payload stays valid until the next call to any non-const member.
+ */
+class ws_reader {
+    std::vector<char> buffer;
+    /* Offsets into buffer: first byte still needed, end of data, next frame header */
+    size_t start{0};
+    size_t end{0};
+    size_t parse{0};
+    bool server;
+    size_t max_message;
+    bool in_message{false};
+    ws_opcode message_opcode{ws_text};
+    size_t message_begin{0};
+    size_t message_len{0};
+
+public:
+    /**
+     * @brief Create a reader
+     * @param server_side true if the peer is a client, whose frames must be
+     * masked; false if the peer is a server, whose frames must not be
+     * @param max_message_size largest message to accept
+     * @param initial_capacity initial buffer size
+     */
+    explicit ws_reader(bool server_side, size_t max_message_size = 64 * 1024 * 1024, size_t initial_capacity = 64 * 1024);
+
+    /**
+     * @brief Get space to read into, making at least min_space bytes available
+     * @param min_space bytes wanted
+     * @param space set to the space available, which may be more
+     * @return where to write
+     */
+    char* prepare(size_t min_space, size_t& space);
+
+    /**
+     * @brief Mark bytes written after prepare() as received
+     * @param n bytes written
+     */
+    void commit(size_t n);
+
+    /**
+     * @brief Copy received data in, for callers which already have it in
+     * another buffer
+     * @param data received data
+     */
+    void feed(std::string_view data);
+
+    /**
+     * @brief Parse the next message
+     * @param out message, if ws_ok is returned
+     * @return status
+     */
+    ws_status next(ws_message& out);
+
+    /**
+     * @brief Bytes received but not yet returned in a message
+     */
+    size_t buffered() const;
+
+    /**
+     * @brief Current buffer capacity
+     */
+    size_t capacity() const;
+};
+
+}
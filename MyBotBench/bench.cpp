@@ -0,0 +1,187 @@
+#include "bench.h"
+#include "gateway_record.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace mybot::bench {
+
+void runner::set_filters(const std::vector<std::string>& f) {
+    filters = f;
+}
+
+bool runner::wanted(const std::string& group, const std::string& name) const {
+    if (filters.empty()) {
+        return true;
+    }
+    std::string full = group + "/" + name;
+    for (const auto& f : filters) {
+        if (full.find(f) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+result& runner::add(const std::string& group, const std::string& name, uint64_t iterations, uint32_t threads, double seconds, size_t bytes_per_op) {
+    result res;
+    res.group = group;
+    res.name = name;
+    res.iterations = iterations;
+    res.threads = threads;
+    if (iterations > 0 && seconds > 0) {
+        res.ns_per_op = seconds * 1e9 / static_cast<double>(iterations);
+        res.ops_per_second = static_cast<double>(iterations) / seconds;
+        res.bytes_per_second = res.ops_per_second * static_cast<double>(bytes_per_op);
+    }
+    std::cerr << group << "/" << name << ": " << res.ns_per_op << " ns/op";
+    if (threads > 1) {
+        std::cerr << " (" << threads << " threads)";
+    }
+    std::cerr << "\n";
+    results.push_back(std::move(res));
+    return results.back();
+}
+
+dpp::cluster& offline_cluster() {
+    static dpp::cluster bot("bench");
+    return bot;
+}
+
+const std::vector<result>& runner::all() const {
+    return results;
+}
+
+nlohmann::json runner::to_json() const {
+    nlohmann::json doc;
+    doc["suite"] = "mybot-bench";
+    doc["dpp_version"] = DPP_VERSION_TEXT;
+#if defined(_MSC_VER)
+    doc["compiler"] = "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+    doc["compiler"] = std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    doc["compiler"] = std::string("gcc ") + __VERSION__;
+#endif
+#ifdef NDEBUG
+    doc["build"] = "release";
+#else
+    doc["build"] = "debug";
+#endif
+    doc["pointer_bits"] = sizeof(void*) * 8;
+    doc["hardware_threads"] = std::thread::hardware_concurrency();
+    doc["started"] = dpp::ts_to_string(time(nullptr));
+    doc["min_time_ms"] = min_time.count();
+    doc["results"] = nlohmann::json::array();
+    for (const auto& r : results) {
+        nlohmann::json j;
+        j["group"] = r.group;
+        j["name"] = r.name;
+        j["iterations"] = r.iterations;
+        j["threads"] = r.threads;
+        j["ns_per_op"] = r.ns_per_op;
+        j["ops_per_second"] = r.ops_per_second;
+        if (r.bytes_per_second > 0) {
+            j["bytes_per_second"] = r.bytes_per_second;
+        }
+        for (const auto& [key, value] : r.extra) {
+            j[key] = value;
+        }
+        doc["results"].push_back(j);
+    }
+    return doc;
+}
+
+}
+
+namespace {
+
+void load_payloads(mybot::bench::payload_set& payloads, const std::string& dir) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().extension() != ".json") {
+            continue;
+        }
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        payloads[entry.path().stem().string()] = ss.str();
+    }
+    if (ec) {
+        std::cerr << "Can't read payloads from " << dir << ": " << ec.message() << "\n";
+    }
+}
+
+/* The largest frame of each event type in a gateway recording, as "rec:EVENT" */
+void load_recording(mybot::bench::payload_set& payloads, const std::string& file) {
+    mybot::gateway_reader reader(file);
+    mybot::gateway_frame frame;
+    while (reader.next(frame)) {
+        nlohmann::json j = nlohmann::json::parse(frame.payload, nullptr, false);
+        if (j.is_discarded() || j.value("op", -1) != 0 || !j.contains("t") || !j["t"].is_string()) {
+            continue;
+        }
+        std::string& slot = payloads["rec:" + j["t"].get<std::string>()];
+        if (frame.payload.size() > slot.size()) {
+            slot = frame.payload;
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--loadgen") {
+        return mybot::bench::run_loadgen(argc, argv);
+    }
+    mybot::bench::runner r;
+    std::string out;
+    std::string payload_dir = "payloads";
+    std::string recording;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (arg == "--payloads" && i + 1 < argc) {
+            payload_dir = argv[++i];
+        } else if (arg == "--recording" && i + 1 < argc) {
+            recording = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            r.min_time = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: MyBotBench [--out results.json] [--payloads dir] [--recording file] [--min-time ms] [filter...]\n"
+                << "       MyBotBench --loadgen --help\n";
+            return 0;
+        } else {
+            filters.push_back(arg);
+        }
+    }
+    r.set_filters(filters);
+    load_payloads(r.payloads, payload_dir);
+    if (!recording.empty()) {
+        load_recording(r.payloads, recording);
+    }
+    if (r.payloads.empty()) {
+        std::cerr << "No payloads found; decode benchmarks will be skipped\n";
+    }
+
+    mybot::bench::decode_benchmarks(r);
+    mybot::bench::cache_benchmarks(r);
+    mybot::bench::dispatch_benchmarks(r);
+    mybot::bench::rest_benchmarks(r);
+
+    std::string doc = r.to_json().dump(2);
+    if (out.empty()) {
+        std::cout << doc << "\n";
+    } else {
+        std::ofstream f(out, std::ios::binary);
+        f << doc << "\n";
+        if (!f) {
+            std::cerr << "Can't write " << out << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
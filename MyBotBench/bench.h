@@ -0,0 +1,231 @@
+#pragma once
+#include <dpp/dpp.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mybot::bench {
+
+/**
+ * @brief One measurement
+ */
+struct result {
+    /**
+     * @brief Group, e.g. "decode"
+     */
+    std::string group;
+
+    /**
+     * @brief Name, unique within the run, e.g. "json_fill/MESSAGE_CREATE"
+     */
+    std::string name;
+
+    /**
+     * @brief Operations timed
+     */
+    uint64_t iterations{0};
+
+    /**
+     * @brief Threads the operations ran on
+     */
+    uint32_t threads{1};
+
+    /**
+     * @brief Wall time per operation, across all threads
+     */
+    double ns_per_op{0};
+
+    /**
+     * @brief Operations per second, across all threads
+     */
+    double ops_per_second{0};
+
+    /**
+     * @brief Input bytes per second, if the operation has an input size
+     */
+    double bytes_per_second{0};
+
+    /**
+     * @brief Extra figures, e.g. latency percentiles
+     */
+    std::map<std::string, double> extra;
+};
+
+/**
+ * @brief Gateway payloads to benchmark against, by event name
+ */
+using payload_set = std::map<std::string, std::string>;
+
+/**
+ * @brief Runs benchmarks and collects their results
+ */
+class runner {
+    std::vector<result> results;
+    std::vector<std::string> filters;
+
+public:
+    /**
+     * @brief Minimum time each measurement runs for
+     */
+    std::chrono::milliseconds min_time{500};
+
+    /**
+     * @brief Payloads loaded for this run
+     */
+    payload_set payloads;
+
+    /**
+     * @brief Only run benchmarks whose full name contains one of these;
+     * run everything if empty
+     * @param f substrings
+     */
+    void set_filters(const std::vector<std::string>& f);
+
+    /**
+     * @brief Returns true if a benchmark was asked for. Check this before any
+     * expensive setup.
+     * @param group group
+     * @param name name
+     */
+    bool wanted(const std::string& group, const std::string& name) const;
+
+    /**
+     * @brief Time body(n) on this thread, growing n until a run takes at
+     * least min_time
+     * @param group group
+     * @param name name
+     * @param body runs the operation n times
+     * @param bytes_per_op input size of one operation, zero if none
+     * @return the result, or nullptr if the benchmark was filtered out
+     */
+    template<typename F> result* measure(const std::string& group, const std::string& name, F&& body, size_t bytes_per_op = 0) {
+        if (!wanted(group, name)) {
+            return nullptr;
+        }
+        uint64_t n = 1;
+        double seconds = 0;
+        for (;;) {
+            auto start = std::chrono::steady_clock::now();
+            body(n);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double target = std::chrono::duration<double>(min_time).count();
+            if (seconds >= target || n >= (1ull << 40)) {
+                break;
+            }
+            double grow = seconds < target / 100 ? 10 : std::min(10.0, std::max(1.5, target / seconds * 1.2));
+            n = static_cast<uint64_t>(n * grow) + 1;
+        }
+        return &add(group, name, n, 1, seconds, bytes_per_op);
+    }
+
+    /**
+     * @brief Run body(thread, stop) on each of `threads` threads for
+     * min_time. Each call returns the operations it completed.
+     * @param group group
+     * @param name name
+     * @param threads thread count
+     * @param body operation loop; stops when stop becomes true
+     * @return the result, or nullptr if the benchmark was filtered out
+     */
+    template<typename F> result* measure_threads(const std::string& group, const std::string& name, uint32_t threads, F&& body) {
+        if (!wanted(group, name)) {
+            return nullptr;
+        }
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> total{0};
+        std::vector<std::thread> pool;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t] {
+                total += body(t, stop);
+            });
+        }
+        std::this_thread::sleep_for(min_time);
+        stop = true;
+        for (auto& th : pool) {
+            th.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return &add(group, name, total, threads, seconds, 0);
+    }
+
+    /**
+     * @brief Record a measurement taken some other way
+     * @param group group
+     * @param name name
+     * @param iterations operations
+     * @param threads threads
+     * @param seconds wall time
+     * @param bytes_per_op input size of one operation, zero if none
+     * @return the stored result, for adding extra figures
+     */
+    result& add(const std::string& group, const std::string& name, uint64_t iterations, uint32_t threads, double seconds, size_t bytes_per_op);
+
+    /**
+     * @brief All results so far
+     */
+    const std::vector<result>& all() const;
+
+    /**
+     * @brief The run as a JSON document: build details and every result
+     */
+    nlohmann::json to_json() const;
+};
+
+/**
+ * @brief Where keep() writes
+ */
+inline const void* volatile keep_sink{nullptr};
+
+/**
+ * @brief Stop the compiler discarding a value that is otherwise unused
+ * @param value value
+ */
+template<typename T> inline void keep(const T& value) {
+    keep_sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+/**
+ * @brief A cluster which is never started, for benchmarks which need its
+ * timers or HTTP client. Created on first use.
+ */
+dpp::cluster& offline_cluster();
+
+/**
+ * @brief Decoding benchmarks: JSON and ETF parsing, object fill per event
+ * type, a handler's per event scratch data on the heap and in an event_arena,
+ * and the bot's fast_parse routines against what D++ uses. Built with
+ * MYBOT_COUNT_ALLOCATIONS, the scratch results also report heap allocations
+ * per event.
+ */
+void decode_benchmarks(runner& r);
+
+/**
+ * @brief dpp::cache find and store under contention
+ */
+void cache_benchmarks(runner& r);
+
+/**
+ * @brief Event router fan-out and timer churn
+ */
+void dispatch_benchmarks(runner& r);
+
+/**
+ * @brief REST queue throughput against a local stand-in server
+ */
+void rest_benchmarks(runner& r);
+
+/**
+ * @brief Serve synthetic gateway traffic with gateway_loadgen until the
+ * duration passes or the process is stopped, printing its counters
+ * @param argc argument count
+ * @param argv arguments, see --loadgen --help
+ * @return exit code
+ */
+int run_loadgen(int argc, char** argv);
+
+}
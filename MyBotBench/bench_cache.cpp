@@ -0,0 +1,79 @@
+#include "bench.h"
+#include <random>
+
+namespace mybot::bench {
+
+namespace {
+
+constexpr uint64_t prefill = 100000;
+
+/* Frees everything still in the cache. Nothing is ever replaced or removed
+ * while benchmarking, so the deletion queue is not involved.
+ */
+void empty_cache(dpp::cache<dpp::role>& c) {
+    std::unique_lock lock(c.get_mutex());
+    auto& container = c.get_container();
+    for (auto& [id, object] : container) {
+        delete object;
+    }
+    container.clear();
+}
+
+void fill_cache(dpp::cache<dpp::role>& c) {
+    for (uint64_t i = 1; i <= prefill; ++i) {
+        dpp::role* r = new dpp::role();
+        r->id = i;
+        r->name = "role" + std::to_string(i);
+        c.store(r);
+    }
+}
+
+}
+
+void cache_benchmarks(runner& r) {
+    dpp::cache<dpp::role> c;
+    fill_cache(c);
+
+    r.measure("cache", "find", [&](uint64_t n) {
+        uint64_t hits = 0;
+        std::mt19937_64 rng(1);
+        for (uint64_t i = 0; i < n; ++i) {
+            hits += c.find(1 + rng() % prefill) != nullptr;
+        }
+        keep(hits);
+    });
+
+    std::atomic<uint64_t> next_id{prefill + 1};
+    r.measure("cache", "store", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            dpp::role* role = new dpp::role();
+            role->id = next_id++;
+            c.store(role);
+        }
+    });
+
+    /* 95% finds, 5% stores of new ids: roughly a busy bot's cache traffic */
+    for (uint32_t threads : {1u, 2u, 4u, 8u}) {
+        r.measure_threads("cache", "mixed_95_5/" + std::to_string(threads) + "t", threads, [&](uint32_t t, std::atomic<bool>& stop) {
+            std::mt19937_64 rng(t + 1);
+            uint64_t ops = 0, hits = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i, ++ops) {
+                    if (rng() % 100 < 5) {
+                        dpp::role* role = new dpp::role();
+                        role->id = next_id++;
+                        c.store(role);
+                    } else {
+                        hits += c.find(1 + rng() % prefill) != nullptr;
+                    }
+                }
+            }
+            keep(hits);
+            return ops;
+        });
+    }
+
+    empty_cache(c);
+}
+
+}
@@ -0,0 +1,258 @@
+#include "bench.h"
+#include "event_arena.h"
+#include "fast_parse.h"
+#include <dpp/etf.h>
+#include <cstdio>
+#include <functional>
+#include <random>
+
+namespace mybot::bench {
+
+namespace {
+
+using fill_t = std::function<void(nlohmann::json& d)>;
+
+void fill_members(nlohmann::json& members, dpp::snowflake guild_id) {
+    for (auto& m : members) {
+        dpp::user u;
+        u.fill_from_json(&m["user"]);
+        dpp::guild_member gm;
+        gm.fill_from_json(&m, guild_id, u.id);
+        keep(gm);
+    }
+}
+
+/* What D++'s event handler builds from each event's "d", without touching
+ * the cache, so that one event type can be compared across D++ versions
+ */
+const std::map<std::string, fill_t>& fills() {
+    static const std::map<std::string, fill_t> table{
+        {"MESSAGE_CREATE", [](nlohmann::json& d) {
+            dpp::message m;
+            m.fill_from_json(&d, {dpp::cp_none, dpp::cp_none, dpp::cp_none});
+            keep(m);
+        }},
+        {"GUILD_CREATE", [](nlohmann::json& d) {
+            dpp::guild g;
+            g.fill_from_json(&d);
+            for (auto& c : d["channels"]) {
+                dpp::channel ch;
+                ch.fill_from_json(&c);
+                keep(ch);
+            }
+            for (auto& r : d["roles"]) {
+                dpp::role role;
+                role.fill_from_json(g.id, &r);
+                keep(role);
+            }
+            fill_members(d["members"], g.id);
+            keep(g);
+        }},
+        {"GUILD_MEMBERS_CHUNK", [](nlohmann::json& d) {
+            fill_members(d["members"], json_snowflake(d, "guild_id"));
+        }},
+        {"PRESENCE_UPDATE", [](nlohmann::json& d) {
+            dpp::presence p;
+            p.fill_from_json(&d);
+            keep(p);
+        }},
+        {"INTERACTION_CREATE", [](nlohmann::json& d) {
+            dpp::interaction i;
+            i.fill_from_json(&d);
+            keep(i);
+        }},
+        {"CHANNEL_CREATE", [](nlohmann::json& d) {
+            dpp::channel c;
+            c.fill_from_json(&d);
+            keep(c);
+        }},
+        {"TYPING_START", [](nlohmann::json& d) {
+            dpp::user u;
+            u.fill_from_json(&d["member"]["user"]);
+            dpp::guild_member m;
+            m.fill_from_json(&d["member"], json_snowflake(d, "guild_id"), u.id);
+            keep(m);
+        }},
+        {"MESSAGE_REACTION_ADD", [](nlohmann::json& d) {
+            dpp::user u;
+            u.fill_from_json(&d["member"]["user"]);
+            dpp::guild_member m;
+            m.fill_from_json(&d["member"], json_snowflake(d, "guild_id"), u.id);
+            keep(m);
+        }},
+    };
+    return table;
+}
+
+/* The scratch data a handler typically builds while handling one event:
+ * every id in it, and the name of each object which has one
+ */
+void index_event(const nlohmann::json& j, arena_vector<uint64_t>& ids, arena_map<uint64_t, arena_string>& names) {
+    if (j.is_object()) {
+        auto id = j.find("id");
+        if (id != j.end() && id->is_string()) {
+            uint64_t value = parse_snowflake(id->get_ref<const std::string&>());
+            ids.push_back(value);
+            auto name = j.find(j.contains("username") ? "username" : "name");
+            if (name != j.end() && name->is_string()) {
+                names.emplace(value, std::string_view(name->get_ref<const std::string&>()));
+            }
+        }
+    }
+    if (j.is_structured()) {
+        for (const auto& child : j) {
+            index_event(child, ids, names);
+        }
+    }
+}
+
+/* Heap allocations made by one call, when built with MYBOT_COUNT_ALLOCATIONS */
+template<typename F> void count_allocations(result* res, F&& once) {
+#ifdef MYBOT_COUNT_ALLOCATIONS
+    if (res != nullptr) {
+        uint64_t before = thread_allocations().allocations;
+        once();
+        res->extra["heap_allocations"] = static_cast<double>(thread_allocations().allocations - before);
+    }
+#else
+    (void)res;
+    (void)once;
+#endif
+}
+
+void scratch_benchmarks(runner& r, const std::string& name, const nlohmann::json& d) {
+    auto heap = [&d] {
+        arena_vector<uint64_t> ids(std::pmr::new_delete_resource());
+        arena_map<uint64_t, arena_string> names(std::pmr::new_delete_resource());
+        index_event(d, ids, names);
+        keep(ids);
+        keep(names);
+    };
+    /* The containers go out of scope before the arena_scope releases them */
+    auto arena = [&d] {
+        arena_scope scope;
+        arena_vector<uint64_t> ids(scope.get_resource());
+        arena_map<uint64_t, arena_string> names(scope.get_resource());
+        index_event(d, ids, names);
+        keep(ids);
+        keep(names);
+    };
+    count_allocations(r.measure("decode", "scratch_heap/" + name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            heap();
+        }
+    }), heap);
+    count_allocations(r.measure("decode", "scratch_arena/" + name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            arena();
+        }
+    }), arena);
+}
+
+void payload_benchmarks(runner& r, const std::string& name, const std::string& text) {
+    nlohmann::json frame = nlohmann::json::parse(text, nullptr, false);
+    if (frame.is_discarded()) {
+        return;
+    }
+    r.measure("decode", "json_parse/" + name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            nlohmann::json j = nlohmann::json::parse(text);
+            keep(j);
+        }
+    }, text.size());
+
+    dpp::etf_parser etf;
+    std::string etf_bytes = etf.build(frame);
+    r.measure("decode", "etf_parse/" + name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            nlohmann::json j = etf.parse(etf_bytes);
+            keep(j);
+        }
+    }, etf_bytes.size());
+
+    std::string event = name.rfind("rec:", 0) == 0 ? name.substr(4) : name;
+    auto fill = fills().find(event);
+    if (fill != fills().end() && frame.contains("d")) {
+        nlohmann::json& d = frame["d"];
+        r.measure("decode", "fill/" + name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                fill->second(d);
+            }
+        });
+    }
+    if (frame.contains("d")) {
+        scratch_benchmarks(r, name, frame["d"]);
+    }
+}
+
+void parse_benchmarks(runner& r) {
+    std::mt19937_64 rng(1);
+    std::vector<std::string> ids(1024);
+    std::vector<uint64_t> values(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        values[i] = 700000000000000000ull + rng() % 500000000000000000ull;
+        ids[i] = std::to_string(values[i]);
+    }
+    r.measure("parse", "snowflake/fast_parse", [&](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            sum += parse_snowflake(ids[i & 1023]);
+        }
+        keep(sum);
+    });
+    r.measure("parse", "snowflake/stoull", [&](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            sum += std::stoull(ids[i & 1023]);
+        }
+        keep(sum);
+    });
+    r.measure("parse", "snowflake_format/fast_parse", [&](uint64_t n) {
+        char buffer[24];
+        size_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            total += format_snowflake(values[i & 1023], buffer);
+        }
+        keep(total);
+    });
+    r.measure("parse", "snowflake_format/to_string", [&](uint64_t n) {
+        size_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            total += std::to_string(values[i & 1023]).size();
+        }
+        keep(total);
+    });
+
+    std::vector<nlohmann::json> stamps(256);
+    for (size_t i = 0; i < stamps.size(); ++i) {
+        char iso[40];
+        snprintf(iso, sizeof(iso), "%04d-%02d-%02dT%02d:%02d:%02d.%06d+00:00", static_cast<int>(2016 + rng() % 9), static_cast<int>(1 + rng() % 12), static_cast<int>(1 + rng() % 28),
+            static_cast<int>(rng() % 24), static_cast<int>(rng() % 60), static_cast<int>(rng() % 60), static_cast<int>(rng() % 1000000));
+        stamps[i]["timestamp"] = iso;
+    }
+    r.measure("parse", "timestamp/fast_parse", [&](uint64_t n) {
+        time_t sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            sum += json_timestamp(stamps[i & 255], "timestamp");
+        }
+        keep(sum);
+    });
+    r.measure("parse", "timestamp/ts_not_null", [&](uint64_t n) {
+        time_t sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            sum += dpp::ts_not_null(&stamps[i & 255], "timestamp");
+        }
+        keep(sum);
+    });
+}
+
+}
+
+void decode_benchmarks(runner& r) {
+    for (const auto& [name, text] : r.payloads) {
+        payload_benchmarks(r, name, text);
+    }
+    parse_benchmarks(r);
+}
+
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "io_loop.h"
+
+namespace mybot::bench {
+
+namespace {
+
+void fanout_benchmarks(runner& r) {
+    dpp::message_create_t event(nullptr, "");
+    auto payload = r.payloads.find("MESSAGE_CREATE");
+    if (payload != r.payloads.end()) {
+        nlohmann::json frame = nlohmann::json::parse(payload->second, nullptr, false);
+        if (!frame.is_discarded() && frame.contains("d")) {
+            event.msg.fill_from_json(&frame["d"], {dpp::cp_none, dpp::cp_none, dpp::cp_none});
+        }
+    }
+
+    for (size_t listeners : {1, 8, 64}) {
+        dpp::event_router_t<dpp::message_create_t> router;
+        std::atomic<uint64_t> seen{0};
+        for (size_t i = 0; i < listeners; ++i) {
+            router([&seen](const dpp::message_create_t& e) {
+                if (!e.msg.content.empty()) {
+                    seen.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        r.measure("dispatch", "fanout/" + std::to_string(listeners), [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                router.call(event);
+            }
+        });
+        keep(seen.load());
+    }
+}
+
+void timer_benchmarks(runner& r) {
+    if (r.wanted("dispatch", "timer_churn/io_loop")) {
+        io_loop io;
+        r.measure("dispatch", "timer_churn/io_loop", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                io.cancel(io.after(std::chrono::seconds(60), [] {}));
+            }
+        });
+    }
+    if (r.wanted("dispatch", "timer_churn/cluster")) {
+        dpp::cluster& bot = offline_cluster();
+        r.measure("dispatch", "timer_churn/cluster", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                bot.stop_timer(bot.start_timer([](dpp::timer) {}, 60));
+            }
+        });
+    }
+}
+
+}
+
+void dispatch_benchmarks(runner& r) {
+    fanout_benchmarks(r);
+    timer_benchmarks(r);
+}
+
+}
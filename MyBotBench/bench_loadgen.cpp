@@ -0,0 +1,80 @@
+#include "bench.h"
+#include "gateway_loadgen.h"
+#include <iostream>
+
+namespace mybot::bench {
+
+namespace {
+
+void print_stats(const loadgen_stats& s, double seconds) {
+    std::cerr << static_cast<uint64_t>(seconds) << "s: " << s.connections << " connected, " << s.identifies << " identifies, " << s.resumes << " resumes ("
+        << s.failed_resumes << " failed), " << s.guild_creates << " guild creates, " << s.member_chunks << " chunks, " << s.events << " events ("
+        << s.skipped << " skipped for backlog), " << s.bytes / (1024 * 1024) << " MiB sent\n";
+}
+
+}
+
+int run_loadgen(int argc, char** argv) {
+    loadgen_config config;
+    uint16_t port = 8765;
+    double duration = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            return i + 1 < argc ? argv[++i] : "";
+        };
+        if (arg == "--loadgen") {
+            continue;
+        } else if (arg == "--port") {
+            port = static_cast<uint16_t>(std::atoi(value().c_str()));
+        } else if (arg == "--guilds") {
+            config.guilds = static_cast<uint32_t>(std::atol(value().c_str()));
+        } else if (arg == "--members") {
+            config.members_per_guild = static_cast<uint32_t>(std::atol(value().c_str()));
+        } else if (arg == "--channels") {
+            config.channels_per_guild = static_cast<uint32_t>(std::atol(value().c_str()));
+        } else if (arg == "--eps") {
+            config.events_per_second = std::atof(value().c_str());
+        } else if (arg == "--mix") {
+            /* message,presence,typing,reaction */
+            std::string mix = value();
+            for (size_t k = 0, pos = 0; k < config.mix.size() && pos <= mix.size(); ++k) {
+                size_t comma = mix.find(',', pos);
+                config.mix[k] = std::atof(mix.substr(pos, comma - pos).c_str());
+                pos = comma == std::string::npos ? mix.size() + 1 : comma + 1;
+            }
+        } else if (arg == "--chunk-flood") {
+            config.chunk_flood = true;
+        } else if (arg == "--storm-every") {
+            config.storm_every = std::atof(value().c_str());
+        } else if (arg == "--storm") {
+            std::string kind = value();
+            config.storm = kind == "drop" ? storm_drop : kind == "invalid" ? storm_invalid_session : storm_reconnect;
+        } else if (arg == "--storm-fraction") {
+            config.storm_fraction = std::atof(value().c_str());
+        } else if (arg == "--duration") {
+            duration = std::atof(value().c_str());
+        } else {
+            std::cerr << "Usage: MyBotBench --loadgen [--port 8765] [--guilds n] [--members n] [--channels n] [--eps n] [--mix m,p,t,r]\n"
+                << "    [--chunk-flood] [--storm-every s] [--storm reconnect|drop|invalid] [--storm-fraction f] [--duration s]\n";
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    io_loop io;
+    gateway_loadgen gateway(io, config, port);
+    std::cerr << "Serving " << config.guilds << " guilds of " << config.members_per_guild << " members at " << gateway.url()
+        << "; put TLS on 127.0.0.1:443 in front of it and run the bot with MYBOT_LOADGEN_GATEWAY=127.0.0.1\n";
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        print_stats(gateway.stats(), seconds);
+        if (duration > 0 && seconds >= duration) {
+            break;
+        }
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,125 @@
+#include "bench.h"
+#include "io_loop.h"
+#include "retry_engine.h"
+#include "standin_server.h"
+#include <algorithm>
+#include <condition_variable>
+
+namespace mybot::bench {
+
+namespace {
+
+constexpr size_t in_flight = 32;
+
+/* Starts one request and calls done with its HTTP status */
+using issue_t = std::function<void(std::function<void(uint32_t)>)>;
+
+/* Keeps in_flight requests outstanding until min_time has passed, then
+ * records throughput and latency percentiles
+ */
+class closed_loop {
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<double> latencies;
+    uint64_t failed{0};
+    size_t outstanding{0};
+    std::chrono::steady_clock::time_point deadline;
+    issue_t issue;
+
+    void next() {
+        auto sent = std::chrono::steady_clock::now();
+        issue([this, sent](uint32_t status) {
+            auto now = std::chrono::steady_clock::now();
+            std::unique_lock lock(mutex);
+            latencies.push_back(std::chrono::duration<double, std::milli>(now - sent).count());
+            failed += status != 200;
+            if (now < deadline) {
+                lock.unlock();
+                next();
+                return;
+            }
+            if (--outstanding == 0) {
+                idle.notify_all();
+            }
+        });
+    }
+
+public:
+    explicit closed_loop(issue_t fn) : issue(std::move(fn)) {
+    }
+
+    result& run(runner& r, const std::string& name) {
+        auto start = std::chrono::steady_clock::now();
+        deadline = start + r.min_time;
+        {
+            std::lock_guard lock(mutex);
+            outstanding = in_flight;
+        }
+        for (size_t i = 0; i < in_flight; ++i) {
+            next();
+        }
+        std::unique_lock lock(mutex);
+        /* Requests time out after five seconds, so this always finishes */
+        idle.wait(lock, [this] { return outstanding == 0; });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result& res = r.add("rest", name, latencies.size(), 1, seconds, 0);
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [this](double p) {
+            return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+        };
+        res.extra["in_flight"] = in_flight;
+        res.extra["failed"] = static_cast<double>(failed);
+        res.extra["p50_ms"] = percentile(0.5);
+        res.extra["p99_ms"] = percentile(0.99);
+        res.extra["max_ms"] = latencies.empty() ? 0.0 : latencies.back();
+        return res;
+    }
+};
+
+}
+
+void rest_benchmarks(runner& r) {
+    bool plain = r.wanted("rest", "request");
+    bool retried = r.wanted("rest", "request_retry");
+    if (!plain && !retried) {
+        return;
+    }
+    io_loop io;
+    standin_server server(io);
+    dpp::cluster& bot = offline_cluster();
+    std::string url = server.url() + "/bench";
+
+    if (plain) {
+        closed_loop([&](std::function<void(uint32_t)> done) {
+            bot.request(url, dpp::m_get, [done](const dpp::http_request_completion_t& http) {
+                done(http.status);
+            });
+        }).run(r, "request");
+    }
+
+    if (retried) {
+        /* One response in ten is a 503, and one connection in fifty is reset */
+        standin_faults faults;
+        faults.error_rate = 0.1;
+        faults.reset_rate = 0.02;
+        server.set_faults(faults);
+        retry_config cfg;
+        cfg.retry.base_delay = std::chrono::milliseconds(1);
+        cfg.retry.max_delay = std::chrono::milliseconds(20);
+        cfg.breaker.failure_threshold = 1000;
+        retry_engine engine(io, cfg);
+        result& res = closed_loop([&](std::function<void(uint32_t)> done) {
+            engine.request(bot, url, dpp::m_get, [done](const dpp::http_request_completion_t& http) {
+                done(http.status);
+            });
+        }).run(r, "request_retry");
+        retry_stats stats = engine.stats();
+        res.extra["attempts"] = static_cast<double>(stats.attempts);
+        res.extra["retries"] = static_cast<double>(stats.retries);
+        res.extra["exhausted"] = static_cast<double>(stats.exhausted);
+        res.extra["budget_denied"] = static_cast<double>(stats.budget_denied);
+    }
+}
+
+}